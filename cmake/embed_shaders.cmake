@@ -0,0 +1,22 @@
+# Writes every shader in src/shaders into OUTPUT as raw string literals, keyed by the same
+# src/shaders/<name> path the renderer passes to its shader objects.
+# usage: cmake -DSOURCE_DIR=<repo> -DOUTPUT=<header> -P embed_shaders.cmake
+file(GLOB SHADERS RELATIVE ${SOURCE_DIR} ${SOURCE_DIR}/src/shaders/*.vert ${SOURCE_DIR}/src/shaders/*.frag)
+list(SORT SHADERS)
+
+set(CONTENT "// generated from src/shaders by cmake/embed_shaders.cmake\n")
+string(APPEND CONTENT "#ifndef EMBEDDED_SHADERS_H\n#define EMBEDDED_SHADERS_H\n\n")
+string(APPEND CONTENT "struct embeddedShader {\n    const char *path;\n    const char *source;\n};\n\n")
+string(APPEND CONTENT "static const embeddedShader EMBEDDED_SHADERS[] = {\n")
+
+foreach(SHADER ${SHADERS})
+    file(READ ${SOURCE_DIR}/${SHADER} SOURCE)
+    string(FIND "${SOURCE}" ")glsl\"" CLASH)
+    if(NOT CLASH EQUAL -1)
+        message(FATAL_ERROR "${SHADER} contains the raw string delimiter )glsl\"")
+    endif()
+    string(APPEND CONTENT "    {\"${SHADER}\", R\"glsl(${SOURCE})glsl\"},\n")
+endforeach()
+
+string(APPEND CONTENT "};\n\n#endif\n")
+file(WRITE ${OUTPUT} "${CONTENT}")
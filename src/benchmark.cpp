@@ -0,0 +1,501 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <map>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include "utilities/physics.h"
+#include "utilities/generators.h"
+#include "utilities/potential_map.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#elif !defined(__linux__)
+#include <sys/resource.h>
+#endif
+
+#ifndef GRAVITY_COMMIT
+#define GRAVITY_COMMIT "unknown"
+#endif
+
+// Reproducible benchmark of the force solvers, the integrators and the CPU side of a rendered frame.
+// Every case starts from the same seeded Plummer sphere, body counts grow by 10x from --min-bodies to
+// --max-bodies, and the results are written as JSON so two commits can be compared case by case.
+// Cases predicted to take longer than --budget seconds are recorded as skipped instead of run.
+
+struct benchmarkOptions {
+    size_t minBodies = 100;
+    size_t maxBodies = 1000000;
+    long steps = 20;
+    long frames = 30;
+    int repeats = 3;
+    double budget = 10.0;
+    std::string outputPath = "benchmark.json";
+    std::string label;
+    std::vector<forceSolver> solvers = {forceSolver::direct, forceSolver::barnesHut, forceSolver::particleMesh, forceSolver::fastMultipole};
+    std::vector<integratorType> integrators = {integratorType::euler, integratorType::leapfrog, integratorType::verlet, integratorType::yoshida4, integratorType::block};
+};
+
+// Hand-rolled writer for the flat records the benchmark produces.
+class jsonRecord {
+private:
+    std::ostringstream text;
+    bool first = true;
+
+    std::ostringstream& key(const std::string &name) {
+        text << (first ? "" : ", ") << '"' << name << "\": ";
+        first = false;
+        return text;
+    }
+public:
+    jsonRecord() {
+        text.precision(9);
+    }
+
+    jsonRecord& add(const std::string &name, const std::string &value) { key(name) << '"' << value << '"'; return *this; }
+    jsonRecord& add(const std::string &name, const char *value) { return add(name, std::string(value)); }
+    jsonRecord& add(const std::string &name, bool value) { key(name) << (value ? "true" : "false"); return *this; }
+
+    template<typename Number>
+    jsonRecord& add(const std::string &name, Number value) {
+        // JSON has no nan or inf
+        if(std::isfinite((double)value)) key(name) << value;
+        else key(name) << "null";
+        return *this;
+    }
+
+    std::string str() const { return "{" + text.str() + "}"; }
+};
+
+using clock_type = std::chrono::steady_clock;
+
+double secondsSince(clock_type::time_point start);
+size_t residentBytes(bool peak);
+size_t bodyBytes(bodyStore &bodies);
+bool parseList(const std::string &list, benchmarkOptions &options, bool solvers);
+double predictedMilliseconds(forceSolver solver, size_t count, size_t previousCount, double previousMs);
+void linearMomentum(const bodyStore &bodies, double (&momentum)[3], double &scale);
+std::string runForces(const bodyStore &initial, forceSolver solver, const benchmarkOptions &options, double &milliseconds);
+std::string runIntegrator(const bodyStore &initial, forceSolver solver, integratorType type, const benchmarkOptions &options);
+std::string runFrames(const bodyStore &initial, forceSolver solver, const benchmarkOptions &options, bool scattered);
+int main(int argc, char **argv) {
+    benchmarkOptions options;
+    bool solversGiven = false;
+
+    for(int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if(physicsEngine::parseArgument(argc, argv, i)) continue;
+
+        if(arg == "--output" && i + 1 < argc) {
+            options.outputPath = argv[++i];
+        }
+        else if(arg == "--label" && i + 1 < argc) {
+            options.label = argv[++i];
+        }
+        else if(arg == "--min-bodies" && i + 1 < argc) {
+            options.minBodies = std::max<size_t>(2, std::stoul(argv[++i]));
+        }
+        else if(arg == "--max-bodies" && i + 1 < argc) {
+            options.maxBodies = std::stoul(argv[++i]);
+        }
+        else if(arg == "--steps" && i + 1 < argc) {
+            options.steps = std::max(1l, std::stol(argv[++i]));
+        }
+        else if(arg == "--frames" && i + 1 < argc) {
+            options.frames = std::max(0l, std::stol(argv[++i]));
+        }
+        else if(arg == "--repeats" && i + 1 < argc) {
+            options.repeats = std::max(1, std::stoi(argv[++i]));
+        }
+        else if(arg == "--budget" && i + 1 < argc) {
+            options.budget = std::stod(argv[++i]);
+        }
+        else if(arg == "--solvers" && i + 1 < argc) {
+            if(!parseList(argv[++i], options, true)) return 1;
+            solversGiven = true;
+        }
+        else if(arg == "--integrators" && i + 1 < argc) {
+            if(!parseList(argv[++i], options, false)) return 1;
+        }
+        else {
+            std::cout << "Unknown argument: " << arg << '\n';
+            std::cout << "Usage: benchmark [--output <file.json>] [--label <name>] [--min-bodies N] [--max-bodies N] [--steps N] [--frames N]" << '\n'
+                      << "                 [--repeats N] [--budget seconds] [--solvers direct,barnes-hut,pm,fmm] [--integrators euler,leapfrog,...] [solver options]" << '\n';
+            return 1;
+        }
+    }
+
+    // the default sweep quietly leaves out solvers that cannot run the selected law or precision,
+    // naming one in --solvers is an error
+    for(auto solver = options.solvers.begin(); solver != options.solvers.end();) {
+        const char *reason = physicsEngine::unsupportedCombination(*solver);
+        if(!reason) {
+            solver++;
+            continue;
+        }
+        if(solversGiven) {
+            std::cout << reason << '\n';
+            return 1;
+        }
+        solver = options.solvers.erase(solver);
+    }
+
+    // frames run with the integrator picked on the command line, the sweep below overwrites it
+    integratorType frameIntegrator = physicsEngine::integration;
+
+    std::vector<std::string> forces, integrators, frames;
+    // last measured force evaluation per solver, to predict the next body count
+    std::map<forceSolver, std::pair<size_t, double>> lastForce;
+
+    for(size_t count = options.minBodies; count <= options.maxBodies; count *= 10) {
+        generatorSettings settings;
+        settings.count = count;
+        settings.mass = 20000.0f;
+        settings.radius = 150.0f;
+        settings.density = 0.05f;
+
+        bodyStore initial;
+        generators::plummer(initial, settings, physicsEngine::GRAVITY, physicsEngine::threads > 1 ? &physicsEngine::getPool() : nullptr);
+
+        for(forceSolver solver : options.solvers) {
+            const char *name = physicsEngine::solverName(solver);
+
+            // once a solver is over budget every larger count is skipped too
+            auto last = lastForce.find(solver);
+            bool previousSkipped = last != lastForce.end() && last->second.second < 0.0;
+            double predicted = last == lastForce.end() || previousSkipped ? 0.0 : predictedMilliseconds(solver, count, last->second.first, last->second.second);
+
+            if(previousSkipped || predicted > 1000.0 * options.budget) {
+                std::cout << name << ", " << count << " bodies: skipped, over the " << options.budget << " s budget" << '\n';
+                forces.push_back(jsonRecord().add("solver", name).add("bodies", count).add("skipped", true).str());
+                lastForce[solver] = {count, -1.0};
+                continue;
+            }
+
+            double milliseconds;
+            forces.push_back(runForces(initial, solver, options, milliseconds));
+            lastForce[solver] = {count, milliseconds};
+
+            // an integrator step costs at least one evaluation, a frame two at the default 120 Hz step
+            bool affordable = milliseconds * 4.0 < 1000.0 * options.budget;
+
+            for(integratorType type : options.integrators) {
+                if(affordable) integrators.push_back(runIntegrator(initial, solver, type, options));
+                else integrators.push_back(jsonRecord().add("solver", name).add("integrator", integrator::name(type)).add("bodies", count).add("skipped", true).str());
+            }
+
+            if(options.frames > 0) {
+                physicsEngine::integration = frameIntegrator;
+                for(bool scattered : {false, true}) {
+                    if(affordable) frames.push_back(runFrames(initial, solver, options, scattered));
+                    else frames.push_back(jsonRecord().add("solver", name).add("bodies", count).add("scattered", scattered).add("skipped", true).str());
+                }
+            }
+        }
+    }
+
+    std::ofstream file(options.outputPath);
+    if(!file.is_open()) {
+        std::cout << "Could not write benchmark file: " << options.outputPath << '\n';
+        return 1;
+    }
+
+#if defined(__clang__)
+    std::string compiler = "clang " __clang_version__;
+#elif defined(__GNUC__)
+    std::string compiler = "gcc " __VERSION__;
+#elif defined(_MSC_VER)
+    std::string compiler = "msvc " + std::to_string(_MSC_VER);
+#else
+    std::string compiler = "unknown";
+#endif
+#ifdef NDEBUG
+    const char *build = "release";
+#else
+    const char *build = "debug";
+#endif
+
+    jsonRecord setup;
+    setup.add("label", options.label).add("commit", GRAVITY_COMMIT).add("compiler", compiler).add("build", build)
+         .add("threads", physicsEngine::threads).add("simd", directKernel::name(physicsEngine::simd))
+         .add("force_law", forceLaws::name(physicsEngine::law)).add("precision", forceLaws::name(physicsEngine::precision))
+         .add("deterministic", physicsEngine::deterministic).add("frame_integrator", integrator::name(frameIntegrator)).add("theta", physicsEngine::theta)
+         .add("pm_grid", physicsEngine::meshSize).add("fmm_order", physicsEngine::expansionOrder)
+         .add("dt", physicsEngine::fixedDeltaTime).add("steps", options.steps).add("frames", options.frames)
+         .add("scene", "plummer mass=20000 radius=150 seed=1");
+
+    auto writeArray = [&](const char *name, const std::vector<std::string> &records, bool last) {
+        file << "  \"" << name << "\": [";
+        for(size_t i = 0; i < records.size(); i++) {
+            file << (i ? ",\n    " : "\n    ") << records[i];
+        }
+        file << (records.empty() ? "]" : "\n  ]") << (last ? "\n" : ",\n");
+    };
+
+    file << "{\n  \"setup\": " << setup.str() << ",\n";
+    writeArray("forces", forces, false);
+    writeArray("integrators", integrators, false);
+    writeArray("frames", frames, true);
+    file << "}\n";
+
+    std::cout << "wrote " << options.outputPath << '\n';
+    return file ? 0 : 1;
+}
+
+double secondsSince(clock_type::time_point start) {
+    return std::chrono::duration<double>(clock_type::now() - start).count();
+}
+
+// Current or peak resident set of the whole process, 0 where the platform does not report it.
+size_t residentBytes(bool peak) {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if(!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+    return peak ? counters.PeakWorkingSetSize : counters.WorkingSetSize;
+#elif defined(__linux__)
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    const std::string wanted = peak ? "VmHWM:" : "VmRSS:";
+
+    while(std::getline(status, line)) {
+        if(line.compare(0, wanted.size(), wanted) == 0) return std::stoul(line.substr(wanted.size())) * 1024;
+    }
+    return 0;
+#else
+    if(!peak) return 0;
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (size_t)usage.ru_maxrss;
+#endif
+}
+
+size_t bodyBytes(bodyStore &bodies) {
+    size_t bytes = 0;
+    bodies.forEachArray([&](auto &array) { bytes += array.capacity() * sizeof(array[0]); });
+    return bytes;
+}
+
+bool parseList(const std::string &list, benchmarkOptions &options, bool solvers) {
+    std::istringstream stream(list);
+    std::string name;
+
+    if(solvers) options.solvers.clear();
+    else options.integrators.clear();
+
+    while(std::getline(stream, name, ',')) {
+        if(solvers) {
+            forceSolver solver = physicsEngine::solverFromName(name);
+            if(physicsEngine::solverName(solver) != name) {
+                std::cout << "Unknown solver: " << name << '\n';
+                return false;
+            }
+            options.solvers.push_back(solver);
+        }
+        else {
+            integratorType type = integrator::fromName(name);
+            if(integrator::name(type) != name) {
+                std::cout << "Unknown integrator: " << name << '\n';
+                return false;
+            }
+            options.integrators.push_back(type);
+        }
+    }
+    return true;
+}
+
+// The direct sum grows as N^2, the tree, mesh and multipole solvers roughly as N log N.
+double predictedMilliseconds(forceSolver solver, size_t count, size_t previousCount, double previousMs) {
+    double ratio = (double)count / previousCount;
+    if(solver == forceSolver::direct) return previousMs * ratio * ratio;
+    return previousMs * ratio * 1.3;
+}
+
+void linearMomentum(const bodyStore &bodies, double (&momentum)[3], double &scale) {
+    momentum[0] = momentum[1] = momentum[2] = 0.0;
+    scale = 0.0;
+
+    for(size_t i = 0; i < bodies.size(); i++) {
+        double px = (double)bodies.mass[i] * bodies.vx[i];
+        double py = (double)bodies.mass[i] * bodies.vy[i];
+        double pz = (double)bodies.mass[i] * bodies.vz[i];
+
+        momentum[0] += px; momentum[1] += py; momentum[2] += pz;
+        scale += std::sqrt(px * px + py * py + pz * pz);
+    }
+}
+
+// Times whole force evaluations on the initial state: the first call also builds tables and grows
+// buffers, so it is kept apart from the best and mean of the repeats.
+std::string runForces(const bodyStore &initial, forceSolver solver, const benchmarkOptions &options, double &milliseconds) {
+    physicsEngine::solver = solver;
+    bodyStore &bodies = physicsEngine::getBodies();
+    bodies = initial;
+
+    auto start = clock_type::now();
+    physicsEngine::computeAccelerations(bodies);
+    double firstMs = 1000.0 * secondsSince(start);
+
+    // keep the repeats inside the budget when a single evaluation is already slow
+    int repeats = firstMs * options.repeats > 1000.0 * options.budget ? 1 : options.repeats;
+    double bestMs = firstMs, totalMs = 0.0;
+
+    for(int r = 0; r < repeats; r++) {
+        start = clock_type::now();
+        physicsEngine::computeAccelerations(bodies);
+        double ms = 1000.0 * secondsSince(start);
+
+        bestMs = r == 0 ? ms : std::min(bestMs, ms);
+        totalMs += ms;
+    }
+    milliseconds = bestMs;
+
+    size_t count = bodies.size();
+    double pairs = (double)count * (count - 1);
+
+    std::cout << physicsEngine::solverName(solver) << ", " << count << " bodies: " << bestMs << " ms per evaluation, "
+              << 1e6 * bestMs / pairs << " ns per interaction" << '\n';
+
+    return jsonRecord().add("solver", physicsEngine::solverName(solver)).add("bodies", count)
+        .add("first_ms", firstMs).add("best_ms", bestMs).add("mean_ms", totalMs / repeats).add("repeats", repeats)
+        .add("ns_per_interaction", 1e6 * bestMs / pairs).add("ns_per_body", 1e6 * bestMs / count)
+        .add("body_bytes", bodyBytes(bodies)).add("resident_bytes", residentBytes(false)).add("peak_resident_bytes", residentBytes(true)).str();
+}
+
+// Runs fixed steps and reports throughput, force evaluations per body-step and conservation drift.
+// Energy is an O(N^2) sum, so it is left out above ENERGY_LIMIT bodies.
+std::string runIntegrator(const bodyStore &initial, forceSolver solver, integratorType type, const benchmarkOptions &options) {
+    const size_t ENERGY_LIMIT = 20000;
+
+    physicsEngine::solver = solver;
+    physicsEngine::integration = type;
+    physicsEngine::forceEvaluations = 0;
+    physicsEngine::stepCount = 0;
+    physicsEngine::simulationTime = 0.0;
+
+    bodyStore &bodies = physicsEngine::getBodies();
+    bodies = initial;
+    physicsEngine::invalidateAccelerations();
+
+    size_t count = bodies.size();
+    bool trackEnergy = count <= ENERGY_LIMIT;
+    double initialEnergy = trackEnergy ? physicsEngine::totalEnergy(bodies) : 0.0;
+
+    double initialMomentum[3], momentumScale;
+    linearMomentum(bodies, initialMomentum, momentumScale);
+
+    long steps = 0;
+    auto start = clock_type::now();
+    while(steps < options.steps && secondsSince(start) < options.budget) {
+        physicsEngine::updatePhysics(physicsEngine::fixedDeltaTime);
+        steps++;
+    }
+    double seconds = secondsSince(start);
+
+    double finalMomentum[3], finalScale;
+    linearMomentum(bodies, finalMomentum, finalScale);
+    double dp[3] = {finalMomentum[0] - initialMomentum[0], finalMomentum[1] - initialMomentum[1], finalMomentum[2] - initialMomentum[2]};
+    double momentumDrift = std::sqrt(dp[0] * dp[0] + dp[1] * dp[1] + dp[2] * dp[2]) / std::max(momentumScale, 1e-30);
+
+    double energyDrift = NAN;
+    if(trackEnergy) energyDrift = (physicsEngine::totalEnergy(bodies) - initialEnergy) / std::fabs(initialEnergy);
+
+    double stepsPerSecond = steps / std::max(seconds, 1e-9);
+    std::cout << physicsEngine::solverName(solver) << " + " << integrator::name(type) << ", " << count << " bodies: "
+              << stepsPerSecond << " steps/s, energy drift " << energyDrift << ", momentum drift " << momentumDrift << '\n';
+
+    return jsonRecord().add("solver", physicsEngine::solverName(solver)).add("integrator", integrator::name(type)).add("bodies", count)
+        .add("steps", steps).add("seconds", seconds).add("steps_per_second", stepsPerSecond).add("body_steps_per_second", stepsPerSecond * count)
+        .add("evaluations_per_body_step", (double)physicsEngine::forceEvaluations / std::max(1.0, (double)steps * count))
+        .add("energy_drift", energyDrift).add("momentum_drift", momentumDrift)
+        .add("body_bytes", bodyBytes(bodies)).add("peak_resident_bytes", residentBytes(true)).str();
+}
+
+// The CPU work of one rendered frame at 60 Hz without a GL context: advancing the fixed-step
+// accumulator, resampling the grid's potential map and packing the body instance buffer.
+// Grid settings match the simulator's default grid. The scattered run flings a tenth of the bodies
+// past the map, which then has to account for them without a per-texel sum.
+std::string runFrames(const bodyStore &initial, forceSolver solver, const benchmarkOptions &options, bool scattered) {
+    const float FRAME_TIME = 1.0f / 60.0f;
+    const float MAP_EXTENT = 200 * 5.0f;
+    // every SCATTER_EVERY-th body is moved SCATTER_SCALE times further out, past the potential map
+    const size_t SCATTER_EVERY = 10;
+    const float SCATTER_SCALE = 20.0f;
+
+    physicsEngine::solver = solver;
+    bodyStore &bodies = physicsEngine::getBodies();
+    bodies = initial;
+    if(scattered) {
+        for(size_t i = 0; i < bodies.size(); i += SCATTER_EVERY) {
+            bodies.x[i] = bodies.prevX[i] = bodies.x[i] * SCATTER_SCALE;
+            bodies.y[i] = bodies.prevY[i] = bodies.y[i] * SCATTER_SCALE;
+            bodies.z[i] = bodies.prevZ[i] = bodies.z[i] * SCATTER_SCALE;
+            bodies.lowX[i] *= SCATTER_SCALE;
+            bodies.lowY[i] *= SCATTER_SCALE;
+            bodies.lowZ[i] *= SCATTER_SCALE;
+        }
+    }
+    physicsEngine::invalidateAccelerations();
+
+    size_t outside = 0;
+    for(size_t i = 0; i < bodies.size(); i++) {
+        if(std::fabs(bodies.x[i]) > MAP_EXTENT || std::fabs(bodies.z[i]) > MAP_EXTENT) outside++;
+    }
+
+    potentialMap potential;
+    potential.configure(256, MAP_EXTENT, 20.0f, 0.4f * 10.0f);
+    std::vector<float> instances;
+
+    double physicsSeconds = 0.0, potentialSeconds = 0.0, instanceSeconds = 0.0;
+    long frames = 0;
+    auto start = clock_type::now();
+
+    while(frames < options.frames && secondsSince(start) < options.budget) {
+        auto begin = clock_type::now();
+        float alpha = physicsEngine::advance(FRAME_TIME);
+        const std::vector<uint32_t> &stars = physicsEngine::getStars();
+        auto physicsEnd = clock_type::now();
+
+        potential.compute(bodies, alpha);
+        auto potentialEnd = clock_type::now();
+
+        instances.clear();
+        auto append = [&](size_t i) {
+            instances.push_back(bodies.interpolatedX(i, alpha));
+            instances.push_back(bodies.interpolatedY(i, alpha));
+            instances.push_back(bodies.interpolatedZ(i, alpha));
+            instances.push_back(bodies.radius[i]);
+            instances.push_back(bodies.colorR[i]);
+            instances.push_back(bodies.colorG[i]);
+            instances.push_back(bodies.colorB[i]);
+        };
+        for(size_t i = 0; i < bodies.size(); i++) {
+            if(!bodies.isStar(i)) append(i);
+        }
+        for(uint32_t star : stars) append(star);
+        auto instanceEnd = clock_type::now();
+
+        physicsSeconds += std::chrono::duration<double>(physicsEnd - begin).count();
+        potentialSeconds += std::chrono::duration<double>(potentialEnd - physicsEnd).count();
+        instanceSeconds += std::chrono::duration<double>(instanceEnd - potentialEnd).count();
+        frames++;
+    }
+
+    double perFrame = 1000.0 / std::max(frames, 1l);
+    double frameMs = (physicsSeconds + potentialSeconds + instanceSeconds) * perFrame;
+
+    std::cout << physicsEngine::solverName(solver) << ", " << bodies.size() << " bodies" << (scattered ? " (scattered)" : "") << ": "
+              << frameMs << " ms per frame, potential map " << potentialSeconds * perFrame << " ms" << '\n';
+
+    return jsonRecord().add("solver", physicsEngine::solverName(solver)).add("bodies", bodies.size()).add("scattered", scattered)
+        .add("outside_map", outside).add("frames", frames)
+        .add("physics_ms", physicsSeconds * perFrame).add("potential_ms", potentialSeconds * perFrame)
+        .add("instances_ms", instanceSeconds * perFrame).add("frame_ms", frameMs)
+        .add("cpu_fps", 1000.0 / std::max(frameMs, 1e-9)).str();
+}
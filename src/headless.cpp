@@ -0,0 +1,693 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <cctype>
+#include <functional>
+#include "utilities/physics.h"
+#include "utilities/scene.h"
+#include "utilities/snapshot.h"
+#include "utilities/trajectory.h"
+#include "utilities/profiler.h"
+#ifndef _WIN32
+#include "utilities/distributed.h"
+#endif
+
+// Batch runner for machines without a GPU or display: loads a scene, advances it for a fixed number
+// of steps and writes the final state, without creating a window or touching GL.
+
+void generateCluster(size_t count, std::vector<float> &x, std::vector<float> &y, std::vector<float> &z, std::vector<float> &m);
+double relativeError(const std::vector<float> (&reference)[3], const std::vector<float> (&result)[3], double &maxError);
+size_t optionalCount(int argc, char **argv, int &i, size_t fallback);
+int checkSolverError(float theta, size_t count, double tolerance);
+int checkKernels(size_t count, double tolerance);
+int checkParticleMesh(size_t count, double tolerance);
+int runScaling(size_t maxCount);
+int checkFastMultipole(size_t count, double tolerance);
+int checkForceLaws(size_t count, double tolerance);
+int runDistributed(const std::string &scenePath, const std::string &restartPath, const std::string &outputPath, long steps,
+                   int ranks, int rank, std::string rendezvous, long rebalanceEvery);
+int main(int argc, char **argv) {
+    std::string scenePath;
+    std::string outputPath;
+    std::string restartPath;
+    std::string checkpointPath;
+    std::string trajectoryPath;
+    std::string tracePath;
+    long steps = 1000;
+    long checkpointEvery = 0;
+    long trajectoryEvery = 1;
+    int ranks = 1;
+    int rank = -1;
+    std::string rendezvous;
+    long rebalanceEvery = 20;
+    // rms relative error the check modes fail past, each has its own default when negative
+    double checkTolerance = -1.0;
+    // a check mode runs instead of a scene, once every option has been read
+    std::function<int()> check;
+
+    for(int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if(physicsEngine::parseArgument(argc, argv, i)) continue;
+
+        if(arg == "--scene" && i + 1 < argc) {
+            scenePath = argv[++i];
+        }
+        else if(arg == "--output" && i + 1 < argc) {
+            outputPath = argv[++i];
+        }
+        else if(arg == "--steps" && i + 1 < argc) {
+            steps = std::stol(argv[++i]);
+        }
+        else if(arg == "--restart" && i + 1 < argc) {
+            restartPath = argv[++i];
+        }
+        else if(arg == "--checkpoint" && i + 1 < argc) {
+            checkpointPath = argv[++i];
+        }
+        else if(arg == "--checkpoint-every" && i + 1 < argc) {
+            checkpointEvery = std::stol(argv[++i]);
+        }
+        else if(arg == "--trajectory" && i + 1 < argc) {
+            trajectoryPath = argv[++i];
+        }
+        else if(arg == "--trajectory-every" && i + 1 < argc) {
+            trajectoryEvery = std::stol(argv[++i]);
+        }
+        else if(arg == "--profile" && i + 1 < argc) {
+            tracePath = argv[++i];
+        }
+        else if(arg == "--ranks" && i + 1 < argc) {
+            ranks = std::max(1, std::stoi(argv[++i]));
+        }
+        else if(arg == "--rank" && i + 1 < argc) {
+            rank = std::stoi(argv[++i]);
+        }
+        else if(arg == "--rendezvous" && i + 1 < argc) {
+            rendezvous = argv[++i];
+        }
+        else if(arg == "--rebalance-every" && i + 1 < argc) {
+            rebalanceEvery = std::stol(argv[++i]);
+        }
+        else if(arg == "--check-tolerance" && i + 1 < argc) {
+            checkTolerance = std::stod(argv[++i]);
+        }
+        else if(arg == "--check-theta" && i + 1 < argc) {
+            float theta = std::stof(argv[++i]);
+            size_t count = optionalCount(argc, argv, i, 2000);
+            check = [=, &checkTolerance] { return checkSolverError(theta, count, checkTolerance); };
+        }
+        else if(arg == "--check-kernel") {
+            size_t count = optionalCount(argc, argv, i, 4000);
+            check = [=, &checkTolerance] { return checkKernels(count, checkTolerance); };
+        }
+        else if(arg == "--check-pm") {
+            size_t count = optionalCount(argc, argv, i, 20000);
+            check = [=, &checkTolerance] { return checkParticleMesh(count, checkTolerance); };
+        }
+        else if(arg == "--check-fmm") {
+            size_t count = optionalCount(argc, argv, i, 20000);
+            check = [=, &checkTolerance] { return checkFastMultipole(count, checkTolerance); };
+        }
+        else if(arg == "--check-laws") {
+            size_t count = optionalCount(argc, argv, i, 4000);
+            check = [=, &checkTolerance] { return checkForceLaws(count, checkTolerance); };
+        }
+        else if(arg == "--scaling") {
+            size_t maxCount = optionalCount(argc, argv, i, 1048576);
+            check = [=] { return runScaling(maxCount); };
+        }
+        else {
+            std::cout << "Unknown argument: " << arg << '\n';
+            return 1;
+        }
+    }
+    if(check) return check();
+
+    if(scenePath.empty() == restartPath.empty()) {
+        std::cout << "Usage: headless (--scene <file> | --restart <snapshot>) [--steps N] [--dt seconds] [--integrator euler|leapfrog|verlet|yoshida4|block] [--output <file>]" << '\n'
+                  << "                [--checkpoint <snapshot> [--checkpoint-every N]] [--trajectory <file> [--trajectory-every K]] [--profile <trace.json>] [solver options]" << '\n'
+                  << "                [--ranks N [--rank R --rendezvous <socket prefix>] [--rebalance-every K]]" << '\n';
+        return 1;
+    }
+    if(const char *reason = physicsEngine::unsupportedCombination(physicsEngine::solver)) {
+        std::cout << reason << '\n';
+        return 1;
+    }
+    PROFILE_THREAD("main");
+    if(!tracePath.empty() && !profiler::enabled) {
+        std::cout << "Profiling is compiled out, rebuild with GRAVITY_PROFILE defined to record " << tracePath << '\n';
+    }
+
+    if(ranks > 1) {
+        if(!checkpointPath.empty() || !trajectoryPath.empty()) {
+            std::cout << "Checkpoints and trajectories are not supported with --ranks" << '\n';
+            return 1;
+        }
+        return runDistributed(scenePath, restartPath, outputPath, steps, ranks, rank, rendezvous, rebalanceEvery);
+    }
+
+    if(!scenePath.empty()) {
+        auto loadStart = std::chrono::steady_clock::now();
+        if(!scene::load(scenePath)) return 1;
+
+        std::cout << "loaded " << physicsEngine::getBodies().size() << " bodies in "
+                  << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart).count() << " ms" << '\n';
+    }
+
+    if(!restartPath.empty()) {
+        auto loadStart = std::chrono::steady_clock::now();
+        if(!snapshot::load(restartPath)) return 1;
+
+        std::cout << "restarted at step " << physicsEngine::stepCount << ", time " << physicsEngine::simulationTime << " in "
+                  << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart).count() << " ms" << '\n';
+    }
+
+    trajectoryWriter trajectory;
+    // a fresh run records its first step, a restart continues with the step after the checkpoint
+    uint64_t firstRecorded = physicsEngine::stepCount + (restartPath.empty() ? 0 : 1);
+    if(!trajectoryPath.empty() && !trajectory.open(trajectoryPath, trajectoryEvery, firstRecorded)) return 1;
+
+    bodyStore &bodies = physicsEngine::getBodies();
+    float deltaTime = physicsEngine::fixedDeltaTime;
+    std::cout << "bodies: " << bodies.size() << ", steps: " << steps << ", dt: " << deltaTime
+              << ", integrator: " << integrator::name(physicsEngine::integration)
+              << ", force law: " << forceLaws::name(physicsEngine::law) << " (" << forceLaws::name(physicsEngine::precision) << ")" << '\n';
+
+    // the energy sum is O(N^2) in double precision, too slow to be a side diagnostic on big scenes
+    const size_t ENERGY_LIMIT = 50000;
+    bool trackEnergy = bodies.size() <= ENERGY_LIMIT;
+    double initialEnergy = trackEnergy ? physicsEngine::totalEnergy(bodies) : 0.0;
+
+    auto start = std::chrono::steady_clock::now();
+    if(restartPath.empty()) trajectory.record(physicsEngine::stepCount, physicsEngine::simulationTime, bodies);
+
+    for(long step = 0; step < steps; step++) {
+        physicsEngine::updatePhysics(deltaTime);
+        trajectory.record(physicsEngine::stepCount, physicsEngine::simulationTime, bodies);
+
+        if(!checkpointPath.empty() && checkpointEvery > 0 && physicsEngine::stepCount % checkpointEvery == 0) {
+            PROFILE_SCOPE("checkpoint");
+            if(!snapshot::save(checkpointPath, bodies, physicsEngine::stepCount, physicsEngine::simulationTime)) return 1;
+        }
+    }
+    if(!trajectory.close()) return 1;
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    double stepsPerSecond = steps / std::max(seconds, 1e-9);
+    std::cout << "elapsed: " << seconds << " s" << '\n';
+    std::cout << "steps/s: " << stepsPerSecond << '\n';
+    std::cout << "body-steps/s: " << stepsPerSecond * bodies.size() << '\n';
+
+    if(physicsEngine::collisions != collisionMode::none) {
+        std::cout << "collisions: " << collisionSystem::name(physicsEngine::collisions) << ", merges: " << physicsEngine::mergeCount
+                  << ", bodies left: " << bodies.size() << '\n';
+    }
+    std::cout << "force evaluations per body-step: " << (double)physicsEngine::forceEvaluations / std::max(1.0, (double)steps * bodies.size()) << '\n';
+
+    if(trackEnergy) {
+        double finalEnergy = physicsEngine::totalEnergy(bodies);
+        std::cout << "relative energy drift: " << (finalEnergy - initialEnergy) / std::fabs(initialEnergy) << '\n';
+    }
+
+    if(!outputPath.empty() && !scene::save(outputPath, bodies)) return 1;
+    if(!checkpointPath.empty() && !snapshot::save(checkpointPath, bodies, physicsEngine::stepCount, physicsEngine::simulationTime)) return 1;
+
+    if(!tracePath.empty() && profiler::enabled) {
+        profiler::summary(std::cout);
+        if(!profiler::writeTrace(tracePath)) return 1;
+    }
+    return 0;
+}
+
+void generateCluster(size_t count, std::vector<float> &x, std::vector<float> &y, std::vector<float> &z, std::vector<float> &m) {
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::uniform_real_distribution<float> massDist(0.5f, 10.0f);
+
+    while(x.size() < count) {
+        float px = unit(rng), py = unit(rng), pz = unit(rng);
+        if(px * px + py * py + pz * pz > 1.0f) continue;
+
+        x.push_back(px * 500.0f);
+        y.push_back(py * 500.0f);
+        z.push_back(pz * 500.0f);
+        m.push_back(massDist(rng));
+    }
+}
+
+double relativeError(const std::vector<float> (&reference)[3], const std::vector<float> (&result)[3], double &maxError) {
+    size_t count = reference[0].size();
+    double sumSquared = 0.0;
+    maxError = 0.0;
+
+    for(size_t i = 0; i < count; i++) {
+        double dx = result[0][i] - reference[0][i];
+        double dy = result[1][i] - reference[1][i];
+        double dz = result[2][i] - reference[2][i];
+        double expected = std::sqrt((double)reference[0][i] * reference[0][i] + (double)reference[1][i] * reference[1][i] + (double)reference[2][i] * reference[2][i]);
+
+        double error = std::sqrt(dx * dx + dy * dy + dz * dz) / std::max(expected, 1e-20);
+        sumSquared += error * error;
+        maxError = std::max(maxError, error);
+    }
+    return std::sqrt(sumSquared / std::max<size_t>(count, 1));
+}
+
+// The count after a check flag, when the next argument is one, so another option can follow the flag.
+size_t optionalCount(int argc, char **argv, int &i, size_t fallback) {
+    if(i + 1 < argc && std::isdigit((unsigned char)argv[i + 1][0])) return std::stoul(argv[++i]);
+    return fallback;
+}
+
+// Compares Barnes-Hut accelerations against the direct sum on a random cluster and reports the relative
+// error. Fails past the tolerance, by default 0.05 * theta^2 since the monopole error grows about as theta^2.
+int checkSolverError(float theta, size_t count, double tolerance) {
+    if(tolerance < 0.0) tolerance = 0.05 * theta * theta;
+
+    std::vector<float> x, y, z, m;
+    generateCluster(count, x, y, z, m);
+
+    std::vector<float> direct[3] = {std::vector<float>(count), std::vector<float>(count), std::vector<float>(count)};
+    std::vector<float> tree[3] = {std::vector<float>(count), std::vector<float>(count), std::vector<float>(count)};
+
+    auto start = std::chrono::steady_clock::now();
+    physicsEngine::computePairwise(x.data(), y.data(), z.data(), m.data(), count, direct[0].data(), direct[1].data(), direct[2].data());
+    auto directEnd = std::chrono::steady_clock::now();
+
+    physicsEngine::theta = theta;
+    physicsEngine::computeBarnesHut(x.data(), y.data(), z.data(), m.data(), count, tree[0].data(), tree[1].data(), tree[2].data());
+    auto treeEnd = std::chrono::steady_clock::now();
+
+    double maxError;
+    double rmsError = relativeError(direct, tree, maxError);
+
+    std::cout << "bodies: " << count << ", theta: " << theta << '\n';
+    std::cout << "rms relative error: " << rmsError << ", max relative error: " << maxError << '\n';
+    std::cout << "direct: " << std::chrono::duration<double, std::milli>(directEnd - start).count() << " ms, "
+              << "barnes-hut: " << std::chrono::duration<double, std::milli>(treeEnd - directEnd).count() << " ms" << '\n';
+
+    if(rmsError > tolerance) {
+        std::cout << "rms relative error exceeds the tolerance of " << tolerance << '\n';
+        return 1;
+    }
+    return 0;
+}
+
+// Runs every direct-summation kernel this CPU supports against the pair loop and reports error and speedup.
+// Fails when any kernel lands further than the tolerance, by default 1e-5, from the pair loop: they only
+// differ in summation order and the SIMD reciprocal square root refinement.
+int checkKernels(size_t count, double tolerance) {
+    if(tolerance < 0.0) tolerance = 1e-5;
+    bool passed = true;
+    std::vector<float> x, y, z, m;
+    generateCluster(count, x, y, z, m);
+
+    std::vector<float> reference[3] = {std::vector<float>(count), std::vector<float>(count), std::vector<float>(count)};
+
+    auto start = std::chrono::steady_clock::now();
+    physicsEngine::computePairwise(x.data(), y.data(), z.data(), m.data(), count, reference[0].data(), reference[1].data(), reference[2].data());
+    double referenceTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "bodies: " << count << ", pair loop: " << referenceTime << " ms" << '\n';
+
+    for(simdLevel level : {simdLevel::scalar, simdLevel::avx2, simdLevel::avx512}) {
+        if(!directKernel::supported(level)) continue;
+
+        std::vector<float> result[3] = {std::vector<float>(count), std::vector<float>(count), std::vector<float>(count)};
+        physicsEngine::simd = level;
+
+        start = std::chrono::steady_clock::now();
+        physicsEngine::computeDirect(x.data(), y.data(), z.data(), m.data(), count, result[0].data(), result[1].data(), result[2].data());
+        double time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        double maxError;
+        double rmsError = relativeError(reference, result, maxError);
+
+        std::cout << directKernel::name(level) << ": " << time << " ms (" << referenceTime / time << "x), "
+                  << "rms relative error: " << rmsError << ", max relative error: " << maxError << '\n';
+
+        if(rmsError > tolerance) {
+            std::cout << directKernel::name(level) << " rms relative error exceeds the tolerance of " << tolerance << '\n';
+            passed = false;
+        }
+    }
+
+    physicsEngine::simd = directKernel::detect();
+    return passed ? 0 : 1;
+}
+
+// Compares particle-mesh accelerations against the pair loop, overall and for bodies far from the
+// densest cells, where the mesh should reproduce the Newtonian force. The overall error of the bare
+// mesh is dominated by pairs closer than a few cells, which it smooths by design, so the gate is on
+// pairs further apart: the short-range correction swaps the mesh's own force for the exact law below
+// that distance and leaves only those to the mesh. Fails when that error passes the tolerance, by
+// default 0.05, when an escaper makes the bare mesh more than ESCAPER_GROWTH times worse, or when the
+// far field is off by more than FAR_TOLERANCE.
+int checkParticleMesh(size_t count, double tolerance) {
+    const double FAR_TOLERANCE = 1e-3;
+    const double ESCAPER_GROWTH = 1.1;
+    if(tolerance < 0.0) tolerance = 0.05;
+
+    std::vector<float> x, y, z, m;
+    generateCluster(count, x, y, z, m);
+
+    // direct and mesh accelerations of the current bodies, the mesh with or without the correction
+    auto solve = [&](bool correction, std::vector<float> (&direct)[3], std::vector<float> (&mesh)[3]) {
+        for(int axis = 0; axis < 3; axis++) {
+            direct[axis].resize(x.size());
+            mesh[axis].resize(x.size());
+        }
+        physicsEngine::computeDirect(x.data(), y.data(), z.data(), m.data(), x.size(), direct[0].data(), direct[1].data(), direct[2].data());
+
+        bool shortRange = physicsEngine::meshShortRange;
+        physicsEngine::meshShortRange = correction;
+        physicsEngine::computeParticleMesh(x.data(), y.data(), z.data(), m.data(), x.size(), mesh[0].data(), mesh[1].data(), mesh[2].data());
+        physicsEngine::meshShortRange = shortRange;
+    };
+
+    std::vector<float> direct[3], mesh[3];
+
+    auto start = std::chrono::steady_clock::now();
+    solve(physicsEngine::meshShortRange, direct, mesh);
+    double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    double maxError;
+    double rmsError = relativeError(direct, mesh, maxError);
+
+    std::cout << "bodies: " << count << ", grid: " << physicsEngine::meshSize << "^3, assignment: " << particleMesh::name(physicsEngine::assignment)
+              << ", short-range correction: " << (physicsEngine::meshShortRange ? "on" : "off") << '\n';
+    std::cout << "rms relative error: " << rmsError << ", max relative error: " << maxError << '\n';
+    std::cout << "direct + pm: " << milliseconds << " ms" << '\n';
+
+    double pairMax;
+    solve(true, direct, mesh);
+    double pairError = relativeError(direct, mesh, pairMax);
+    std::cout << "pairs over " << particleMesh::getShortRangeCells() << " cells apart, rms relative error: " << pairError
+              << ", max relative error: " << pairMax << '\n';
+
+    // one body flung far out must not coarsen the grid for everyone else
+    double bareError, escaperError;
+    {
+        double bareMax, escaperMax;
+        solve(false, direct, mesh);
+        bareError = relativeError(direct, mesh, bareMax);
+
+        x.push_back(20000.0f); y.push_back(0.0f); z.push_back(0.0f);
+        m.push_back(1.0f);
+
+        solve(false, direct, mesh);
+        escaperError = relativeError(direct, mesh, escaperMax);
+        std::cout << "bare mesh rms relative error: " << bareError << ", with an escaper: " << escaperError << '\n';
+
+        x.pop_back(); y.pop_back(); z.pop_back();
+        m.pop_back();
+    }
+
+    // test bodies beyond the cluster: the nearest still sits in the mesh's box and feels its far field,
+    // the others fall outside it and are summed directly
+    std::vector<float> probe[3] = {std::vector<float>(1), std::vector<float>(1), std::vector<float>(1)};
+    std::vector<float> probeMesh[3] = {std::vector<float>(1), std::vector<float>(1), std::vector<float>(1)};
+    std::vector<float> probeMass = m;
+    double sumSquared = 0.0;
+    int probes = 0;
+
+    for(float distance : {600.0f, 800.0f, 1200.0f}) {
+        x.push_back(distance); y.push_back(0.3f * distance); z.push_back(-0.2f * distance);
+        probeMass.push_back(0.0f);
+
+        std::vector<float> all[3] = {std::vector<float>(x.size()), std::vector<float>(x.size()), std::vector<float>(x.size())};
+        std::vector<float> allMesh[3] = {std::vector<float>(x.size()), std::vector<float>(x.size()), std::vector<float>(x.size())};
+
+        physicsEngine::computeDirect(x.data(), y.data(), z.data(), probeMass.data(), x.size(), all[0].data(), all[1].data(), all[2].data());
+        physicsEngine::computeParticleMesh(x.data(), y.data(), z.data(), probeMass.data(), x.size(), allMesh[0].data(), allMesh[1].data(), allMesh[2].data());
+
+        for(int axis = 0; axis < 3; axis++) {
+            probe[axis][0] = all[axis].back();
+            probeMesh[axis][0] = allMesh[axis].back();
+        }
+
+        double error;
+        relativeError(probe, probeMesh, error);
+        sumSquared += error * error;
+        probes++;
+
+        x.pop_back(); y.pop_back(); z.pop_back();
+        probeMass.pop_back();
+    }
+    double farError = std::sqrt(sumSquared / probes);
+    std::cout << "far-field rms relative error: " << farError << '\n';
+
+    if(pairError > tolerance) {
+        std::cout << "rms relative error over " << particleMesh::getShortRangeCells() << " cells exceeds the tolerance of " << tolerance << '\n';
+        return 1;
+    }
+    if(escaperError > ESCAPER_GROWTH * bareError) {
+        std::cout << "an escaper makes the rms relative error more than " << ESCAPER_GROWTH << " times worse" << '\n';
+        return 1;
+    }
+    if(farError > FAR_TOLERANCE) {
+        std::cout << "far-field rms relative error exceeds the tolerance of " << FAR_TOLERANCE << '\n';
+        return 1;
+    }
+    return 0;
+}
+
+// Times one force evaluation for growing body counts: the pair loop and direct kernel grow as N^2,
+// the particle mesh as N + M log M for a fixed grid.
+int runScaling(size_t maxCount) {
+    const size_t PAIR_LIMIT = 32768;
+
+    std::cout << "grid: " << physicsEngine::meshSize << "^3, threads: " << physicsEngine::threads << ", simd: " << directKernel::name(physicsEngine::simd) << '\n';
+    std::cout << "bodies\tpair loop ms\tdirect ms\tpm ms" << '\n';
+
+    for(size_t count = 1024; count <= maxCount; count *= 4) {
+        std::vector<float> x, y, z, m;
+        generateCluster(count, x, y, z, m);
+        std::vector<float> ax(count), ay(count), az(count);
+
+        auto time = [&](auto solve) {
+            auto start = std::chrono::steady_clock::now();
+            solve(x.data(), y.data(), z.data(), m.data(), count, ax.data(), ay.data(), az.data());
+            return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        };
+
+        std::cout << count << '\t';
+        if(count <= PAIR_LIMIT) std::cout << time(physicsEngine::computePairwise) << '\t';
+        else std::cout << "-" << '\t';
+
+        if(count <= 4 * PAIR_LIMIT) std::cout << time(physicsEngine::computeDirect) << '\t';
+        else std::cout << "-" << '\t';
+
+        // the first call also builds the Green's function spectrum
+        if(count == 1024) time(physicsEngine::computeParticleMesh);
+        std::cout << time(physicsEngine::computeParticleMesh) << '\n';
+    }
+    return 0;
+}
+
+// Sweeps the FMM expansion order against the direct sum and puts Barnes-Hut at the same theta next to
+// it, so error per millisecond can be compared. Fails when a higher order does worse than the one before
+// it or the highest order is further than the tolerance, by default 1e-4, from the direct sum.
+int checkFastMultipole(size_t count, double tolerance) {
+    const int MAX_ORDER = 8;
+    if(tolerance < 0.0) tolerance = 1e-4;
+
+    std::vector<float> x, y, z, m;
+    generateCluster(count, x, y, z, m);
+
+    std::vector<float> direct[3] = {std::vector<float>(count), std::vector<float>(count), std::vector<float>(count)};
+    std::vector<float> result[3] = {std::vector<float>(count), std::vector<float>(count), std::vector<float>(count)};
+
+    auto start = std::chrono::steady_clock::now();
+    physicsEngine::computeDirect(x.data(), y.data(), z.data(), m.data(), count, direct[0].data(), direct[1].data(), direct[2].data());
+    double directTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "bodies: " << count << ", theta: " << physicsEngine::theta << ", direct: " << directTime << " ms" << '\n';
+
+    auto report = [&](const std::string &label, auto solve) {
+        // the first run builds the translation tables, time the second
+        solve(x.data(), y.data(), z.data(), m.data(), count, result[0].data(), result[1].data(), result[2].data());
+
+        auto begin = std::chrono::steady_clock::now();
+        solve(x.data(), y.data(), z.data(), m.data(), count, result[0].data(), result[1].data(), result[2].data());
+        double time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+
+        double maxError;
+        double rmsError = relativeError(direct, result, maxError);
+        std::cout << label << ": " << time << " ms, rms relative error: " << rmsError << ", max relative error: " << maxError << '\n';
+        return rmsError;
+    };
+
+    report("barnes-hut", physicsEngine::computeBarnesHut);
+
+    float orderTolerance = physicsEngine::tolerance;
+    int order = physicsEngine::expansionOrder;
+    physicsEngine::tolerance = 0.0f;
+
+    bool converging = true;
+    double previous = 0.0, rmsError = 0.0;
+    for(int p = 1; p <= MAX_ORDER; p++) {
+        physicsEngine::expansionOrder = p;
+        rmsError = report("fmm p=" + std::to_string(p), physicsEngine::computeFastMultipole);
+
+        if(p > 1 && rmsError > previous) converging = false;
+        previous = rmsError;
+    }
+    physicsEngine::tolerance = orderTolerance;
+    physicsEngine::expansionOrder = order;
+
+    if(!converging) {
+        std::cout << "rms relative error does not fall with the expansion order" << '\n';
+        return 1;
+    }
+    if(rmsError > tolerance) {
+        std::cout << "rms relative error at p=" << MAX_ORDER << " exceeds the tolerance of " << tolerance << '\n';
+        return 1;
+    }
+    return 0;
+}
+
+// Runs the direct sum with every force law in float and in double, reporting how far each kernel lands
+// from the double pair loop of the same law and what each specialization costs. Fails when either is
+// further than the tolerance, by default 1e-5, the same float rounding bound as --check-kernel.
+int checkForceLaws(size_t count, double tolerance) {
+    if(tolerance < 0.0) tolerance = 1e-5;
+    bool passed = true;
+
+    std::vector<float> x, y, z, m;
+    generateCluster(count, x, y, z, m);
+
+    std::cout << "bodies: " << count << ", threads: " << physicsEngine::threads << ", simd: " << directKernel::name(physicsEngine::simd)
+              << ", cutoff: " << physicsEngine::cutoff << '\n';
+
+    for(forceLaw law : {forceLaw::softened, forceLaw::plummer, forceLaw::spline, forceLaw::cutoff}) {
+        std::vector<float> reference[3] = {std::vector<float>(count), std::vector<float>(count), std::vector<float>(count)};
+        std::vector<float> single[3] = {std::vector<float>(count), std::vector<float>(count), std::vector<float>(count)};
+        std::vector<float> twice[3] = {std::vector<float>(count), std::vector<float>(count), std::vector<float>(count)};
+        physicsEngine::law = law;
+
+        physicsEngine::precision = precisionMode::doublePrecision;
+        physicsEngine::computePairwise(x.data(), y.data(), z.data(), m.data(), count, reference[0].data(), reference[1].data(), reference[2].data());
+
+        auto time = [&](precisionMode precision, std::vector<float> (&result)[3]) {
+            physicsEngine::precision = precision;
+
+            auto start = std::chrono::steady_clock::now();
+            physicsEngine::computeDirect(x.data(), y.data(), z.data(), m.data(), count, result[0].data(), result[1].data(), result[2].data());
+            return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        };
+
+        double singleTime = time(precisionMode::singlePrecision, single);
+        double doubleTime = time(precisionMode::doublePrecision, twice);
+
+        double singleMax, doubleMax;
+        double singleError = relativeError(reference, single, singleMax);
+        double doubleError = relativeError(reference, twice, doubleMax);
+
+        std::cout << forceLaws::name(law) << ": float " << singleTime << " ms, double " << doubleTime << " ms, "
+                  << "rms relative error float: " << singleError << ", double: " << doubleError
+                  << ", max relative error float: " << singleMax << ", double: " << doubleMax << '\n';
+
+        if(std::max(singleError, doubleError) > tolerance) {
+            std::cout << forceLaws::name(law) << " rms relative error exceeds the tolerance of " << tolerance << '\n';
+            passed = false;
+        }
+    }
+
+    physicsEngine::law = forceLaw::softened;
+    physicsEngine::precision = precisionMode::singlePrecision;
+    return passed ? 0 : 1;
+}
+
+// Splits the run over several processes talking over Unix sockets. Without --rank the ranks are forked
+// from this process; with it, every rank is started by hand with the same arguments and rendezvous.
+// Only rank 0 loads the scene and writes the output, and --threads is shared out among forked ranks.
+#ifdef _WIN32
+int runDistributed(const std::string&, const std::string&, const std::string&, long, int, int, std::string, long) {
+    std::cout << "Distributed runs (--ranks) are not supported on this platform" << '\n';
+    return 1;
+}
+#else
+int runDistributed(const std::string &scenePath, const std::string &restartPath, const std::string &outputPath, long steps,
+                   int ranks, int rank, std::string rendezvous, long rebalanceEvery) {
+    if(physicsEngine::integration == integratorType::block || physicsEngine::collisions != collisionMode::none) {
+        std::cout << "Distributed runs support neither the block integrator nor collisions" << '\n';
+        return 1;
+    }
+
+    std::vector<pid_t> children;
+    if(rank < 0) {
+        if(rendezvous.empty()) rendezvous = "/tmp/gravity-" + std::to_string(::getpid());
+        physicsEngine::threads = std::max(1u, physicsEngine::threads / ranks);
+
+        std::cout.flush();
+        rank = distributedEngine::launch(ranks, children);
+        if(rank < 0) return 1;
+    }
+    else if(rendezvous.empty() || rank >= ranks) {
+        std::cout << "Ranks started by hand need --rank below --ranks and a shared --rendezvous prefix" << '\n';
+        return 1;
+    }
+
+    // forked ranks report failure through their exit code, rank 0 collects them
+    auto finish = [&](int code) {
+        if(!children.empty() && !distributedEngine::wait(children)) code = 1;
+        return code;
+    };
+
+    distributedEngine engine;
+    engine.rebalanceEvery = rebalanceEvery;
+    if(!engine.connect(rendezvous, rank, ranks)) return finish(1);
+
+    if(rank == 0) {
+        auto loadStart = std::chrono::steady_clock::now();
+        if(!(scenePath.empty() ? snapshot::load(restartPath) : scene::load(scenePath))) return finish(1);
+
+        std::cout << "loaded " << physicsEngine::getBodies().size() << " bodies in "
+                  << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart).count() << " ms" << '\n';
+    }
+
+    size_t totalBodies = physicsEngine::getBodies().size();
+    if(!engine.distribute(steps)) return finish(1);
+
+    float deltaTime = physicsEngine::fixedDeltaTime;
+    if(rank == 0) {
+        std::cout << "bodies: " << totalBodies << ", steps: " << steps << ", dt: " << deltaTime
+                  << ", integrator: " << integrator::name(physicsEngine::integration)
+                  << ", force law: " << forceLaws::name(physicsEngine::law) << " (" << forceLaws::name(physicsEngine::precision) << ")"
+                  << ", ranks: " << ranks << '\n';
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for(long step = 0; step < steps; step++) {
+        if(!engine.step(deltaTime)) return finish(1);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    uint64_t imported = engine.importedSources;
+
+    bodyStore all;
+    std::vector<uint64_t> counts;
+    std::vector<double> forceSeconds;
+    if(!engine.gather(all, counts, forceSeconds)) return finish(1);
+    if(rank != 0) return finish(0);
+
+    double stepsPerSecond = steps / std::max(seconds, 1e-9);
+    std::cout << "elapsed: " << seconds << " s" << '\n';
+    std::cout << "steps/s: " << stepsPerSecond << '\n';
+    std::cout << "body-steps/s: " << stepsPerSecond * all.size() << '\n';
+    std::cout << "rebalances: " << engine.rebalances << ", last imbalance: " << engine.imbalance
+              << ", sources imported per body-step on rank 0: " << (double)imported / std::max(1.0, (double)counts[0] * steps) << '\n';
+    for(int r = 0; r < ranks; r++) {
+        std::cout << "rank " << r << ": " << counts[r] << " bodies, " << forceSeconds[r] << " s of CPU in forces" << '\n';
+    }
+
+    if(!outputPath.empty() && !scene::save(outputPath, all)) return finish(1);
+    return finish(0);
+}
+#endif
@@ -1,48 +1,63 @@
 #include <iostream>
 #include <vector>
+#include <string>
 #define _USE_MATH_DEFINES
 #include <cmath>
 #include <memory>
+#include <cstddef>
+#include <algorithm>
+#include <cstdio>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
-#include "utility/window.h"
-#include "utility/shader.h"
-#include "utility/camera.h"
+#include "utilities/window.h"
+#include "utilities/frame_stream.h"
+#include "utilities/shader.h"
+#include "utilities/camera.h"
+#include "utilities/uniform_buffer.h"
+#include "utilities/frustum.h"
+#include "utilities/light_list.h"
+#include "utilities/physics.h"
+#include "utilities/physics_thread.h"
+#include "utilities/scene.h"
+#include "utilities/potential_map.h"
+#include "utilities/profiler.h"
+#include "utilities/gpu_profiler.h"
+
+// Points attributes 2-4 (offset, radius, color) of a vertex array at a per-instance buffer, starting at
+// instance `first`.
+void bindInstanceAttributes(GLuint VAO, GLuint instanceVBO, size_t first) {
+    const GLsizei stride = 7 * sizeof(GLfloat);
+    const size_t base = first * stride;
+
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void*)base);
+    glEnableVertexAttribArray(2);
+    glVertexAttribDivisor(2, 1);
+
+    glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, stride, (void*)(base + 3 * sizeof(GLfloat)));
+    glEnableVertexAttribArray(3);
+    glVertexAttribDivisor(3, 1);
+
+    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, stride, (void*)(base + 4 * sizeof(GLfloat)));
+    glEnableVertexAttribArray(4);
+    glVertexAttribDivisor(4, 1);
+}
 
-class object {
+class sphereMesh {
 private:
     GLuint VAO, VBO, EBO;
-    std::vector<GLfloat> vertices;
-    std::vector<GLuint> indices;
-
-    shader &objectShader;
+    GLsizei indexCount;
 
-    const int stacks = 64;
-    const int sectors = 64;
+    const int stacks;
+    const int sectors;
 public:
-    glm::vec3 position{};
-    glm::vec3 acceleration{};
-    glm::vec3 velocity{};
-
-    const float mass;
-    const float density;
-    const GLfloat radius;
-
-    const bool star;
-    const glm::vec3 color;
-
-    object(glm::vec3 position, glm::vec3 velocity, float mass, float density, glm::vec3 color, bool star, shader &objectShader):
-    mass(mass),
-    density(density),
-    radius(std::cbrt((3.0f * this->mass) / (4.0f * M_PI * this->density))),
-    color(color),
-    star(star),
-    objectShader(objectShader) {
-
-        this->position = position;
-        this->velocity = velocity;
+    sphereMesh(int stacks, int sectors) : stacks(stacks), sectors(sectors) {
+        std::vector<GLfloat> vertices;
+        std::vector<GLuint> indices;
 
         for(int i = 0; i <= stacks; i++) {
             float phi = M_PI * i / stacks;
@@ -50,22 +65,22 @@ public:
             for(int j = 0; j <= sectors; j++) {
                 float theta = 2.0f * M_PI * j / sectors;
 
-                GLfloat x = radius * sin(phi) * cos(theta);
-                GLfloat y = radius * sin(phi) * sin(theta);
-                GLfloat z = radius * cos(phi);
+                GLfloat x = sin(phi) * cos(theta);
+                GLfloat y = sin(phi) * sin(theta);
+                GLfloat z = cos(phi);
 
                 vertices.push_back(x);
                 vertices.push_back(y);
                 vertices.push_back(z);
 
-                vertices.push_back(x / radius);
-                vertices.push_back(y / radius);
-                vertices.push_back(z / radius);
+                vertices.push_back(x);
+                vertices.push_back(y);
+                vertices.push_back(z);
             }
         }
 
         for(int i = 0; i < stacks; i++) {
-            for(int j = 0; j < stacks; j++) {
+            for(int j = 0; j < sectors; j++) {
                 int first = i * (sectors + 1) + j;
                 int second = first + sectors + 1;
 
@@ -78,6 +93,7 @@ public:
                 indices.push_back(first + 1);
             }
         }
+        indexCount = indices.size();
 
         glGenVertexArrays(1, &VAO);
         glGenBuffers(1, &VBO);
@@ -100,186 +116,297 @@ public:
         glBindVertexArray(0);
     }
 
-    void draw(glm::mat4 model, glm::mat4 view, glm::mat4 projection, std::vector<object*> stars) {
-        objectShader.use();
-        glm::mat4 modelMatrix = glm::translate(model, this->position);
-
-        objectShader.setMat4("model", modelMatrix);
-        objectShader.setMat4("view", view);
-        objectShader.setMat4("projection", projection);
-
-        objectShader.setVec3("color", color);
-        for(int i = 0; i < stars.size(); i++) {
-            std::string baseLine = "pointLights[" + std::to_string(i) + ']';
-
-            objectShader.setVec3((baseLine + ".position").c_str(), stars[i]->position);
-            objectShader.setVec3((baseLine + ".ambient").c_str(), stars[i]->color * 0.1f);
-            objectShader.setVec3((baseLine + ".diffuse").c_str(), glm::vec3(0.5f));
-
-            if(i >= 4) break;
-        }
-
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-    }
-
-    void applyForce(const glm::vec3 &force) {
-        this->acceleration += force / this->mass;
+    void bindInstances(GLuint instanceVBO, size_t first) {
+        bindInstanceAttributes(VAO, instanceVBO, first);
     }
 
-    void updatePosition(const float &deltaTime) {
-        this->velocity += this->acceleration * deltaTime;
-        this->position += this->velocity * deltaTime;
-
-        this->acceleration = glm::vec3(0.0f);
+    void drawInstanced(GLsizei instanceCount) {
+        glBindVertexArray(VAO);
+        glDrawElementsInstanced(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0, instanceCount);
     }
 
-    ~object() {
+    ~sphereMesh() {
         glDeleteVertexArrays(1, &VAO);
         glDeleteBuffers(1, &VBO);
         glDeleteBuffers(1, &EBO);
     }
 };
 
-class grid {
+// Two triangles spanning [-1, 1]^2, expanded per instance into a camera-facing billboard by
+// impostor_shader.vert.
+class impostorQuad {
 private:
-    std::vector<GLfloat> vertices;
-    std::vector<GLuint> indices;
-
-    GLuint VAO, VBO, EBO;
-    shader &gridShader;
-
-    const int N_DIVS;
-    const int N_LINES;
-    const float STEP;
-
-    void createVertices(int size) {
-        for(int i = 0; i <= N_DIVS; i++) {
-            float z = (float)i - (float)N_LINES;
-
-            for(int j = 0; j <= N_DIVS; j++) {
-                float x = (float)j - (float)N_LINES;
-
-                vertices.push_back(x * STEP);
-                vertices.push_back(0.0f); 
-                vertices.push_back(z * STEP);
-            }
-        }
-
-        int pointsPerLine = N_DIVS + 1;
-        for(int i = 0; i <= N_DIVS; i++) {
-            for(int j = 0; j < N_DIVS; j++) {
-                indices.push_back(i * pointsPerLine + j);
-                indices.push_back(i * pointsPerLine + j + 1);
-            }
-        }
-
-        for (int j = 0; j <= N_DIVS; j++) {
-            for (int i = 0; i < N_DIVS; i++) {
-                indices.push_back(i * pointsPerLine + j);
-                indices.push_back((i + 1) * pointsPerLine + j);
-            }
-        }
-    }
+    GLuint VAO, VBO;
 public:
-    grid(int size, float step, shader &gridShader) : N_LINES(size), N_DIVS(size * 2), STEP(step), gridShader(gridShader) {
-        createVertices(size);
+    impostorQuad() {
+        const GLfloat corners[] = {-1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f};
 
         glGenVertexArrays(1, &VAO);
         glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
 
         glBindVertexArray(VAO);
 
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat), vertices.data(), GL_DYNAMIC_DRAW);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_DYNAMIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
 
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (void*)0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), (void*)0);
         glEnableVertexAttribArray(0);
 
         glBindVertexArray(0);
     }
 
-    void draw(glm::mat4 model, glm::mat4 view, glm::mat4 projection, std::vector<object*> objects) {
-        gridShader.use();
-
-        gridShader.setMat4("model", model);
-        gridShader.setMat4("view", view);
-        gridShader.setMat4("projection", projection);
-        
-        gridShader.setInt("objectCount", objects.size());
-        for(int i = 0; i < objects.size(); i++) {
-            gridShader.setVec3(("objectPositions[" + std::to_string(i) + ']').c_str(), objects[i]->position);
-            gridShader.setFloat(("objectMasses[" + std::to_string(i) + ']').c_str(), objects[i]->mass);
-        }
+    void bindInstances(GLuint instanceVBO, size_t first) {
+        bindInstanceAttributes(VAO, instanceVBO, first);
+    }
 
+    void drawInstanced(GLsizei instanceCount) {
         glBindVertexArray(VAO);
-        glDrawElements(GL_LINES, indices.size(), GL_UNSIGNED_INT, 0);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, instanceCount);
     }
 
-    ~grid() {
+    ~impostorQuad() {
         glDeleteVertexArrays(1, &VAO);
         glDeleteBuffers(1, &VBO);
     }
 };
 
-class physicsEngine {
+// Draws every body from a few shared unit spheres: per-instance position, radius and color are streamed
+// into a single buffer each frame, grouped by kind (planets, then stars) and level of detail, so each
+// group takes one instanced draw call.
+//
+// Bodies outside the view frustum are skipped. The rest pick a sphere mesh by their projected radius
+// in pixels, and anything smaller than the coarsest mesh threshold is drawn as a ray-traced impostor:
+// a single quad whose fragments intersect the exact sphere, so tiny bodies cost two triangles.
+// Planets are lit by every star through the tiled light list.
+class bodyRenderer {
 private:
-    static inline std::vector<std::unique_ptr<object>> objects;
-    static inline std::vector<object*> objectPointers;
-    static inline std::vector<object*> stars;
-
-    static constexpr float GRAVITY = 100.0f;
-    static constexpr float EPS = 0.01f;
-public:
-    template<typename... Args>
-    static void addObject(Args&&... args) {
-        objects.emplace_back(std::make_unique<object>(std::forward<Args>(args)...));
+    // sphere tessellations and the smallest projected radius, in pixels, each one is used down to
+    static constexpr int LOD_LEVELS = 3;
+    static constexpr int LOD_STACKS[LOD_LEVELS] = {64, 32, 16};
+    static constexpr float LOD_PIXELS[LOD_LEVELS] = {48.0f, 24.0f, 12.0f};
+    static constexpr int IMPOSTOR = LOD_LEVELS;
+    static constexpr int BATCHES = LOD_LEVELS + 1;
+
+    sphereMesh meshes[LOD_LEVELS] = {
+        sphereMesh(LOD_STACKS[0], LOD_STACKS[0]),
+        sphereMesh(LOD_STACKS[1], LOD_STACKS[1]),
+        sphereMesh(LOD_STACKS[2], LOD_STACKS[2])
+    };
+    impostorQuad quad;
+    GLuint instanceVBO;
+    std::vector<GLfloat> instances;
+
+    // per kind (0 planets, 1 stars) and batch (mesh levels, then impostors)
+    std::vector<GLfloat> batches[2][BATCHES];
+
+    lightList lights;
+
+    shader &planetShader;
+    shader &starShader;
+    shader &impostorShader;
+    GLint planetModelLocation;
+    GLint starModelLocation;
+    GLint impostorModelLocation;
+    GLint impostorLitLocation;
+
+    void appendInstance(std::vector<GLfloat> &target, const bodyStore &bodies, size_t i, float x, float y, float z) {
+        target.push_back(x);
+        target.push_back(y);
+        target.push_back(z);
+        target.push_back(bodies.radius[i]);
+        target.push_back(bodies.colorR[i]);
+        target.push_back(bodies.colorG[i]);
+        target.push_back(bodies.colorB[i]);
     }
 
-    static auto& getObjects() {
-        objectPointers.clear();
+    int batchFor(float radius, float distance, float pixelScale) const {
+        if(!levelOfDetail) return 0;
 
-        for(auto& obj : objects) {
-            objectPointers.emplace_back(obj.get());
+        float pixels = radius * pixelScale / std::max(distance, 1e-6f);
+        for(int level = 0; level < LOD_LEVELS; level++) {
+            if(pixels >= LOD_PIXELS[level]) return level;
         }
-        return objectPointers; 
+        return IMPOSTOR;
     }
 
-    static auto& getStars() {
-        stars.clear();
+    void drawBatch(int batch, size_t first, size_t count) {
+        if(count == 0) return;
 
-        for(auto& obj : objects) {
-            if(obj->star == true) stars.emplace_back(obj.get());
+        if(batch == IMPOSTOR) {
+            quad.bindInstances(instanceVBO, first);
+            quad.drawInstanced(count);
+        }
+        else {
+            meshes[batch].bindInstances(instanceVBO, first);
+            meshes[batch].drawInstanced(count);
         }
-        return stars; 
+    }
+public:
+    // off draws every body at full tessellation with no culling, for comparisons
+    bool levelOfDetail = true;
+
+    bodyRenderer(shader &planetShader, shader &starShader, shader &impostorShader)
+        : planetShader(planetShader), starShader(starShader), impostorShader(impostorShader) {
+        glGenBuffers(1, &instanceVBO);
+
+        planetShader.bindUniformBlock("camera", CAMERA_BINDING);
+        starShader.bindUniformBlock("camera", CAMERA_BINDING);
+        impostorShader.bindUniformBlock("camera", CAMERA_BINDING);
+        lightList::attach(planetShader);
+        lightList::attach(impostorShader);
+
+        planetModelLocation = planetShader.getLocation("model");
+        starModelLocation = starShader.getLocation("model");
+        impostorModelLocation = impostorShader.getLocation("model");
+        impostorLitLocation = impostorShader.getLocation("lit");
     }
 
-    static void updatePhysics(const float &deltaTime) {
-        for(size_t i = 0; i < objects.size(); i++) {
+    void draw(const bodyStore &bodies, float alpha, glm::mat4 model, const std::vector<uint32_t> &stars,
+              const glm::mat4 &view, const glm::mat4 &projection, int viewportWidth, int viewportHeight) {
+        // culling and distances work in model space, where the instance positions live
+        glm::mat4 modelView = view * model;
+        frustum visible(projection * modelView);
+        glm::vec4 eye = glm::inverse(modelView)[3];
+        float pixelScale = 0.5f * (float)viewportHeight * projection[1][1];
 
-            for(size_t j = i + 1; j < objects.size(); j++) {
-                glm::vec3 direction = objects[j]->position - objects[i]->position;
+        for(auto &kind : batches) {
+            for(auto &batch : kind) batch.clear();
+        }
 
-                float distance = glm::dot(direction, direction) + EPS * EPS;
-                if(distance < 0.01f) continue;
+        auto append = [&](int kind, size_t i) {
+            float x = bodies.interpolatedX(i, alpha);
+            float y = bodies.interpolatedY(i, alpha);
+            float z = bodies.interpolatedZ(i, alpha);
+            float radius = bodies.radius[i];
+            if(levelOfDetail && !visible.intersectsSphere(x, y, z, radius)) return;
 
-                float forceMagnitude = GRAVITY * (objects[j]->mass * objects[i]->mass) / distance;
+            float dx = x - eye.x, dy = y - eye.y, dz = z - eye.z;
+            int batch = batchFor(radius, std::sqrt(dx * dx + dy * dy + dz * dz), pixelScale);
+            appendInstance(batches[kind][batch], bodies, i, x, y, z);
+        };
 
-                glm::vec3 directionNormalized(glm::normalize(direction));
-                glm::vec3 force = forceMagnitude * directionNormalized;
+        for(size_t i = 0; i < bodies.size(); i++) {
+            if(!bodies.isStar(i)) append(0, i);
+        }
+        for(uint32_t star : stars) {
+            append(1, star);
+        }
 
-                objects[i]->applyForce(force);
-                objects[j]->applyForce(-force);
+        size_t first[2][BATCHES], count[2][BATCHES];
+        instances.clear();
+        for(int kind = 0; kind < 2; kind++) {
+            for(int batch = 0; batch < BATCHES; batch++) {
+                first[kind][batch] = instances.size() / 7;
+                count[kind][batch] = batches[kind][batch].size() / 7;
+                instances.insert(instances.end(), batches[kind][batch].begin(), batches[kind][batch].end());
             }
         }
+        if(instances.empty()) return;
 
-        for (auto& obj : objects) {
-            obj->updatePosition(deltaTime);
-        }
+        // a fresh store every frame, the driver orphans the one last frame's draws still read from
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(GLfloat), instances.data(), GL_STREAM_DRAW);
+
+        lights.update(bodies, stars, alpha, model, view, projection, viewportWidth, viewportHeight);
+        lights.bind();
+
+        planetShader.use();
+        planetShader.setMat4(planetModelLocation, model);
+        for(int level = 0; level < LOD_LEVELS; level++) drawBatch(level, first[0][level], count[0][level]);
+
+        starShader.use();
+        starShader.setMat4(starModelLocation, model);
+        for(int level = 0; level < LOD_LEVELS; level++) drawBatch(level, first[1][level], count[1][level]);
+
+        impostorShader.use();
+        impostorShader.setMat4(impostorModelLocation, model);
+        impostorShader.setBool(impostorLitLocation, true);
+        drawBatch(IMPOSTOR, first[0][IMPOSTOR], count[0][IMPOSTOR]);
+        impostorShader.setBool(impostorLitLocation, false);
+        drawBatch(IMPOSTOR, first[1][IMPOSTOR], count[1][IMPOSTOR]);
+    }
+
+    ~bodyRenderer() {
+        glDeleteBuffers(1, &instanceVBO);
+    }
+};
+
+// Camera-following clipmap of the potential wells. The lines are generated in the vertex shader from
+// gl_VertexID, so the grid owns no vertex data: LEVELS nested squares of CELLS x CELLS cells, the
+// finest `step` apart and each one around it twice as coarse, 96 * 256 steps across in total.
+class grid {
+private:
+    static constexpr int CELLS = 96;
+    static constexpr int LEVELS = 9;
+    static constexpr GLsizei VERTICES = LEVELS * 2 * (CELLS + 1) * CELLS * 2;
+
+    GLuint VAO;
+    shader &gridShader;
+    GLint modelLocation;
+    GLint eyeLocation;
+    GLint farFieldLocation;
+
+    // well depth = WELL_STRENGTH * mass / sqrt(r^2 + WELL_SOFTENING^2), sampled from a texture
+    static constexpr int POTENTIAL_TEXELS = 256;
+    static constexpr float WELL_SOFTENING = 20.0f;
+    static constexpr float WELL_STRENGTH = 0.4f * 10.0f;
+
+    potentialMap potential;
+    GLuint potentialTexture;
+public:
+    // step is the finest line spacing, the potential map covers [-mapExtent, mapExtent] around the origin
+    grid(float step, float mapExtent, shader &gridShader) : gridShader(gridShader) {
+        gridShader.bindUniformBlock("camera", CAMERA_BINDING);
+        modelLocation = gridShader.getLocation("model");
+        eyeLocation = gridShader.getLocation("eye");
+        farFieldLocation = gridShader.getLocation("farField");
+
+        potential.configure(POTENTIAL_TEXELS, mapExtent, WELL_SOFTENING, WELL_STRENGTH);
+
+        // texel centers map onto world positions through uv = xz * scale + offset
+        float scale = 1.0f / (potential.getSpacing() * POTENTIAL_TEXELS);
+        float offset = (potential.getHalfExtent() + 0.5f * potential.getSpacing()) * scale;
+
+        gridShader.use();
+        gridShader.setInt("potential", 0);
+        gridShader.setVec2("potentialTransform", glm::vec2(scale, offset));
+        gridShader.setFloat("step", step);
+        gridShader.setInt("cells", CELLS);
+        gridShader.setInt("levels", LEVELS);
+
+        glGenTextures(1, &potentialTexture);
+        glBindTexture(GL_TEXTURE_2D, potentialTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, POTENTIAL_TEXELS, POTENTIAL_TEXELS, 0, GL_RED, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        // the core profile wants a vertex array bound even with no attributes
+        glGenVertexArrays(1, &VAO);
+    }
+
+    void draw(glm::mat4 model, const bodyStore &bodies, float alpha, const glm::vec3 &eye) {
+        potential.compute(bodies, alpha);
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, potentialTexture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, POTENTIAL_TEXELS, POTENTIAL_TEXELS, GL_RED, GL_FLOAT, potential.getValues().data());
+
+        gridShader.use();
+        gridShader.setMat4(modelLocation, model);
+        gridShader.setVec2(eyeLocation, glm::vec2(eye.x, eye.z));
+        gridShader.setVec4(farFieldLocation, glm::vec4(potential.getMassCenterX(), potential.getMassCenterZ(),
+                                                       potential.getStrength() * potential.getTotalMass(), potential.getSoftening() * potential.getSoftening()));
+
+        glBindVertexArray(VAO);
+        glDrawArrays(GL_LINES, 0, VERTICES);
+    }
+
+    ~grid() {
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteTextures(1, &potentialTexture);
     }
 };
 
@@ -287,10 +414,87 @@ constexpr int WINDOW_WIDTH = 800;
 constexpr int WINDOW_HEIGTH = 600;
 
 void checkCursor(GLFWwindow *window);
+void checkProfilerKeys(GLFWwindow *window, const std::string &tracePath);
 float getDeltaTime();
-int main() {
-    window myWindow(WINDOW_WIDTH, WINDOW_HEIGTH, "Planetary simulation");
-    glfwSetInputMode(myWindow.getwindow(), GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+int main(int argc, char **argv) {
+    PROFILE_THREAD("main");
+    std::string scenePath = "scenes/solar_system.scene";
+    std::string tracePath = "trace.json";
+    bool asyncPhysics = true;
+    bool levelOfDetail = true;
+
+    // offscreen: no window on screen, no vsync, every frame advances the simulation by 1 / fps
+    bool offscreen = false;
+    int offscreenWidth = 1920, offscreenHeigth = 1080;
+    int contextApi = GLFW_NATIVE_CONTEXT_API;
+    float framesPerSecond = 60.0f;
+    long long frameLimit = 0;
+    std::string framePath;
+    frameFormat format = frameFormat::raw;
+
+    for(int i = 1; i < argc; i++) {
+        if(physicsEngine::parseArgument(argc, argv, i)) continue;
+
+        if(std::string(argv[i]) == "--scene" && i + 1 < argc) {
+            scenePath = argv[++i];
+        }
+        else if(std::string(argv[i]) == "--trace" && i + 1 < argc) {
+            tracePath = argv[++i];
+        }
+        else if(std::string(argv[i]) == "--sync-physics") {
+            asyncPhysics = false;
+        }
+        else if(std::string(argv[i]) == "--full-detail") {
+            levelOfDetail = false;
+        }
+        else if(std::string(argv[i]) == "--shader-cache" && i + 1 < argc) {
+            programCache::directory = argv[++i];
+        }
+        else if(std::string(argv[i]) == "--no-shader-cache") {
+            programCache::directory.clear();
+        }
+        else if(std::string(argv[i]) == "--offscreen" && i + 1 < argc) {
+            offscreen = true;
+            if(std::sscanf(argv[++i], "%dx%d", &offscreenWidth, &offscreenHeigth) != 2) {
+                std::cout << "Could not read resolution " << argv[i] << ", expected WIDTHxHEIGHT" << '\n';
+                return 1;
+            }
+        }
+        else if(std::string(argv[i]) == "--context" && i + 1 < argc) {
+            std::string api = argv[++i];
+            contextApi = api == "egl" ? GLFW_EGL_CONTEXT_API : api == "osmesa" ? GLFW_OSMESA_CONTEXT_API : GLFW_NATIVE_CONTEXT_API;
+        }
+        else if(std::string(argv[i]) == "--fps" && i + 1 < argc) {
+            framesPerSecond = std::max(std::stof(argv[++i]), 1e-3f);
+        }
+        else if(std::string(argv[i]) == "--frames" && i + 1 < argc) {
+            frameLimit = std::stoll(argv[++i]);
+        }
+        else if(std::string(argv[i]) == "--output" && i + 1 < argc) {
+            framePath = argv[++i];
+        }
+        else if(std::string(argv[i]) == "--format" && i + 1 < argc) {
+            format = frameStream::fromName(argv[++i]);
+        }
+        else {
+            std::cout << "Unknown argument: " << argv[i] << '\n';
+        }
+    }
+
+    if(!framePath.empty() && !offscreen) {
+        std::cout << "--output needs --offscreen" << '\n';
+        return 1;
+    }
+    if(const char *reason = physicsEngine::unsupportedCombination(physicsEngine::solver)) {
+        std::cout << reason << '\n';
+        return 1;
+    }
+    // frames have to be reproducible, not paced by the wall clock
+    if(offscreen) asyncPhysics = false;
+
+    window myWindow(offscreen ? offscreenWidth : WINDOW_WIDTH, offscreen ? offscreenHeigth : WINDOW_HEIGTH, "Planetary simulation", offscreen, contextApi);
+    if(!myWindow.isOpen()) return 1;
+    if(!offscreen) glfwSetInputMode(myWindow.getwindow(), GLFW_CURSOR, GLFW_CURSOR_DISABLED);
     glEnable(GL_DEPTH_TEST);
 
     glEnable(GL_BLEND);
@@ -305,79 +509,90 @@ int main() {
     shader defaultShader("src/shaders/default_shader.vert", "src/shaders/default_shader.frag"); // for the planets
     shader lightingShader("src/shaders/lighting_shader.vert", "src/shaders/lighting_shader.frag"); // for the stars
     shader gridShader("src/shaders/grid_shader.vert", "src/shaders/grid_shader.frag"); // for the grid
+    shader impostorShader("src/shaders/impostor_shader.vert", "src/shaders/impostor_shader.frag"); // for distant bodies
+    if(!defaultShader.valid() || !lightingShader.valid() || !gridShader.valid() || !impostorShader.valid()) return 1;
+
+    // view and projection are shared by every shader through one uniform buffer
+    uniformBuffer cameraBuffer(2 * sizeof(glm::mat4), CAMERA_BINDING);
+
+    grid newGrid(5.0f, 1000.0f, gridShader);
+    bodyRenderer renderer(lightingShader, defaultShader, impostorShader);
+    renderer.levelOfDetail = levelOfDetail;
+
+    if(!scene::load(scenePath)) return 1;
 
-    grid newGrid(200, 5.0f, gridShader);
-
-    physicsEngine::addObject(
-        glm::vec3(100.0f, 0.0f, 0.0f),
-        glm::vec3(0.0f, 0.0f, 15.0f),
-        5.0f,
-        0.5f,
-        glm::vec3(0.54f, 0.89f, 1.0f),
-        false,
-        lightingShader
-    );
-
-    physicsEngine::addObject(
-        glm::vec3(-150.0f, 0.0f, 0.0f),
-        glm::vec3(0.0f, 0.0f, -20.0f),
-        3.0f,
-        0.1f,
-        glm::vec3(0.94f, 0.34f, 0.07f),
-        false,
-        lightingShader
-    );
-
-    physicsEngine::addObject(
-        glm::vec3(250.0f, 0.0f, 0.0f),
-        glm::vec3(0.0f, 0.0f, 15.0f),
-        10.0f,
-        0.05f,
-        glm::vec3(0.82f, 0.3f, 0.3f),
-        false,
-        lightingShader
-    );
-
-    physicsEngine::addObject(
-        glm::vec3(275.0f, 0.0f, 0.0f),
-        glm::vec3(0.0f, 0.0f, 20.0f),
-        0.5f,
-        0.1f,
-        glm::vec3(0.77f ,0.78f ,0.73f),
-        false,
-        lightingShader
-    );
-
-    physicsEngine::addObject(
-        glm::vec3(0.0f),
-        glm::vec3(0.0f),
-        500.0f,
-        0.05f,
-        glm::vec3(1.0f, 0.9f, 0.6f),
-        true,
-        defaultShader
-    );
+    gpuProfiler gpuTimers;
+
+    std::unique_ptr<frameStream> frames;
+    if(!framePath.empty()) frames = std::make_unique<frameStream>(myWindow.getWidth(), myWindow.getHeigth(), framePath, format);
+    if(frames && !frames->good()) return 1;
+    long long frameCount = 0;
+    double startTime = glfwGetTime();
+
+    // physics steps on its own thread unless --sync-physics asks for the old lockstep loop
+    physicsThread simulation;
+    if(asyncPhysics) simulation.start();
 
     while(!myWindow.windowShouldClose()) {
+        PROFILE_SCOPE("frame");
         glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        float deltaTime = getDeltaTime();
+        float deltaTime = offscreen ? 1.0f / framesPerSecond : getDeltaTime();
 
         camera::processKeyboardInput(myWindow.getwindow(), deltaTime);
         checkCursor(myWindow.getwindow());
+        checkProfilerKeys(myWindow.getwindow(), tracePath);
 
         glm::mat4 view = camera::getViewMatrix();
         glm::mat4 projection = glm::perspective(glm::radians(55.0f), (float)myWindow.getWidth() / (float)myWindow.getHeigth(), 0.1f, 75000.0f);
 
-        physicsEngine::updatePhysics(deltaTime);
-        for(auto &obj : physicsEngine::getObjects()) {
-            obj->draw(glm::mat4(1.0f), view, projection, physicsEngine::getStars());
+        glm::mat4 cameraMatrices[2] = {view, projection};
+        cameraBuffer.update(cameraMatrices, sizeof(cameraMatrices));
+
+        float alpha;
+        const bodyStore *bodies;
+        const std::vector<uint32_t> *stars;
+
+        if(asyncPhysics) {
+            const renderState &state = simulation.latest(alpha);
+            bodies = &state.bodies;
+            stars = &state.stars;
         }
-        newGrid.draw(glm::mat4(1.0f), view, projection, physicsEngine::getObjects());
+        else {
+            alpha = physicsEngine::advance(deltaTime);
+            bodies = &physicsEngine::getBodies();
+            stars = &physicsEngine::getStars();
+        }
+
+        {
+            PROFILE_SCOPE("draw bodies");
+            PROFILE_GPU_SCOPE(gpuTimers, "bodies");
+            renderer.draw(*bodies, alpha, glm::mat4(1.0f), *stars, view, projection, myWindow.getWidth(), myWindow.getHeigth());
+        }
+        {
+            PROFILE_SCOPE("draw grid");
+            PROFILE_GPU_SCOPE(gpuTimers, "grid");
+            newGrid.draw(glm::mat4(1.0f), *bodies, alpha, camera::cameraPosition);
+        }
+        gpuTimers.endFrame();
 
-        myWindow.swapBuffers();
+        {
+            PROFILE_SCOPE("swapBuffers");
+            myWindow.swapBuffers();
+        }
         glfwPollEvents();
+
+        if(frames && !frames->capture()) break;
+        frameCount++;
+        if(frameLimit > 0 && frameCount >= frameLimit) break;
+    }
+
+    if(frames) frames->finish();
+    if(offscreen) {
+        double seconds = glfwGetTime() - startTime;
+        long long rendered = frames ? (long long)frames->framesWritten() : frameCount;
+        std::cout << "Rendered " << rendered << " frames in " << seconds << " s (" << rendered / std::max(seconds, 1e-9) << " frames/s)" << '\n';
     }
 
     return 0;
@@ -393,6 +608,29 @@ void checkCursor(GLFWwindow *window) {
     keyPressed = escapeDown;
 }
 
+// F1 prints the timings gathered since the last F1, F2 writes them as a Chrome trace.
+void checkProfilerKeys(GLFWwindow *window, const std::string &tracePath) {
+    static bool summaryPressed = false;
+    static bool tracePressed = false;
+    bool summaryDown = glfwGetKey(window, GLFW_KEY_F1);
+    bool traceDown = glfwGetKey(window, GLFW_KEY_F2);
+
+    if((summaryDown && !summaryPressed) || (traceDown && !tracePressed)) {
+        if(!profiler::enabled) {
+            std::cout << "Profiling is compiled out, rebuild with GRAVITY_PROFILE defined" << '\n';
+        }
+        else if(summaryDown) {
+            profiler::summary(std::cout);
+            profiler::reset();
+        }
+        else if(profiler::writeTrace(tracePath)) {
+            std::cout << "wrote " << tracePath << '\n';
+        }
+    }
+    summaryPressed = summaryDown;
+    tracePressed = traceDown;
+}
+
 float getDeltaTime() {
     static float lastFrameTime{};
     static float deltaTime{};
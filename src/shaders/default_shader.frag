@@ -1,8 +1,8 @@
 #version 330 core
 
 out vec4 fragColor;
-uniform vec3 color;
+in vec3 objectColor;
 
 void main() {
-    fragColor = vec4(color, 1.0);
+    fragColor = vec4(objectColor, 1.0);
 }
\ No newline at end of file
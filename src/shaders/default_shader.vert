@@ -1,10 +1,19 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
+layout (location = 2) in vec3 aOffset;
+layout (location = 3) in float aRadius;
+layout (location = 4) in vec3 aColor;
+
+out vec3 objectColor;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+
+layout (std140) uniform camera {
+    mat4 view;
+    mat4 projection;
+};
 
 void main() {
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    objectColor = aColor;
+    gl_Position = projection * view * model * vec4(aPos * aRadius + aOffset, 1.0);
 }
\ No newline at end of file
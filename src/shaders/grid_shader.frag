@@ -1,6 +1,7 @@
 #version 330 core
 out vec4 fragColor;
+in float fade;
 
 void main() {
-    fragColor = vec4(1.0, 1.0, 1.0, 0.2);
+    fragColor = vec4(1.0, 1.0, 1.0, 0.2 * fade);
 }
\ No newline at end of file
@@ -1,39 +1,76 @@
 #version 330 core
-#define MAX_OBJECTS 256
-layout (location = 0) in vec3 aPos;
+// No vertex buffer: every vertex is decoded from gl_VertexID. The grid is a stack of square clipmap
+// levels of `cells` x `cells` lines centered under the eye, each with twice the spacing of the one
+// inside it; a level skips the lines the finer level already draws, so density falls with distance.
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
 
-uniform int objectCount;
-uniform vec3 objectPositions[MAX_OBJECTS];
-uniform float objectMasses[MAX_OBJECTS];
+layout (std140) uniform camera {
+    mat4 view;
+    mat4 projection;
+};
 
-float schwarzschildWell(float r, float mass) {
-    mass *= 10.0;
-    float softening = 20.0;
-    float k = 0.4;
-    float p = 0.5;
-    return k * mass / pow(r*r + softening*softening, p);
-}
+uniform vec2 eye;           // camera position in the XZ plane
+uniform float step;         // line spacing of the finest level
+uniform int cells;          // cells across a level, a multiple of four
+uniform int levels;
+
+// softened potential of all bodies in the XZ plane, filled on the CPU every frame
+uniform sampler2D potential;
+uniform vec2 potentialTransform;
+
+// past the map the well is the monopole of every body: center of mass xz, strength * mass, softening^2
+uniform vec4 farField;
+
+out float fade;
 
 void main() {
-    vec3 pos = aPos;
-    float yOffset = 0.0;
+    int linesPerLevel = 2 * (cells + 1) * cells;
+    int segment = gl_VertexID / 2;
+    int level = segment / linesPerLevel;
+    int local = segment % linesPerLevel;
+
+    // segments of lines along x first, then along z
+    int along = local / ((cells + 1) * cells);
+    int line = (local % ((cells + 1) * cells)) / cells;
+    int cell = local % cells;
 
-    for(int i = 0; i < objectCount; i++) {
-        vec3 objXZ = vec3(objectPositions[i].x, 0.0, objectPositions[i].z);
-        vec3 posXZ = vec3(pos.x, 0.0, pos.z);
+    float spacing = step * exp2(float(level));
+    float halfSize = 0.5 * float(cells) * spacing;
+    // snapped to twice the spacing so every line of this level continues one of the next coarser level
+    vec2 center = floor(eye / (2.0 * spacing) + 0.5) * 2.0 * spacing;
 
-        float r = length(objXZ - posXZ);
+    float offset = float(cell) + float(gl_VertexID & 1);
+    vec2 corner = center - halfSize;
+    vec2 xz = corner + (along == 0 ? vec2(offset, line) : vec2(line, offset)) * spacing;
 
-        float pull = schwarzschildWell(r, objectMasses[i]);
+    if(level > 0) {
+        vec2 finerCenter = floor(eye / spacing + 0.5) * spacing;
+        vec2 middle = corner + (along == 0 ? vec2(float(cell) + 0.5, line) : vec2(line, float(cell) + 0.5)) * spacing;
 
-        yOffset += pull;
+        // drawn by the finer level already: push both ends outside the clip volume
+        if(all(lessThanEqual(abs(middle - finerCenter), vec2(0.5 * halfSize + 0.01 * spacing)))) {
+            gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+            fade = 0.0;
+            return;
+        }
     }
 
-    pos.y -= yOffset;
+    // the outermost level fades out instead of ending in a hard edge
+    fade = 1.0;
+    if(level == levels - 1) {
+        float edge = halfSize - max(abs(xz.x - center.x), abs(xz.y - center.y));
+        fade = clamp(edge / (0.25 * halfSize), 0.0, 1.0);
+    }
+
+    vec2 uv = xz * potentialTransform.x + potentialTransform.y;
+    vec2 toCenter = xz - farField.xy;
+    float far = farField.z / sqrt(dot(toCenter, toCenter) + farField.w);
+
+    // blend over the outer tenth of the map, where the monopole takes over
+    vec2 inside = min(uv, 1.0 - uv);
+    float map = clamp(min(inside.x, inside.y) / 0.1, 0.0, 1.0);
+    float depth = mix(far, textureLod(potential, uv, 0.0).r, map);
 
-    gl_Position = projection * view * model * vec4(pos, 1.0);
+    gl_Position = projection * view * model * vec4(xz.x, -depth, xz.y, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,79 @@
+#version 330 core
+
+out vec4 fragColor;
+in vec3 fragPos;
+flat in vec3 eye;
+flat in vec3 center;
+flat in float radius;
+in vec3 objectColor;
+
+// the stars reaching each screen tile, binned every frame by lightList
+layout (std140) uniform lights {
+    int tileSize;
+    int tilesX;
+    int tilesY;
+};
+
+uniform samplerBuffer lightData;      // per light: position and reach, then ambient color and diffuse strength
+uniform usamplerBuffer lightTiles;    // per tile: first entry in lightIndices and light count
+uniform usamplerBuffer lightIndices;
+
+layout (std140) uniform camera {
+    mat4 view;
+    mat4 projection;
+};
+
+// planets are lit by the stars, stars are drawn in their flat color
+uniform bool lit;
+
+vec3 calculatePointLight(int light, vec3 position, vec3 norm) {
+    vec4 lightPosition = texelFetch(lightData, 2 * light);
+    vec4 color = texelFetch(lightData, 2 * light + 1);
+
+    vec3 toLight = lightPosition.xyz - position;
+    vec3 lightDir = normalize(toLight);
+
+    float diff = max(dot(norm, lightDir), 0.0);
+
+    float fade = clamp(1.0 - dot(toLight, toLight) / (lightPosition.w * lightPosition.w), 0.0, 1.0);
+    fade *= fade;
+
+    vec3 ambient = color.xyz * objectColor;
+    vec3 diffuse = color.w * diff * objectColor;
+
+    return (ambient + diffuse) * fade;
+}
+
+void main() {
+    vec3 ray = normalize(fragPos - eye);
+    vec3 toCenter = center - eye;
+
+    // the ray's closest approach to the center, taken from the perpendicular offset rather than
+    // b^2 - c, which cancels away entirely for a small sphere far from the camera
+    float along = dot(ray, toCenter);
+    vec3 offset = toCenter - ray * along;
+    float inside = radius * radius - dot(offset, offset);
+    if(inside < 0.0) discard;
+
+    float depth = sqrt(inside);
+    vec3 position = eye + ray * (along - depth);
+    vec3 norm = -(offset + ray * depth) / radius;
+
+    vec4 clip = projection * view * vec4(position, 1.0);
+    gl_FragDepth = clip.z / clip.w * 0.5 + 0.5;
+
+    if(!lit) {
+        fragColor = vec4(objectColor, 1.0);
+        return;
+    }
+
+    ivec2 tile = min(ivec2(gl_FragCoord.xy) / tileSize, ivec2(tilesX - 1, tilesY - 1));
+    uvec2 range = texelFetch(lightTiles, tile.y * tilesX + tile.x).xy;
+
+    vec3 result = vec3(0.0);
+    for(uint i = 0u; i < range.y; i++) {
+        result += calculatePointLight(int(texelFetch(lightIndices, int(range.x + i)).x), position, norm);
+    }
+
+    fragColor = vec4(result, 1.0);
+}
\ No newline at end of file
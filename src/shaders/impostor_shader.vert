@@ -0,0 +1,42 @@
+#version 330 core
+layout (location = 0) in vec2 aCorner;
+layout (location = 2) in vec3 aOffset;
+layout (location = 3) in float aRadius;
+layout (location = 4) in vec3 aColor;
+
+out vec3 fragPos;
+flat out vec3 eye;
+flat out vec3 center;
+flat out float radius;
+out vec3 objectColor;
+
+uniform mat4 model;
+
+layout (std140) uniform camera {
+    mat4 view;
+    mat4 projection;
+};
+
+// A camera-facing quad around the body; the fragment shader ray-traces the sphere inside it.
+void main() {
+    center = vec3(model * vec4(aOffset, 1.0));
+    radius = aRadius;
+    objectColor = aColor;
+
+    // the view matrix is a rotation and a translation, so the eye sits at -R^T t
+    eye = -transpose(mat3(view)) * view[3].xyz;
+
+    vec3 toCenter = center - eye;
+    float distance = length(toCenter);
+    vec3 forward = toCenter / distance;
+
+    vec3 up = abs(forward.y) > 0.99 ? vec3(1.0, 0.0, 0.0) : vec3(0.0, 1.0, 0.0);
+    vec3 right = normalize(cross(forward, up));
+    up = cross(right, forward);
+
+    // half width of the silhouette cone where it crosses the plane through the center
+    float extent = radius * distance / sqrt(max(distance * distance - radius * radius, 1e-6 * distance * distance));
+
+    fragPos = center + (right * aCorner.x + up * aCorner.y) * extent;
+    gl_Position = projection * view * vec4(fragPos, 1.0);
+}
\ No newline at end of file
@@ -1,40 +1,51 @@
 #version 330 core
-#define MAX_POINT_LIGHTS 4
 
 out vec4 fragColor;
 in vec3 fragPos;
 in vec3 normal;
+in vec3 objectColor;
 
-struct light {
-    vec3 position;
-
-    vec3 ambient;
-    vec3 diffuse;
+// the stars reaching each screen tile, binned every frame by lightList
+layout (std140) uniform lights {
+    int tileSize;
+    int tilesX;
+    int tilesY;
 };
 
-uniform light pointLights[MAX_POINT_LIGHTS];
+uniform samplerBuffer lightData;      // per light: position and reach, then ambient color and diffuse strength
+uniform usamplerBuffer lightTiles;    // per tile: first entry in lightIndices and light count
+uniform usamplerBuffer lightIndices;
+
 uniform vec3 viewerPos;
-uniform vec3 color;
 
-vec3 calculatePointLight(light pointLight, vec3 norm) {
-    vec3 lightDir = normalize(pointLight.position - fragPos);
+vec3 calculatePointLight(int light, vec3 norm) {
+    vec4 position = texelFetch(lightData, 2 * light);
+    vec4 color = texelFetch(lightData, 2 * light + 1);
+
+    vec3 toLight = position.xyz - fragPos;
+    vec3 lightDir = normalize(toLight);
 
     float diff = max(dot(norm, lightDir), 0.0);
 
-    float dist = length(pointLight.position - fragPos);
+    // fades out smoothly at the light's reach, so tiles beyond it can drop the light
+    float fade = clamp(1.0 - dot(toLight, toLight) / (position.w * position.w), 0.0, 1.0);
+    fade *= fade;
 
-    vec3 ambient = pointLight.ambient * color;
-    vec3 diffuse = pointLight.diffuse * diff * color;
+    vec3 ambient = color.xyz * objectColor;
+    vec3 diffuse = color.w * diff * objectColor;
 
-    return ambient + diffuse;
+    return (ambient + diffuse) * fade;
 }
 
 void main() {
     vec3 norm = normalize(normal);
 
+    ivec2 tile = min(ivec2(gl_FragCoord.xy) / tileSize, ivec2(tilesX - 1, tilesY - 1));
+    uvec2 range = texelFetch(lightTiles, tile.y * tilesX + tile.x).xy;
+
     vec3 result = vec3(0.0);
-    for(int i = 0; i < MAX_POINT_LIGHTS; i++) {
-        result += calculatePointLight(pointLights[i], norm); 
+    for(uint i = 0u; i < range.y; i++) {
+        result += calculatePointLight(int(texelFetch(lightIndices, int(range.x + i)).x), norm);
     }
 
     fragColor = vec4(result, 1.0);
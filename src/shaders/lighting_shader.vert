@@ -1,17 +1,25 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec3 aOffset;
+layout (location = 3) in float aRadius;
+layout (location = 4) in vec3 aColor;
 
 out vec3 fragPos;
 out vec3 normal;
+out vec3 objectColor;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+
+layout (std140) uniform camera {
+    mat4 view;
+    mat4 projection;
+};
 
 void main() {
-    fragPos = vec3(model * vec4(aPos, 1.0));
+    fragPos = vec3(model * vec4(aPos * aRadius + aOffset, 1.0));
     normal = mat3(transpose(inverse(model))) * aNormal;  
+    objectColor = aColor;
     
     gl_Position = projection * view * vec4(fragPos, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,114 @@
+#ifndef BODIES_H
+#define BODIES_H
+#define _USE_MATH_DEFINES
+#include <cmath>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+enum bodyFlag : uint32_t {
+    BODY_STAR = 1u << 0
+};
+
+// Structure-of-arrays storage for every body in the simulation. The force loop only touches
+// the position, acceleration and mass arrays; density and color are kept for rendering and output.
+// prevX/prevY/prevZ hold the positions before the last fixed step so frames can interpolate.
+// Double-precision runs carry each position and velocity as the float value plus the float residual
+// in the low arrays, about 48 significant bits, so the integrators do not round away small steps and
+// the direct and tree kernels resolve close pairs far from the origin; the FMM, the mesh, distributed
+// ranks and rendering read the float value alone. Single-precision runs leave the residuals at zero.
+class bodyStore {
+public:
+    std::vector<float> x, y, z;
+    std::vector<float> vx, vy, vz;
+    std::vector<float> lowX, lowY, lowZ;
+    std::vector<float> lowVX, lowVY, lowVZ;
+    std::vector<float> ax, ay, az;
+    std::vector<float> prevX, prevY, prevZ;
+
+    std::vector<float> mass;
+    std::vector<float> radius;
+    std::vector<uint32_t> flags;
+
+    std::vector<float> density;
+    std::vector<float> colorR, colorG, colorB;
+
+    static float radiusFor(float mass, float density) {
+        return std::cbrt((3.0f * mass) / (4.0f * M_PI * density));
+    }
+
+    size_t size() const { return x.size(); }
+    bool empty() const { return x.empty(); }
+
+    bool isStar(size_t i) const { return flags[i] & BODY_STAR; }
+
+    double preciseX(size_t i) const { return (double)x[i] + lowX[i]; }
+    double preciseY(size_t i) const { return (double)y[i] + lowY[i]; }
+    double preciseZ(size_t i) const { return (double)z[i] + lowZ[i]; }
+    double preciseVX(size_t i) const { return (double)vx[i] + lowVX[i]; }
+    double preciseVY(size_t i) const { return (double)vy[i] + lowVY[i]; }
+    double preciseVZ(size_t i) const { return (double)vz[i] + lowVZ[i]; }
+
+    float interpolatedX(size_t i, float alpha) const { return prevX[i] + (x[i] - prevX[i]) * alpha; }
+    float interpolatedY(size_t i, float alpha) const { return prevY[i] + (y[i] - prevY[i]) * alpha; }
+    float interpolatedZ(size_t i, float alpha) const { return prevZ[i] + (z[i] - prevZ[i]) * alpha; }
+
+    size_t add(float px, float py, float pz, float velX, float velY, float velZ, float bodyMass, float bodyDensity, float r, float g, float b, uint32_t bodyFlags) {
+        x.push_back(px); y.push_back(py); z.push_back(pz);
+        vx.push_back(velX); vy.push_back(velY); vz.push_back(velZ);
+        lowX.push_back(0.0f); lowY.push_back(0.0f); lowZ.push_back(0.0f);
+        lowVX.push_back(0.0f); lowVY.push_back(0.0f); lowVZ.push_back(0.0f);
+        ax.push_back(0.0f); ay.push_back(0.0f); az.push_back(0.0f);
+        prevX.push_back(px); prevY.push_back(py); prevZ.push_back(pz);
+
+        mass.push_back(bodyMass);
+        radius.push_back(radiusFor(bodyMass, bodyDensity));
+        flags.push_back(bodyFlags);
+
+        density.push_back(bodyDensity);
+        colorR.push_back(r); colorG.push_back(g); colorB.push_back(b);
+
+        return size() - 1;
+    }
+
+    // Removes a body by moving the last one into its slot, so indices past `index` are not preserved.
+    void remove(size_t index) {
+        size_t last = size() - 1;
+
+        forEachArray([&](auto &array) {
+            array[index] = array[last];
+            array.pop_back();
+        });
+    }
+
+    void resize(size_t count) {
+        forEachArray([&](auto &array) { array.resize(count); });
+    }
+
+    void reserve(size_t count) {
+        forEachArray([&](auto &array) { array.reserve(count); });
+    }
+
+    void clear() {
+        forEachArray([&](auto &array) { array.clear(); });
+    }
+
+    template<typename Function>
+    void forEachArray(Function function) {
+        function(x); function(y); function(z);
+        function(vx); function(vy); function(vz);
+        function(lowX); function(lowY); function(lowZ);
+        function(lowVX); function(lowVY); function(lowVZ);
+        function(ax); function(ay); function(az);
+        function(prevX); function(prevY); function(prevZ);
+
+        function(mass);
+        function(radius);
+        function(flags);
+
+        function(density);
+        function(colorR); function(colorG); function(colorB);
+    }
+};
+
+#endif
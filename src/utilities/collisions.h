@@ -0,0 +1,299 @@
+#ifndef COLLISIONS_H
+#define COLLISIONS_H
+#include <cmath>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <numeric>
+#include <algorithm>
+#include "bodies.h"
+#include "profiler.h"
+
+enum class collisionMode {
+    none,
+    merge,
+    bounce
+};
+
+// Uniform grid over a subset of bodies, hashed into a power-of-two bucket table. Each body is binned
+// once, by the cell of its center, and the entries are counting-sorted by bucket. Cells are at least
+// twice the largest member radius, so two touching members always sit in the same or adjacent cells;
+// pairs come from each cell and the forward half of its neighbours, so every pair is visited once.
+// Entries of different cells that share a bucket are told apart by their cell coordinates.
+class spatialHash {
+private:
+    struct entry {
+        int32_t cellX, cellY, cellZ;
+        uint32_t body;
+    };
+
+    std::vector<entry> entries, sorted;
+    std::vector<uint32_t> bucketStart, cursor;
+    uint32_t mask = 0;
+    float inverseCell = 1.0f;
+    float maxRadius = 0.0f;
+
+    // columns along z land in consecutive buckets, so the neighbours of a cell are mostly in cache
+    static uint32_t hashCell(int32_t x, int32_t y, int32_t z) {
+        return ((uint32_t)x * 73856093u ^ (uint32_t)y * 19349663u) + (uint32_t)z;
+    }
+
+    int32_t cellOf(float coordinate) const {
+        return (int32_t)std::floor(coordinate * inverseCell);
+    }
+
+    uint32_t bucketOf(int32_t x, int32_t y, int32_t z) const {
+        return hashCell(x, y, z) & mask;
+    }
+
+    template<typename Visit>
+    void forEachInCell(int32_t x, int32_t y, int32_t z, Visit visit) const {
+        uint32_t b = bucketOf(x, y, z);
+        for(uint32_t p = bucketStart[b]; p < bucketStart[b + 1]; p++) {
+            const entry &e = sorted[p];
+            if(e.cellX == x && e.cellY == y && e.cellZ == z) visit(e.body);
+        }
+    }
+public:
+    // size must be at least twice the largest radius among the members
+    void build(const bodyStore &bodies, const std::vector<uint32_t> &members, float size) {
+        inverseCell = 1.0f / size;
+        maxRadius = 0.0f;
+        entries.resize(members.size());
+
+        for(size_t k = 0; k < members.size(); k++) {
+            uint32_t i = members[k];
+            entries[k] = {cellOf(bodies.x[i]), cellOf(bodies.y[i]), cellOf(bodies.z[i]), i};
+            maxRadius = std::max(maxRadius, bodies.radius[i]);
+        }
+
+        size_t buckets = 1;
+        while(buckets < 2 * entries.size()) buckets <<= 1;
+        mask = buckets - 1;
+
+        bucketStart.assign(buckets + 1, 0);
+        for(const entry &e : entries) bucketStart[bucketOf(e.cellX, e.cellY, e.cellZ) + 1]++;
+        for(size_t b = 0; b < buckets; b++) bucketStart[b + 1] += bucketStart[b];
+
+        sorted.resize(entries.size());
+        cursor.assign(bucketStart.begin(), bucketStart.end() - 1);
+        for(const entry &e : entries) sorted[cursor[bucketOf(e.cellX, e.cellY, e.cellZ)]++] = e;
+    }
+
+    // Calls visit(i, j) once for every two members in the same or adjacent cells.
+    template<typename Visit>
+    void forEachPair(Visit visit) const {
+        // the 13 neighbours that come after a cell in (x, y, z) order
+        static const int32_t forward[13][3] = {
+            {0, 0, 1}, {0, 1, -1}, {0, 1, 0}, {0, 1, 1},
+            {1, -1, -1}, {1, -1, 0}, {1, -1, 1}, {1, 0, -1}, {1, 0, 0}, {1, 0, 1}, {1, 1, -1}, {1, 1, 0}, {1, 1, 1}
+        };
+
+        for(size_t b = 0; b + 1 < bucketStart.size(); b++) {
+            for(uint32_t p = bucketStart[b]; p < bucketStart[b + 1]; p++) {
+                const entry &a = sorted[p];
+
+                for(uint32_t q = p + 1; q < bucketStart[b + 1]; q++) {
+                    const entry &c = sorted[q];
+                    if(a.cellX == c.cellX && a.cellY == c.cellY && a.cellZ == c.cellZ) visit(a.body, c.body);
+                }
+                for(const auto &offset : forward) {
+                    forEachInCell(a.cellX + offset[0], a.cellY + offset[1], a.cellZ + offset[2], [&](uint32_t j) { visit(a.body, j); });
+                }
+            }
+        }
+    }
+
+    // Calls visit(i) for every member that could touch a sphere of the given radius, and some more.
+    template<typename Visit>
+    void query(float x, float y, float z, float r, Visit visit) const {
+        if(sorted.empty()) return;
+        float reach = r + maxRadius;
+
+        for(int32_t cx = cellOf(x - reach); cx <= cellOf(x + reach); cx++) {
+            for(int32_t cy = cellOf(y - reach); cy <= cellOf(y + reach); cy++) {
+                for(int32_t cz = cellOf(z - reach); cz <= cellOf(z + reach); cz++) forEachInCell(cx, cy, cz, visit);
+            }
+        }
+    }
+};
+
+// Sphere collisions between bodies, using the radius derived from mass and density.
+//
+// Broadphase: two spatial hashes. The fine one has cells twice the 99th percentile radius and holds
+// every body up to that radius. The rare larger bodies (stars, merged giants) go into a coarse hash
+// sized by the largest radius; each small body queries it for the handful of large ones nearby. Both
+// passes are O(N) for any radius spread.
+//
+// Narrowphase is the exact sphere overlap test at the current positions. Overlapping groups either
+// merge into one body conserving mass, momentum and volume, or bounce off each other with an impulse
+// scaled by the restitution and are pushed apart along the contact normal.
+class collisionSystem {
+private:
+    spatialHash fine, coarse;
+    std::vector<uint32_t> small, large;
+    std::vector<float> scratch;
+    std::vector<uint32_t> parent, absorbed;
+    std::vector<std::pair<uint32_t, uint32_t>> contacts;
+
+    uint32_t findRoot(uint32_t i) {
+        while(parent[i] != i) {
+            parent[i] = parent[parent[i]];
+            i = parent[i];
+        }
+        return i;
+    }
+
+    void addIfTouching(const bodyStore &bodies, uint32_t i, uint32_t j) {
+        float dx = bodies.x[j] - bodies.x[i];
+        float dy = bodies.y[j] - bodies.y[i];
+        float dz = bodies.z[j] - bodies.z[i];
+        float reach = bodies.radius[i] + bodies.radius[j];
+
+        if(dx * dx + dy * dy + dz * dz < reach * reach) contacts.emplace_back(std::min(i, j), std::max(i, j));
+    }
+
+    void broadphase(const bodyStore &bodies) {
+        const size_t count = bodies.size();
+
+        scratch.assign(bodies.radius.begin(), bodies.radius.end());
+        size_t quantile = (count * 99) / 100;
+        std::nth_element(scratch.begin(), scratch.begin() + quantile, scratch.end());
+        const float limit = std::max(scratch[quantile], 1e-3f);
+
+        small.clear();
+        large.clear();
+        float largest = 0.0f;
+        for(uint32_t i = 0; i < count; i++) {
+            if(bodies.radius[i] <= limit) {
+                small.push_back(i);
+            }
+            else {
+                large.push_back(i);
+                largest = std::max(largest, bodies.radius[i]);
+            }
+        }
+
+        contacts.clear();
+        auto touching = [&](uint32_t i, uint32_t j) { addIfTouching(bodies, i, j); };
+
+        fine.build(bodies, small, 2.0f * limit);
+        fine.forEachPair(touching);
+
+        if(large.empty()) return;
+
+        coarse.build(bodies, large, 2.0f * largest);
+        coarse.forEachPair(touching);
+        for(uint32_t i : small) {
+            coarse.query(bodies.x[i], bodies.y[i], bodies.z[i], bodies.radius[i], [&](uint32_t j) { addIfTouching(bodies, i, j); });
+        }
+    }
+
+    // Folds every connected group of touching bodies into its lowest index and removes the rest.
+    size_t merge(bodyStore &bodies) {
+        const size_t count = bodies.size();
+        parent.resize(count);
+        std::iota(parent.begin(), parent.end(), 0u);
+
+        for(auto [i, j] : contacts) {
+            uint32_t a = findRoot(i), b = findRoot(j);
+            if(a != b) parent[std::max(a, b)] = std::min(a, b);
+        }
+
+        absorbed.clear();
+        for(uint32_t i = 0; i < count; i++) {
+            uint32_t root = findRoot(i);
+            if(root == i) continue;
+
+            double m1 = bodies.mass[root], m2 = bodies.mass[i], total = m1 + m2;
+            auto blend = [&](std::vector<float> &array) {
+                array[root] = (float)((array[root] * m1 + array[i] * m2) / total);
+            };
+
+            blend(bodies.x); blend(bodies.y); blend(bodies.z);
+            blend(bodies.prevX); blend(bodies.prevY); blend(bodies.prevZ);
+            blend(bodies.vx); blend(bodies.vy); blend(bodies.vz);
+            blend(bodies.lowX); blend(bodies.lowY); blend(bodies.lowZ);
+            blend(bodies.lowVX); blend(bodies.lowVY); blend(bodies.lowVZ);
+            blend(bodies.ax); blend(bodies.ay); blend(bodies.az);
+            blend(bodies.colorR); blend(bodies.colorG); blend(bodies.colorB);
+
+            // volumes add up, so the merged density is the total mass over the total volume
+            double volume = m1 / bodies.density[root] + m2 / bodies.density[i];
+            bodies.mass[root] = (float)total;
+            bodies.density[root] = (float)(total / volume);
+            bodies.radius[root] = bodyStore::radiusFor(bodies.mass[root], bodies.density[root]);
+            bodies.flags[root] |= bodies.flags[i];
+
+            absorbed.push_back(i);
+        }
+
+        // remove from the back so the swapped-in bodies are ones already visited
+        for(auto index = absorbed.rbegin(); index != absorbed.rend(); index++) bodies.remove(*index);
+        return absorbed.size();
+    }
+
+    void bounce(bodyStore &bodies, float restitution) {
+        for(auto [i, j] : contacts) {
+            float nx = bodies.x[j] - bodies.x[i];
+            float ny = bodies.y[j] - bodies.y[i];
+            float nz = bodies.z[j] - bodies.z[i];
+            float distance = std::sqrt(nx * nx + ny * ny + nz * nz);
+
+            if(distance > 0.0f) {
+                nx /= distance; ny /= distance; nz /= distance;
+            }
+            else {
+                nx = 1.0f; ny = 0.0f; nz = 0.0f;
+            }
+
+            float inverseI = 1.0f / bodies.mass[i], inverseJ = 1.0f / bodies.mass[j];
+            float inverseSum = inverseI + inverseJ;
+
+            // separate the spheres in proportion to their inverse masses, which keeps the center of mass
+            float overlap = bodies.radius[i] + bodies.radius[j] - distance;
+            float pushI = overlap * inverseI / inverseSum, pushJ = overlap * inverseJ / inverseSum;
+            bodies.x[i] -= nx * pushI; bodies.y[i] -= ny * pushI; bodies.z[i] -= nz * pushI;
+            bodies.x[j] += nx * pushJ; bodies.y[j] += ny * pushJ; bodies.z[j] += nz * pushJ;
+
+            float approach = (bodies.vx[j] - bodies.vx[i]) * nx + (bodies.vy[j] - bodies.vy[i]) * ny + (bodies.vz[j] - bodies.vz[i]) * nz;
+            if(approach >= 0.0f) continue;
+
+            float impulse = -(1.0f + restitution) * approach / inverseSum;
+            bodies.vx[i] -= impulse * inverseI * nx; bodies.vy[i] -= impulse * inverseI * ny; bodies.vz[i] -= impulse * inverseI * nz;
+            bodies.vx[j] += impulse * inverseJ * nx; bodies.vy[j] += impulse * inverseJ * ny; bodies.vz[j] += impulse * inverseJ * nz;
+        }
+    }
+public:
+    static const char* name(collisionMode type) {
+        switch(type) {
+            case collisionMode::merge: return "merge";
+            case collisionMode::bounce: return "bounce";
+            default: return "none";
+        }
+    }
+
+    static collisionMode fromName(const std::string &name) {
+        if(name == "merge") return collisionMode::merge;
+        if(name == "bounce") return collisionMode::bounce;
+        return collisionMode::none;
+    }
+
+    // Finds and resolves every overlap, returns the number of contacts handled. Merging removes bodies,
+    // so indices past the first merged body do not survive the call.
+    size_t resolve(bodyStore &bodies, collisionMode mode, float restitution, size_t &merged) {
+        merged = 0;
+        if(mode == collisionMode::none || bodies.size() < 2) return 0;
+
+        PROFILE_SCOPE("collisions");
+        broadphase(bodies);
+        if(contacts.empty()) return 0;
+
+        if(mode == collisionMode::merge) merged = merge(bodies);
+        else bounce(bodies, restitution);
+
+        return contacts.size();
+    }
+};
+
+#endif
@@ -0,0 +1,764 @@
+#ifndef DISTRIBUTED_H
+#define DISTRIBUTED_H
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <chrono>
+#include <ctime>
+#include <thread>
+#include <limits>
+#include <algorithm>
+#include <type_traits>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "physics.h"
+#include "octree.h"
+#include "integrator.h"
+#include "profiler.h"
+
+// Fully connected Unix domain stream sockets between the ranks of one run. Rank r listens on
+// <prefix>.<r>, connects to every lower rank and accepts every higher one, so ranks can be started
+// in any order. Messages are length-prefixed byte strings; exchange() moves a whole round at once
+// through poll(), so large messages between many pairs never deadlock on full socket buffers.
+class rankSockets {
+public:
+    using message = std::vector<char>;
+private:
+    static constexpr int CONNECT_TIMEOUT_MS = 30000;
+
+    int rank = 0;
+    int size = 1;
+    std::vector<int> sockets;
+
+    static bool addressFor(const std::string &path, sockaddr_un &address) {
+        address = {};
+        address.sun_family = AF_UNIX;
+        if(path.size() >= sizeof(address.sun_path)) {
+            std::cout << "Could not use socket path, too long: " << path << '\n';
+            return false;
+        }
+        std::strcpy(address.sun_path, path.c_str());
+        return true;
+    }
+
+    static bool writeBlocking(int socket, const void *data, size_t bytes) {
+        const char *cursor = (const char*)data;
+        while(bytes > 0) {
+            ssize_t written = ::send(socket, cursor, bytes, MSG_NOSIGNAL);
+            if(written <= 0) return false;
+            cursor += written;
+            bytes -= written;
+        }
+        return true;
+    }
+
+    static bool readBlocking(int socket, void *data, size_t bytes) {
+        char *cursor = (char*)data;
+        while(bytes > 0) {
+            ssize_t read = ::recv(socket, cursor, bytes, 0);
+            if(read <= 0) return false;
+            cursor += read;
+            bytes -= read;
+        }
+        return true;
+    }
+
+    void closeAll() {
+        for(int &socket : sockets) {
+            if(socket >= 0) ::close(socket);
+            socket = -1;
+        }
+    }
+public:
+    int getRank() const { return rank; }
+    int getSize() const { return size; }
+
+    bool connect(const std::string &prefix, int myRank, int rankCount) {
+        rank = myRank;
+        size = rankCount;
+        sockets.assign(size, -1);
+
+        sockaddr_un address;
+        std::string path = prefix + "." + std::to_string(rank);
+        if(!addressFor(path, address)) return false;
+
+        int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        ::unlink(path.c_str());
+        if(listener < 0 || ::bind(listener, (sockaddr*)&address, sizeof(address)) != 0 || ::listen(listener, size) != 0) {
+            std::cout << "Could not listen on " << path << ": " << std::strerror(errno) << '\n';
+            if(listener >= 0) ::close(listener);
+            return false;
+        }
+
+        for(int peer = 0; peer < rank; peer++) {
+            std::string peerPath = prefix + "." + std::to_string(peer);
+            if(!addressFor(peerPath, address)) return false;
+
+            int socket = -1;
+            for(int waited = 0; waited < CONNECT_TIMEOUT_MS; waited += 10) {
+                socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+                if(::connect(socket, (sockaddr*)&address, sizeof(address)) == 0) break;
+
+                ::close(socket);
+                socket = -1;
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+
+            int32_t hello = rank;
+            if(socket < 0 || !writeBlocking(socket, &hello, sizeof(hello))) {
+                std::cout << "Could not connect rank " << rank << " to " << peerPath << '\n';
+                ::close(listener);
+                return false;
+            }
+            sockets[peer] = socket;
+        }
+
+        for(int accepted = rank + 1; accepted < size; accepted++) {
+            int socket = ::accept(listener, nullptr, nullptr);
+            int32_t peer = -1;
+
+            if(socket < 0 || !readBlocking(socket, &peer, sizeof(peer)) || peer <= rank || peer >= size || sockets[peer] >= 0) {
+                std::cout << "Could not accept a peer on rank " << rank << '\n';
+                ::close(listener);
+                return false;
+            }
+            sockets[peer] = socket;
+        }
+        ::close(listener);
+        ::unlink(path.c_str());
+
+        for(int socket : sockets) {
+            if(socket >= 0) ::fcntl(socket, F_SETFL, ::fcntl(socket, F_GETFL) | O_NONBLOCK);
+        }
+        return true;
+    }
+
+    // Sends outgoing[peer] to and receives incoming[peer] from every listed peer; both are indexed by
+    // rank. Every listed peer has to take part in the same round.
+    bool exchange(const std::vector<int> &peers, const std::vector<message> &outgoing, std::vector<message> &incoming) {
+        PROFILE_SCOPE("rank exchange");
+        incoming.resize(size);
+
+        std::vector<uint64_t> sendLength(size), receiveLength(size);
+        std::vector<size_t> sent(size, 0), received(size, 0);
+        std::vector<pollfd> waiting;
+        std::vector<int> waitingPeer;
+
+        for(int peer : peers) sendLength[peer] = outgoing[peer].size();
+
+        auto sendDone = [&](int peer) { return sent[peer] == sizeof(uint64_t) + sendLength[peer]; };
+        auto receiveDone = [&](int peer) { return received[peer] >= sizeof(uint64_t) && received[peer] == sizeof(uint64_t) + receiveLength[peer]; };
+
+        while(true) {
+            waiting.clear();
+            waitingPeer.clear();
+            for(int peer : peers) {
+                short events = (sendDone(peer) ? 0 : POLLOUT) | (receiveDone(peer) ? 0 : POLLIN);
+                if(events == 0) continue;
+
+                waiting.push_back({sockets[peer], events, 0});
+                waitingPeer.push_back(peer);
+            }
+            if(waiting.empty()) return true;
+
+            if(::poll(waiting.data(), waiting.size(), -1) < 0) {
+                if(errno == EINTR) continue;
+                std::cout << "Could not poll rank sockets: " << std::strerror(errno) << '\n';
+                return false;
+            }
+
+            for(size_t k = 0; k < waiting.size(); k++) {
+                int peer = waitingPeer[k];
+                int socket = sockets[peer];
+                if(waiting[k].revents & (POLLERR | POLLNVAL)) {
+                    std::cout << "Could not reach rank " << peer << " from rank " << rank << '\n';
+                    return false;
+                }
+
+                while((waiting[k].revents & POLLOUT) && !sendDone(peer)) {
+                    const char *data;
+                    size_t bytes;
+                    if(sent[peer] < sizeof(uint64_t)) {
+                        data = (const char*)&sendLength[peer] + sent[peer];
+                        bytes = sizeof(uint64_t) - sent[peer];
+                    }
+                    else {
+                        data = outgoing[peer].data() + (sent[peer] - sizeof(uint64_t));
+                        bytes = sizeof(uint64_t) + sendLength[peer] - sent[peer];
+                    }
+
+                    ssize_t written = ::send(socket, data, bytes, MSG_NOSIGNAL);
+                    if(written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+                    if(written <= 0) {
+                        std::cout << "Could not send to rank " << peer << " from rank " << rank << '\n';
+                        return false;
+                    }
+                    sent[peer] += written;
+                }
+
+                while((waiting[k].revents & (POLLIN | POLLHUP)) && !receiveDone(peer)) {
+                    char *data;
+                    size_t bytes;
+                    if(received[peer] < sizeof(uint64_t)) {
+                        data = (char*)&receiveLength[peer] + received[peer];
+                        bytes = sizeof(uint64_t) - received[peer];
+                    }
+                    else {
+                        data = incoming[peer].data() + (received[peer] - sizeof(uint64_t));
+                        bytes = sizeof(uint64_t) + receiveLength[peer] - received[peer];
+                    }
+
+                    ssize_t read = ::recv(socket, data, bytes, 0);
+                    if(read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+                    if(read <= 0) {
+                        std::cout << "Could not receive from rank " << peer << " on rank " << rank << '\n';
+                        return false;
+                    }
+
+                    received[peer] += read;
+                    if(received[peer] == sizeof(uint64_t)) incoming[peer].resize(receiveLength[peer]);
+                }
+            }
+        }
+    }
+
+    // Every listed peer and this rank end up with the same all[rank] = what that rank passed in.
+    bool allGather(const std::vector<int> &peers, const message &mine, std::vector<message> &all) {
+        std::vector<message> outgoing(size);
+        for(int peer : peers) outgoing[peer] = mine;
+
+        if(!exchange(peers, outgoing, all)) return false;
+        all[rank] = mine;
+        return true;
+    }
+
+    rankSockets() = default;
+    rankSockets(const rankSockets&) = delete;
+    rankSockets& operator=(const rankSockets&) = delete;
+
+    ~rankSockets() {
+        closeAll();
+    }
+};
+
+// Runs the simulation split across ranks, each holding only its own bodies in physicsEngine's store.
+//
+// The domain is cut by orthogonal recursive bisection: every level splits a group of ranks along the
+// longest axis of its box at the weighted median of its bodies, found from histograms summed over the
+// group, and moves the bodies on the wrong side across. Weights are each rank's measured force time
+// spread over its bodies, so the split follows cost rather than count, and it is redone whenever the
+// slowest rank falls more than REBALANCE_THRESHOLD behind the mean (and by more than timer noise).
+//
+// Each force evaluation the ranks swap bounding boxes, then every rank walks a tree of its own bodies
+// for each other rank's box and sends the locally essential part: point masses for nodes that box
+// would accept under theta, raw bodies for the rest. The receiver evaluates its own bodies against
+// its bodies plus everything imported. Solvers other than Barnes-Hut receive every remote body.
+class distributedEngine {
+private:
+    static constexpr int HISTOGRAM_BINS = 256;
+    static constexpr int HISTOGRAM_ROUNDS = 3;
+    static constexpr double REBALANCE_THRESHOLD = 1.1;
+    static constexpr double REBALANCE_MIN_SECONDS = 0.01;    // smaller gaps are timer noise, not worth moving bodies for
+
+    rankSockets sockets;
+    std::vector<int> everyone;
+
+    // original index of every local body, carried along when bodies move so output keeps its order
+    std::vector<uint32_t> ids;
+    std::vector<float> weights;
+
+    octree exporter;
+    integrator stepper;
+    bool accelerationsValid = false;
+    bool failed = false;
+
+    double forceSeconds = 0.0;    // CPU time spent on forces since the last balance
+    double totalForceSeconds = 0.0;
+    long stepsSinceBalance = 0;
+
+    std::vector<float> sourceX, sourceY, sourceZ, sourceM;
+    std::vector<char> keep;
+
+    // Cost is measured in CPU time of this process: waiting on slower ranks takes none, and it stays
+    // meaningful when more ranks than cores share the host.
+    static double cpuSeconds() {
+        timespec now;
+        ::clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+        return now.tv_sec + now.tv_nsec * 1e-9;
+    }
+
+    template<typename T>
+    static void append(rankSockets::message &target, const T &value) {
+        const char *bytes = (const char*)&value;
+        target.insert(target.end(), bytes, bytes + sizeof(T));
+    }
+
+    template<typename T>
+    static T read(const rankSockets::message &source, size_t &offset) {
+        T value;
+        std::memcpy(&value, source.data() + offset, sizeof(T));
+        offset += sizeof(T);
+        return value;
+    }
+
+    // every bodyStore array holds 4 byte values, a body travels as one of each plus id and weight
+    static size_t recordBytes(bodyStore &bodies) {
+        size_t bytes = 0;
+        bodies.forEachArray([&](auto &array) { bytes += sizeof(array[0]); });
+        return bytes + sizeof(uint32_t) + sizeof(float);
+    }
+
+    void packBody(bodyStore &bodies, size_t i, rankSockets::message &target) {
+        bodies.forEachArray([&](auto &array) { append(target, array[i]); });
+        append(target, ids[i]);
+        append(target, weights[i]);
+    }
+
+    void unpackBodies(bodyStore &bodies, const rankSockets::message &source) {
+        size_t first = bodies.size();
+        size_t count = source.size() / recordBytes(bodies);
+
+        bodies.resize(first + count);
+        ids.resize(first + count);
+        weights.resize(first + count);
+
+        size_t offset = 0;
+        for(size_t i = first; i < first + count; i++) {
+            bodies.forEachArray([&](auto &array) { array[i] = read<std::decay_t<decltype(array[0])>>(source, offset); });
+            ids[i] = read<uint32_t>(source, offset);
+            weights[i] = read<float>(source, offset);
+        }
+    }
+
+    // Drops the bodies whose keep flag is cleared, preserving the order of the rest.
+    void compact(bodyStore &bodies) {
+        size_t kept = 0;
+        for(size_t i = 0; i < bodies.size(); i++) {
+            if(!keep[i]) continue;
+
+            if(kept != i) {
+                bodies.forEachArray([&](auto &array) { array[kept] = array[i]; });
+                ids[kept] = ids[i];
+                weights[kept] = weights[i];
+            }
+            kept++;
+        }
+        bodies.resize(kept);
+        ids.resize(kept);
+        weights.resize(kept);
+    }
+
+    // lower xyz then upper xyz, inverted when the rank holds no bodies
+    static void localBounds(const bodyStore &bodies, float (&box)[6]) {
+        const float inf = std::numeric_limits<float>::infinity();
+        std::fill(box, box + 3, inf);
+        std::fill(box + 3, box + 6, -inf);
+
+        for(size_t i = 0; i < bodies.size(); i++) {
+            box[0] = std::min(box[0], bodies.x[i]); box[3] = std::max(box[3], bodies.x[i]);
+            box[1] = std::min(box[1], bodies.y[i]); box[4] = std::max(box[4], bodies.y[i]);
+            box[2] = std::min(box[2], bodies.z[i]); box[5] = std::max(box[5], bodies.z[i]);
+        }
+    }
+
+    bool gatherBounds(const bodyStore &bodies, std::vector<rankSockets::message> &boxes) {
+        float box[6];
+        localBounds(bodies, box);
+
+        rankSockets::message mine;
+        for(float value : box) append(mine, value);
+        return sockets.allGather(everyone, mine, boxes);
+    }
+
+    std::vector<int> peersIn(int begin, int end) const {
+        std::vector<int> peers;
+        for(int peer = begin; peer < end; peer++) {
+            if(peer != sockets.getRank()) peers.push_back(peer);
+        }
+        return peers;
+    }
+
+    // Coordinate along axis below which `fraction` of the group's weight lies, refined over a few
+    // rounds of histograms so every rank of the group arrives at the same value.
+    bool findSplit(const std::vector<int> &group, const bodyStore &bodies, int axis, float low, float high, double fraction, float &split) {
+        const std::vector<float> &coordinate = axis == 0 ? bodies.x : axis == 1 ? bodies.y : bodies.z;
+        double target = -1.0;
+
+        for(int round = 0; round < HISTOGRAM_ROUNDS; round++) {
+            // bin 0 collects everything below the range, the last bin everything above it
+            std::vector<double> histogram(HISTOGRAM_BINS + 2, 0.0);
+            float width = (high - low) / HISTOGRAM_BINS;
+
+            for(size_t i = 0; i < bodies.size(); i++) {
+                int bin = coordinate[i] < low ? 0
+                        : coordinate[i] >= high || width <= 0.0f ? HISTOGRAM_BINS + 1
+                        : 1 + std::min(HISTOGRAM_BINS - 1, (int)((coordinate[i] - low) / width));
+                histogram[bin] += weights[i];
+            }
+
+            rankSockets::message mine(histogram.size() * sizeof(double));
+            std::memcpy(mine.data(), histogram.data(), mine.size());
+            std::vector<rankSockets::message> all;
+            if(!sockets.allGather(group, mine, all)) return false;
+
+            // summed in rank order so every member gets bitwise the same totals
+            std::fill(histogram.begin(), histogram.end(), 0.0);
+            for(int member = 0; member < sockets.getSize(); member++) {
+                if(all[member].size() != mine.size()) continue;
+
+                const double *values = (const double*)all[member].data();
+                for(size_t bin = 0; bin < histogram.size(); bin++) histogram[bin] += values[bin];
+            }
+
+            if(target < 0.0) {
+                double total = 0.0;
+                for(double value : histogram) total += value;
+                target = fraction * total;
+            }
+
+            double below = histogram[0];
+            int bin = 0;
+            while(bin < HISTOGRAM_BINS - 1 && below + histogram[bin + 1] < target) {
+                below += histogram[bin + 1];
+                bin++;
+            }
+
+            low = low + bin * width;
+            high = low + width;
+        }
+
+        split = 0.5f * (low + high);
+        return true;
+    }
+
+    // Recomputes the bisection from the current weights and moves every body to its new owner.
+    bool balance() {
+        PROFILE_SCOPE("rebalance");
+        bodyStore &bodies = physicsEngine::getBodies();
+        const int rank = sockets.getRank();
+
+        std::vector<rankSockets::message> boxes;
+        if(!gatherBounds(bodies, boxes)) return false;
+
+        float lower[3], upper[3];
+        for(int axis = 0; axis < 3; axis++) {
+            lower[axis] = std::numeric_limits<float>::infinity();
+            upper[axis] = -lower[axis];
+
+            for(const rankSockets::message &box : boxes) {
+                lower[axis] = std::min(lower[axis], ((const float*)box.data())[axis]);
+                upper[axis] = std::max(upper[axis], ((const float*)box.data())[axis + 3]);
+            }
+        }
+        if(lower[0] > upper[0]) return true;
+
+        int begin = 0, end = sockets.getSize();
+        while(end - begin > 1) {
+            int middle = (begin + end) / 2;
+            std::vector<int> group = peersIn(begin, end);
+
+            int axis = 0;
+            for(int candidate = 1; candidate < 3; candidate++) {
+                if(upper[candidate] - lower[candidate] > upper[axis] - lower[axis]) axis = candidate;
+            }
+
+            float split;
+            if(!findSplit(group, bodies, axis, lower[axis], upper[axis], (double)(middle - begin) / (end - begin), split)) return false;
+
+            // the wrong side goes to a partner in the other half, spread evenly over its ranks
+            bool lowerHalf = rank < middle;
+            int partner = lowerHalf ? middle + (rank - begin) % (end - middle) : begin + (rank - middle) % (middle - begin);
+            const std::vector<float> &coordinate = axis == 0 ? bodies.x : axis == 1 ? bodies.y : bodies.z;
+
+            std::vector<rankSockets::message> outgoing(sockets.getSize()), incoming;
+            keep.assign(bodies.size(), 1);
+            for(size_t i = 0; i < bodies.size(); i++) {
+                if((coordinate[i] < split) == lowerHalf) continue;
+
+                packBody(bodies, i, outgoing[partner]);
+                keep[i] = 0;
+            }
+            compact(bodies);
+
+            if(!sockets.exchange(group, outgoing, incoming)) return false;
+            for(int peer : group) unpackBodies(bodies, incoming[peer]);
+
+            if(lowerHalf) {
+                end = middle;
+                upper[axis] = split;
+            }
+            else {
+                begin = middle;
+                lower[axis] = split;
+            }
+        }
+
+        forceSeconds = 0.0;
+        stepsSinceBalance = 0;
+        rebalances++;
+        return true;
+    }
+
+    bool computeForces(bodyStore &bodies) {
+        PROFILE_SCOPE("distributed forces");
+        double start = cpuSeconds();
+        const size_t count = bodies.size();
+
+        std::vector<rankSockets::message> boxes;
+        if(!gatherBounds(bodies, boxes)) return false;
+
+        bool essential = physicsEngine::solver == forceSolver::barnesHut;
+        if(essential) exporter.build(bodies.x.data(), bodies.y.data(), bodies.z.data(), bodies.mass.data(), count);
+
+        std::vector<rankSockets::message> outgoing(sockets.getSize()), incoming;
+        for(int peer : everyone) {
+            const float *box = (const float*)boxes[peer].data();
+            if(box[0] > box[3]) continue;
+
+            rankSockets::message &target = outgoing[peer];
+            auto body = [&](uint32_t i) {
+                append(target, bodies.x[i]);
+                append(target, bodies.y[i]);
+                append(target, bodies.z[i]);
+                append(target, bodies.mass[i]);
+            };
+
+            if(!essential) {
+                for(uint32_t i = 0; i < count; i++) body(i);
+                continue;
+            }
+
+            exporter.forEachEssential(box, box + 3, physicsEngine::theta, [&](float x, float y, float z, float mass) {
+                append(target, x);
+                append(target, y);
+                append(target, z);
+                append(target, mass);
+            }, body);
+        }
+
+        if(!sockets.exchange(everyone, outgoing, incoming)) return false;
+
+        // own bodies first, they are the targets
+        sourceX.assign(bodies.x.begin(), bodies.x.end());
+        sourceY.assign(bodies.y.begin(), bodies.y.end());
+        sourceZ.assign(bodies.z.begin(), bodies.z.end());
+        sourceM.assign(bodies.mass.begin(), bodies.mass.end());
+        for(int peer : everyone) {
+            size_t offset = 0;
+            while(offset + 4 * sizeof(float) <= incoming[peer].size()) {
+                sourceX.push_back(read<float>(incoming[peer], offset));
+                sourceY.push_back(read<float>(incoming[peer], offset));
+                sourceZ.push_back(read<float>(incoming[peer], offset));
+                sourceM.push_back(read<float>(incoming[peer], offset));
+            }
+        }
+        importedSources += sourceX.size() - count;
+
+        physicsEngine::computeTargetAccelerations(sourceX.data(), sourceY.data(), sourceZ.data(), sourceM.data(), sourceX.size(), count,
+                                                  bodies.ax.data(), bodies.ay.data(), bodies.az.data());
+        physicsEngine::forceEvaluations += count;
+
+        double seconds = cpuSeconds() - start;
+        forceSeconds += seconds;
+        totalForceSeconds += seconds;
+        return true;
+    }
+
+    // Rebalances once the slowest rank's force time since the last balance exceeds the mean by the threshold.
+    bool checkBalance() {
+        rankSockets::message mine;
+        append(mine, forceSeconds);
+
+        std::vector<rankSockets::message> all;
+        if(!sockets.allGather(everyone, mine, all)) return false;
+
+        double slowest = 0.0, sum = 0.0;
+        for(const rankSockets::message &cost : all) {
+            size_t offset = 0;
+            double seconds = read<double>(cost, offset);
+            slowest = std::max(slowest, seconds);
+            sum += seconds;
+        }
+        imbalance = sum > 0.0 ? slowest * sockets.getSize() / sum : 1.0;
+        if(imbalance <= REBALANCE_THRESHOLD || slowest - sum / sockets.getSize() < REBALANCE_MIN_SECONDS) {
+            forceSeconds = 0.0;
+            stepsSinceBalance = 0;
+            return true;
+        }
+
+        bodyStore &bodies = physicsEngine::getBodies();
+        float weight = bodies.empty() ? 1.0f : (float)(forceSeconds / bodies.size());
+        weights.assign(bodies.size(), weight);
+        return balance();
+    }
+public:
+    long rebalanceEvery = 20;      // steps between balance checks, 0 keeps the first split
+    long rebalances = 0;
+    double imbalance = 1.0;        // slowest rank's force time over the mean, at the last check
+    uint64_t importedSources = 0;  // remote bodies and summaries received, over all force evaluations
+
+    // Forks rankCount - 1 copies of this process and returns the rank the caller became, -1 on failure.
+    // Flush buffered output first or the children print it again.
+    static int launch(int rankCount, std::vector<pid_t> &children) {
+        for(int rank = 1; rank < rankCount; rank++) {
+            pid_t child = ::fork();
+            if(child < 0) {
+                std::cout << "Could not start rank " << rank << ": " << std::strerror(errno) << '\n';
+                return -1;
+            }
+            if(child == 0) {
+                children.clear();
+                return rank;
+            }
+            children.push_back(child);
+        }
+        return 0;
+    }
+
+    // Waits for launched ranks, false if any of them failed.
+    static bool wait(const std::vector<pid_t> &children) {
+        bool succeeded = true;
+        for(pid_t child : children) {
+            int status = 0;
+            if(::waitpid(child, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) succeeded = false;
+        }
+        return succeeded;
+    }
+
+    int getRank() const { return sockets.getRank(); }
+    int getSize() const { return sockets.getSize(); }
+
+    bool connect(const std::string &prefix, int rank, int rankCount) {
+        if(!sockets.connect(prefix, rank, rankCount)) return false;
+
+        everyone = peersIn(0, rankCount);
+        return true;
+    }
+
+    // Collective. Checks every rank runs the same settings and step count, numbers the bodies loaded on
+    // each rank (normally all on rank 0) and splits them by count.
+    bool distribute(uint64_t steps) {
+        bodyStore &bodies = physicsEngine::getBodies();
+
+        rankSockets::message mine;
+        append(mine, (uint64_t)bodies.size());
+        append(mine, steps);
+        append(mine, physicsEngine::solver);
+        append(mine, physicsEngine::integration);
+        append(mine, physicsEngine::law);
+        append(mine, physicsEngine::precision);
+        append(mine, physicsEngine::theta);
+        append(mine, physicsEngine::fixedDeltaTime);
+        append(mine, rebalanceEvery);
+
+        std::vector<rankSockets::message> all;
+        if(!sockets.allGather(everyone, mine, all)) return false;
+
+        for(int rank = 0; rank < sockets.getSize(); rank++) {
+            if(all[rank].size() == mine.size() && std::equal(all[rank].begin() + sizeof(uint64_t), all[rank].end(), all[0].begin() + sizeof(uint64_t))) continue;
+
+            if(sockets.getRank() == 0) std::cout << "Could not start, rank " << rank << " was given different settings than rank 0" << '\n';
+            return false;
+        }
+
+        uint64_t first = 0;
+        for(int rank = 0; rank < sockets.getRank(); rank++) {
+            size_t offset = 0;
+            first += read<uint64_t>(all[rank], offset);
+        }
+
+        ids.resize(bodies.size());
+        for(size_t i = 0; i < bodies.size(); i++) ids[i] = first + i;
+        weights.assign(bodies.size(), 1.0f);
+
+        accelerationsValid = false;
+        if(!balance()) return false;
+        rebalances = 0;
+        return true;
+    }
+
+    // Collective. One step of the selected integrator over the local bodies; the block scheme and
+    // collisions need a global view and are not supported.
+    bool step(float deltaTime) {
+        PROFILE_SCOPE("distributed step");
+        bodyStore &bodies = physicsEngine::getBodies();
+
+        auto forces = [&](bodyStore &store) { if(!failed && !computeForces(store)) failed = true; };
+        auto forcesFor = [](bodyStore &, const std::vector<uint32_t> &) {};
+        if(physicsEngine::precision == precisionMode::doublePrecision) {
+            stepper.step<double>(physicsEngine::integration, bodies, deltaTime, accelerationsValid, forces, forcesFor);
+        }
+        else {
+            stepper.step(physicsEngine::integration, bodies, deltaTime, accelerationsValid, forces, forcesFor);
+        }
+        if(failed) return false;
+
+        physicsEngine::stepCount++;
+        physicsEngine::simulationTime += deltaTime;
+
+        if(rebalanceEvery > 0 && ++stepsSinceBalance >= rebalanceEvery) return checkBalance();
+        return true;
+    }
+
+    // Collective. Gathers every body on rank 0 in its original order, and the per-rank body counts
+    // and total force times; other ranks get empty results.
+    bool gather(bodyStore &all, std::vector<uint64_t> &counts, std::vector<double> &seconds) {
+        bodyStore &bodies = physicsEngine::getBodies();
+        const int rank = sockets.getRank();
+
+        std::vector<rankSockets::message> outgoing(sockets.getSize()), incoming;
+        std::vector<int> peers = rank == 0 ? everyone : std::vector<int>{0};
+
+        rankSockets::message mine;
+        append(mine, (uint64_t)bodies.size());
+        append(mine, totalForceSeconds);
+        for(size_t i = 0; i < bodies.size(); i++) packBody(bodies, i, mine);
+        if(rank != 0) outgoing[0] = std::move(mine);
+
+        if(!sockets.exchange(peers, outgoing, incoming)) return false;
+
+        all.clear();
+        counts.clear();
+        seconds.clear();
+        if(rank != 0) return true;
+        incoming[0] = std::move(mine);
+
+        uint64_t total = 0;
+        for(const rankSockets::message &message : incoming) {
+            size_t offset = 0;
+            total += read<uint64_t>(message, offset);
+        }
+        all.resize(total);
+
+        // the id sits after the fields, so peek at it before reading them straight into place
+        const size_t fieldBytes = recordBytes(all) - sizeof(uint32_t) - sizeof(float);
+        for(const rankSockets::message &message : incoming) {
+            size_t offset = 0;
+            uint64_t count = read<uint64_t>(message, offset);
+            counts.push_back(count);
+            seconds.push_back(read<double>(message, offset));
+
+            for(uint64_t k = 0; k < count; k++) {
+                size_t idOffset = offset + fieldBytes;
+                uint32_t id = read<uint32_t>(message, idOffset);
+                if(id >= total) {
+                    std::cout << "Could not gather bodies, id " << id << " is out of range" << '\n';
+                    return false;
+                }
+
+                all.forEachArray([&](auto &array) { array[id] = read<std::decay_t<decltype(array[0])>>(message, offset); });
+                offset += sizeof(uint32_t) + sizeof(float);
+            }
+        }
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,175 @@
+#ifndef FFT_H
+#define FFT_H
+#define _USE_MATH_DEFINES
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+
+// In-place iterative radix-2 FFT over power-of-two sizes, with row/column passes for 2D and 3D grids
+// stored x-fastest. Inverse transforms are scaled by 1/n so forward followed by inverse is the identity.
+class fft {
+public:
+    using complex = std::complex<float>;
+
+    static bool isPowerOfTwo(size_t n) {
+        return n > 0 && (n & (n - 1)) == 0;
+    }
+
+    static size_t nextPowerOfTwo(size_t n) {
+        size_t power = 1;
+        while(power < n) power <<= 1;
+        return power;
+    }
+
+    static void transform(complex *data, size_t n, bool inverse) {
+        for(size_t i = 1, j = 0; i < n; i++) {
+            size_t bit = n >> 1;
+            for(; j & bit; bit >>= 1) j ^= bit;
+            j ^= bit;
+
+            if(i < j) std::swap(data[i], data[j]);
+        }
+
+        // twiddles for stage `length` sit contiguously at [length / 2 - 1, length - 1)
+        const complex *twiddles = twiddleTable(n, inverse).data();
+        for(size_t length = 2; length <= n; length <<= 1) {
+            const size_t half = length >> 1;
+            const complex *stage = twiddles + half - 1;
+
+            for(size_t start = 0; start < n; start += length) {
+                complex *low = data + start;
+                complex *high = low + half;
+
+                for(size_t k = 0; k < half; k++) {
+                    // written out by hand: operator* on std::complex goes through the Annex G NaN checks
+                    const float wr = stage[k].real(), wi = stage[k].imag();
+                    const float br = high[k].real(), bi = high[k].imag();
+                    const complex odd(br * wr - bi * wi, br * wi + bi * wr);
+
+                    high[k] = low[k] - odd;
+                    low[k] += odd;
+                }
+            }
+        }
+
+        if(inverse) {
+            float scale = 1.0f / n;
+            for(size_t i = 0; i < n; i++) data[i] *= scale;
+        }
+    }
+
+    static void transform2D(std::vector<complex> &data, size_t nx, size_t ny, bool inverse) {
+        for(size_t y = 0; y < ny; y++) {
+            transform(&data[y * nx], nx, inverse);
+        }
+
+        transformStrided(data.data(), ny, nx, nx, inverse);
+    }
+
+    // Two real sequences through one complex transform. Forward: `a` and `b` hold real signals in their
+    // real parts and come back as full spectra. Inverse: only bins [0, n / 2] of the two Hermitian
+    // spectra are read, and the real signals come back in the real parts.
+    static void transformRealPair(complex *a, complex *b, size_t n, bool inverse) {
+        if(!inverse) {
+            for(size_t k = 0; k < n; k++) a[k] = complex(a[k].real(), b[k].real());
+            transform(a, n, false);
+
+            for(size_t k = 0; k <= n / 2; k++) {
+                complex z = a[k];
+                complex mirror = std::conj(a[(n - k) % n]);
+
+                complex spectrumA = 0.5f * (z + mirror);
+                complex spectrumB = complex(0.0f, -0.5f) * (z - mirror);
+
+                a[k] = spectrumA;
+                b[k] = spectrumB;
+                a[(n - k) % n] = std::conj(spectrumA);
+                b[(n - k) % n] = std::conj(spectrumB);
+            }
+            return;
+        }
+
+        for(size_t k = 0; k <= n / 2; k++) {
+            complex spectrumA = a[k], spectrumB = b[k];
+            a[k] = complex(spectrumA.real() - spectrumB.imag(), spectrumA.imag() + spectrumB.real());
+
+            if(k > 0 && k < n - k) {
+                a[n - k] = complex(spectrumA.real() + spectrumB.imag(), -spectrumA.imag() + spectrumB.real());
+            }
+        }
+        transform(a, n, true);
+
+        for(size_t k = 0; k < n; k++) {
+            b[k] = complex(a[k].imag(), 0.0f);
+            a[k] = complex(a[k].real(), 0.0f);
+        }
+    }
+
+    // Transforms `count` interleaved sequences at once: element k of sequence x lives at data[k * stride + x].
+    // Butterflies run across whole rows, which keeps column passes contiguous in memory.
+    static void transformStrided(complex *data, size_t n, size_t count, size_t stride, bool inverse) {
+        for(size_t i = 1, j = 0; i < n; i++) {
+            size_t bit = n >> 1;
+            for(; j & bit; bit >>= 1) j ^= bit;
+            j ^= bit;
+
+            if(i < j) std::swap_ranges(data + i * stride, data + i * stride + count, data + j * stride);
+        }
+
+        const complex *twiddles = twiddleTable(n, inverse).data();
+        for(size_t length = 2; length <= n; length <<= 1) {
+            const size_t half = length >> 1;
+            const complex *stage = twiddles + half - 1;
+
+            for(size_t start = 0; start < n; start += length) {
+                for(size_t k = 0; k < half; k++) {
+                    const float wr = stage[k].real(), wi = stage[k].imag();
+                    complex *low = data + (start + k) * stride;
+                    complex *high = low + half * stride;
+
+                    for(size_t x = 0; x < count; x++) {
+                        const float br = high[x].real(), bi = high[x].imag();
+                        const complex odd(br * wr - bi * wi, br * wi + bi * wr);
+
+                        high[x] = low[x] - odd;
+                        low[x] += odd;
+                    }
+                }
+            }
+        }
+
+        if(inverse) {
+            float scale = 1.0f / n;
+            for(size_t k = 0; k < n; k++) {
+                for(size_t x = 0; x < count; x++) data[k * stride + x] *= scale;
+            }
+        }
+    }
+
+private:
+    // exp(-+2 pi i k / length) for every stage length up to n, built once per size, direction and thread
+    static const std::vector<complex>& twiddleTable(size_t n, bool inverse) {
+        thread_local std::vector<std::vector<complex>> tables(128);
+
+        size_t level = 0;
+        while(((size_t)1 << level) < n) level++;
+
+        std::vector<complex> &table = tables[2 * level + (inverse ? 1 : 0)];
+        if(table.size() != n - 1 && n > 1) {
+            table.resize(n - 1);
+            double sign = inverse ? 2.0 : -2.0;
+
+            for(size_t length = 2; length <= n; length <<= 1) {
+                for(size_t k = 0; k < length / 2; k++) {
+                    double angle = sign * M_PI * k / length;
+                    table[length / 2 - 1 + k] = complex(std::cos(angle), std::sin(angle));
+                }
+            }
+        }
+        return table;
+    }
+};
+
+#endif
@@ -0,0 +1,512 @@
+#ifndef FMM_H
+#define FMM_H
+#include <vector>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include "kernels.h"
+#include "thread_pool.h"
+#include "profiler.h"
+
+// Fast multipole method with Cartesian Taylor expansions of 1/r up to a runtime order p.
+//
+// Every cell of an adaptive octree carries multipole moments Q_a = sum m (-d)^a about its center of
+// mass (P2M, then M2M up the tree). Target cells walk the source tree: a source cell that is well
+// separated, (r_target + r_source) < theta * distance, is turned into a local expansion
+// L_b = sum_a Q_a C(a + b, a) T_(a+b)(R), where T_k are the Taylor coefficients of 1/|R| (M2L).
+// Locals are shifted down the tree (L2L) and differentiated at the bodies (L2P); neighbouring leaves
+// interact directly through the same SIMD kernel as the direct solver (P2P).
+//
+// With that acceptance test every M2L term is bounded by theta^(p+1) / (1 - theta) of the monopole
+// force it approximates, so orderFor() picks the p that reaches a relative tolerance.
+class fastMultipole {
+public:
+    static constexpr int MAX_ORDER = 10;
+private:
+    struct node {
+        float centerX, centerY, centerZ;
+        float halfSize;
+
+        double expansionX, expansionY, expansionZ;
+        double radius;
+        double mass;
+
+        uint32_t parent;
+        uint32_t firstChild;
+        uint32_t childCount;
+
+        uint32_t begin;
+        uint32_t count;
+    };
+
+    // one term of a translation: out[target] += in[source] * monomial[power] * weight
+    struct product {
+        uint32_t source;
+        uint32_t power;
+        double weight;
+    };
+
+    static constexpr uint32_t LEAF_SIZE = 64;
+    static constexpr int MAX_DEPTH = 32;
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    int order = -1;
+    size_t termCount = 0;
+
+    std::vector<int> exponents;
+    std::vector<int> lookup;
+    std::vector<int> minus;
+    // translation tables, the terms feeding output t are [offsets[t], offsets[t + 1])
+    struct table {
+        std::vector<product> products;
+        std::vector<uint32_t> offsets;
+    };
+    table m2l, m2m, l2l;
+
+    std::vector<node> nodes;
+    std::vector<uint32_t> indices;
+    std::vector<uint32_t> scratch;
+    std::vector<double> multipoles, locals;
+
+    // bodies in tree order, so leaves are contiguous ranges for the direct kernel
+    std::vector<float> sortedX, sortedY, sortedZ, sortedM;
+    std::vector<float> sortedAX, sortedAY, sortedAZ;
+
+    const float gravity;
+
+    static double binomial(int n, int k) {
+        double result = 1.0;
+        for(int i = 1; i <= k; i++) result = result * (n - k + i) / i;
+        return result;
+    }
+
+    int termIndex(int i, int j, int k) const {
+        if(i < 0 || j < 0 || k < 0 || i + j + k > order) return -1;
+        return lookup[(i * (order + 1) + j) * (order + 1) + k];
+    }
+
+    void buildTables() {
+        exponents.clear();
+        lookup.assign((order + 1) * (order + 1) * (order + 1), -1);
+
+        for(int degree = 0; degree <= order; degree++) {
+            for(int i = degree; i >= 0; i--) {
+                for(int j = degree - i; j >= 0; j--) {
+                    int k = degree - i - j;
+                    lookup[(i * (order + 1) + j) * (order + 1) + k] = exponents.size() / 3;
+                    exponents.insert(exponents.end(), {i, j, k});
+                }
+            }
+        }
+        termCount = exponents.size() / 3;
+
+        minus.assign(6 * termCount, -1);
+        for(size_t t = 0; t < termCount; t++) {
+            const int *e = &exponents[3 * t];
+            minus[6 * t + 0] = termIndex(e[0] - 1, e[1], e[2]);
+            minus[6 * t + 1] = termIndex(e[0], e[1] - 1, e[2]);
+            minus[6 * t + 2] = termIndex(e[0], e[1], e[2] - 1);
+            minus[6 * t + 3] = termIndex(e[0] - 2, e[1], e[2]);
+            minus[6 * t + 4] = termIndex(e[0], e[1] - 2, e[2]);
+            minus[6 * t + 5] = termIndex(e[0], e[1], e[2] - 2);
+        }
+
+        m2l = {}; m2m = {}; l2l = {};
+
+        for(size_t out = 0; out < termCount; out++) {
+            const int *eo = &exponents[3 * out];
+            m2l.offsets.push_back(m2l.products.size());
+            m2m.offsets.push_back(m2m.products.size());
+            l2l.offsets.push_back(l2l.products.size());
+
+            for(size_t in = 0; in < termCount; in++) {
+                const int *ei = &exponents[3 * in];
+
+                // M2L: L_out += Q_in * C(in + out, in) * T_(in+out)
+                int sum = termIndex(ei[0] + eo[0], ei[1] + eo[1], ei[2] + eo[2]);
+                if(sum >= 0) {
+                    double weight = binomial(ei[0] + eo[0], ei[0]) * binomial(ei[1] + eo[1], ei[1]) * binomial(ei[2] + eo[2], ei[2]);
+                    m2l.products.push_back({(uint32_t)in, (uint32_t)sum, weight});
+                }
+
+                // M2M: Q_out += Q_in * C(out, in) * s^(out-in)
+                int below = termIndex(eo[0] - ei[0], eo[1] - ei[1], eo[2] - ei[2]);
+                if(below >= 0) {
+                    double weight = binomial(eo[0], ei[0]) * binomial(eo[1], ei[1]) * binomial(eo[2], ei[2]);
+                    m2m.products.push_back({(uint32_t)in, (uint32_t)below, weight});
+                }
+
+                // L2L: L_out += L_in * C(in, out) * s^(in-out)
+                int above = termIndex(ei[0] - eo[0], ei[1] - eo[1], ei[2] - eo[2]);
+                if(above >= 0) {
+                    double weight = binomial(ei[0], eo[0]) * binomial(ei[1], eo[1]) * binomial(ei[2], eo[2]);
+                    l2l.products.push_back({(uint32_t)in, (uint32_t)above, weight});
+                }
+            }
+        }
+        m2l.offsets.push_back(m2l.products.size());
+        m2m.offsets.push_back(m2m.products.size());
+        l2l.offsets.push_back(l2l.products.size());
+    }
+
+    // s^k for every term k
+    void monomials(double sx, double sy, double sz, double *out) const {
+        out[0] = 1.0;
+        for(size_t t = 1; t < termCount; t++) {
+            const int *e = &exponents[3 * t];
+            if(e[0] > 0) out[t] = out[minus[6 * t]] * sx;
+            else if(e[1] > 0) out[t] = out[minus[6 * t + 1]] * sy;
+            else out[t] = out[minus[6 * t + 2]] * sz;
+        }
+    }
+
+    // Taylor coefficients of 1/|R + e| in e, from the recurrence
+    // n |R|^2 T_k = -(2n - 1) sum_i R_i T_(k-e_i) - (n - 1) sum_i T_(k-2e_i)
+    void taylorCoefficients(double rx, double ry, double rz, double *out) const {
+        double r2 = rx * rx + ry * ry + rz * rz;
+        double inverseR2 = 1.0 / r2;
+        double r[3] = {rx, ry, rz};
+
+        out[0] = std::sqrt(inverseR2);
+        for(size_t t = 1; t < termCount; t++) {
+            const int *e = &exponents[3 * t];
+            int n = e[0] + e[1] + e[2];
+
+            double first = 0.0, second = 0.0;
+            for(int axis = 0; axis < 3; axis++) {
+                int once = minus[6 * t + axis];
+                int twice = minus[6 * t + 3 + axis];
+
+                if(once >= 0) first += r[axis] * out[once];
+                if(twice >= 0) second += out[twice];
+            }
+            out[t] = (-(2 * n - 1) * first - (n - 1) * second) * inverseR2 / n;
+        }
+    }
+
+    static void translate(const table &terms, const double *in, const double *powers, double *out, size_t count) {
+        const product *products = terms.products.data();
+
+        for(size_t t = 0; t < count; t++) {
+            double sum = 0.0;
+            for(uint32_t k = terms.offsets[t]; k < terms.offsets[t + 1]; k++) {
+                sum += in[products[k].source] * powers[products[k].power] * products[k].weight;
+            }
+            out[t] += sum;
+        }
+    }
+
+    int octant(const node &parent, uint32_t body, const float *x, const float *y, const float *z) const {
+        return (x[body] >= parent.centerX ? 1 : 0)
+             | (y[body] >= parent.centerY ? 2 : 0)
+             | (z[body] >= parent.centerZ ? 4 : 0);
+    }
+
+    void buildNode(uint32_t index, int depth, const float *x, const float *y, const float *z) {
+        node current = nodes[index];
+        if(current.count <= LEAF_SIZE || depth >= MAX_DEPTH) return;
+
+        uint32_t octantCount[8] = {};
+        for(uint32_t k = current.begin; k < current.begin + current.count; k++) {
+            octantCount[octant(current, indices[k], x, y, z)]++;
+        }
+
+        uint32_t cursor[8];
+        uint32_t offset = current.begin;
+        for(int o = 0; o < 8; o++) {
+            cursor[o] = offset;
+            offset += octantCount[o];
+        }
+
+        uint32_t octantStart[8];
+        std::copy(cursor, cursor + 8, octantStart);
+        for(uint32_t k = current.begin; k < current.begin + current.count; k++) {
+            scratch[cursor[octant(current, indices[k], x, y, z)]++] = indices[k];
+        }
+        std::copy(scratch.begin() + current.begin, scratch.begin() + current.begin + current.count, indices.begin() + current.begin);
+
+        uint32_t firstChild = nodes.size();
+        uint32_t childCount = 0;
+        float childHalf = current.halfSize * 0.5f;
+
+        for(int o = 0; o < 8; o++) {
+            if(octantCount[o] == 0) continue;
+
+            node child{};
+            child.centerX = current.centerX + ((o & 1) ? childHalf : -childHalf);
+            child.centerY = current.centerY + ((o & 2) ? childHalf : -childHalf);
+            child.centerZ = current.centerZ + ((o & 4) ? childHalf : -childHalf);
+            child.halfSize = childHalf;
+            child.parent = index;
+            child.firstChild = NONE;
+            child.begin = octantStart[o];
+            child.count = octantCount[o];
+
+            nodes.push_back(child);
+            childCount++;
+        }
+        nodes[index].firstChild = firstChild;
+        nodes[index].childCount = childCount;
+
+        for(uint32_t c = firstChild; c < firstChild + childCount; c++) {
+            buildNode(c, depth + 1, x, y, z);
+        }
+    }
+
+    // P2M at the leaves and M2M towards the root; children always sit after their parent.
+    void upwardPass() {
+        multipoles.assign(nodes.size() * termCount, 0.0);
+        std::vector<double> powers(termCount);
+
+        for(size_t n = nodes.size(); n-- > 0;) {
+            node &current = nodes[n];
+            double *moments = &multipoles[n * termCount];
+
+            if(current.childCount == 0) {
+                double mass = 0.0, mx = 0.0, my = 0.0, mz = 0.0;
+                for(uint32_t k = current.begin; k < current.begin + current.count; k++) {
+                    mass += sortedM[k];
+                    mx += (double)sortedM[k] * sortedX[k];
+                    my += (double)sortedM[k] * sortedY[k];
+                    mz += (double)sortedM[k] * sortedZ[k];
+                }
+                setExpansionCenter(current, mass, mx, my, mz);
+
+                double radius = 0.0;
+                for(uint32_t k = current.begin; k < current.begin + current.count; k++) {
+                    double dx = sortedX[k] - current.expansionX;
+                    double dy = sortedY[k] - current.expansionY;
+                    double dz = sortedZ[k] - current.expansionZ;
+                    radius = std::max(radius, dx * dx + dy * dy + dz * dz);
+
+                    monomials(-dx, -dy, -dz, powers.data());
+                    for(size_t t = 0; t < termCount; t++) moments[t] += sortedM[k] * powers[t];
+                }
+                current.radius = std::sqrt(radius);
+                continue;
+            }
+
+            double mass = 0.0, mx = 0.0, my = 0.0, mz = 0.0;
+            for(uint32_t c = current.firstChild; c < current.firstChild + current.childCount; c++) {
+                mass += nodes[c].mass;
+                mx += nodes[c].mass * nodes[c].expansionX;
+                my += nodes[c].mass * nodes[c].expansionY;
+                mz += nodes[c].mass * nodes[c].expansionZ;
+            }
+            setExpansionCenter(current, mass, mx, my, mz);
+
+            double radius = 0.0;
+            for(uint32_t c = current.firstChild; c < current.firstChild + current.childCount; c++) {
+                double sx = nodes[c].expansionX - current.expansionX;
+                double sy = nodes[c].expansionY - current.expansionY;
+                double sz = nodes[c].expansionZ - current.expansionZ;
+                radius = std::max(radius, std::sqrt(sx * sx + sy * sy + sz * sz) + nodes[c].radius);
+
+                monomials(-sx, -sy, -sz, powers.data());
+                translate(m2m, &multipoles[c * termCount], powers.data(), moments, termCount);
+            }
+            current.radius = radius;
+        }
+    }
+
+    void setExpansionCenter(node &target, double mass, double mx, double my, double mz) {
+        target.mass = mass;
+
+        if(mass > 0.0) {
+            target.expansionX = mx / mass;
+            target.expansionY = my / mass;
+            target.expansionZ = mz / mass;
+        }
+        else {
+            target.expansionX = target.centerX;
+            target.expansionY = target.centerY;
+            target.expansionZ = target.centerZ;
+        }
+    }
+
+    // Everything the source subtree does to the target subtree; writes only to the target side.
+    template<typename Law>
+    void interact(const Law &law, uint32_t target, uint32_t source, float theta, simdLevel simd, std::vector<double> &coefficients) {
+        const node &t = nodes[target];
+        const node &s = nodes[source];
+
+        double dx = t.expansionX - s.expansionX;
+        double dy = t.expansionY - s.expansionY;
+        double dz = t.expansionZ - s.expansionZ;
+        double distance = std::sqrt(dx * dx + dy * dy + dz * dz);
+
+        if(target != source && t.radius + s.radius < theta * distance) {
+            taylorCoefficients(dx, dy, dz, coefficients.data());
+
+            translate(m2l, &multipoles[source * termCount], coefficients.data(), &locals[target * termCount], termCount);
+            return;
+        }
+
+        if(t.childCount == 0 && s.childCount == 0) {
+            directKernel::accumulate(simd, law, sortedX.data(), sortedY.data(), sortedZ.data(), sortedM.data(),
+                                     t.begin, t.begin + t.count, s.begin, s.begin + s.count,
+                                     sortedAX.data(), sortedAY.data(), sortedAZ.data());
+            return;
+        }
+
+        if(s.childCount == 0 || (t.childCount > 0 && t.radius > s.radius)) {
+            for(uint32_t c = t.firstChild; c < t.firstChild + t.childCount; c++) {
+                interact(law, c, source, theta, simd, coefficients);
+            }
+            return;
+        }
+
+        for(uint32_t c = s.firstChild; c < s.firstChild + s.childCount; c++) {
+            interact(law, target, c, theta, simd, coefficients);
+        }
+    }
+
+    // L2L into the children, L2P at the leaves.
+    void downwardPass(uint32_t index, std::vector<double> &powers) {
+        const node &current = nodes[index];
+        const double *local = &locals[index * termCount];
+
+        if(current.childCount == 0) {
+            for(uint32_t k = current.begin; k < current.begin + current.count; k++) {
+                monomials(sortedX[k] - current.expansionX, sortedY[k] - current.expansionY, sortedZ[k] - current.expansionZ, powers.data());
+
+                double gradient[3] = {0.0, 0.0, 0.0};
+                for(size_t t = 1; t < termCount; t++) {
+                    for(int axis = 0; axis < 3; axis++) {
+                        int lower = minus[6 * t + axis];
+                        if(lower >= 0) gradient[axis] += exponents[3 * t + axis] * powers[lower] * local[t];
+                    }
+                }
+
+                sortedAX[k] += gravity * gradient[0];
+                sortedAY[k] += gravity * gradient[1];
+                sortedAZ[k] += gravity * gradient[2];
+            }
+            return;
+        }
+
+        for(uint32_t c = current.firstChild; c < current.firstChild + current.childCount; c++) {
+            monomials(nodes[c].expansionX - current.expansionX, nodes[c].expansionY - current.expansionY, nodes[c].expansionZ - current.expansionZ, powers.data());
+            translate(l2l, local, powers.data(), &locals[c * termCount], termCount);
+
+            downwardPass(c, powers);
+        }
+    }
+
+    template<typename Function>
+    static void forEachTask(threadPool *workers, size_t tasks, Function function) {
+        if(!workers) {
+            for(size_t task = 0; task < tasks; task++) function(task);
+            return;
+        }
+        workers->parallelFor(tasks, [&](size_t task, unsigned) { function(task); });
+    }
+public:
+    explicit fastMultipole(float gravity) : gravity(gravity) {}
+
+    // Lowest order whose per-interaction bound theta^(p+1) / (1 - theta) is below the tolerance.
+    static int orderFor(float tolerance, float theta) {
+        if(theta >= 1.0f) return MAX_ORDER;
+
+        int p = 1;
+        while(p < MAX_ORDER && std::pow(theta, p + 1) / (1.0f - theta) > tolerance) p++;
+        return p;
+    }
+
+    void setOrder(int p) {
+        p = std::min(std::max(p, 1), MAX_ORDER);
+        if(p == order) return;
+
+        order = p;
+        buildTables();
+    }
+
+    int getOrder() const { return order; }
+
+    void build(const float *x, const float *y, const float *z, const float *m, size_t count) {
+        PROFILE_SCOPE("fmm build");
+        if(order < 0) setOrder(4);
+
+        nodes.clear();
+        indices.resize(count);
+        scratch.resize(count);
+        if(count == 0) return;
+
+        float minX = x[0], minY = y[0], minZ = z[0];
+        float maxX = x[0], maxY = y[0], maxZ = z[0];
+        for(size_t i = 0; i < count; i++) {
+            indices[i] = i;
+
+            minX = std::min(minX, x[i]); maxX = std::max(maxX, x[i]);
+            minY = std::min(minY, y[i]); maxY = std::max(maxY, y[i]);
+            minZ = std::min(minZ, z[i]); maxZ = std::max(maxZ, z[i]);
+        }
+
+        node root{};
+        root.centerX = 0.5f * (minX + maxX);
+        root.centerY = 0.5f * (minY + maxY);
+        root.centerZ = 0.5f * (minZ + maxZ);
+        root.halfSize = 0.5f * std::max({maxX - minX, maxY - minY, maxZ - minZ}) * 1.001f + 1e-3f;
+        root.parent = NONE;
+        root.firstChild = NONE;
+        root.begin = 0;
+        root.count = count;
+
+        nodes.reserve(2 * count / LEAF_SIZE + 8);
+        nodes.push_back(root);
+        buildNode(0, 0, x, y, z);
+
+        sortedX.resize(count); sortedY.resize(count); sortedZ.resize(count); sortedM.resize(count);
+        for(size_t k = 0; k < count; k++) {
+            uint32_t body = indices[k];
+            sortedX[k] = x[body]; sortedY[k] = y[body]; sortedZ[k] = z[body]; sortedM[k] = m[body];
+        }
+
+        upwardPass();
+    }
+
+    // Splits the tree into independent target subtrees, walks the source tree from each and
+    // scatters the result back to body order. The law only shapes the near field; well separated
+    // cells interact through the Newtonian expansions.
+    template<typename Law>
+    void computeAccelerations(const Law &law, float theta, simdLevel simd, threadPool *workers, float *ax, float *ay, float *az) {
+        PROFILE_SCOPE("fmm evaluate");
+        size_t count = indices.size();
+        if(nodes.empty()) return;
+
+        locals.assign(nodes.size() * termCount, 0.0);
+        sortedAX.assign(count, 0.0f);
+        sortedAY.assign(count, 0.0f);
+        sortedAZ.assign(count, 0.0f);
+
+        std::vector<uint32_t> tasks = {0};
+        size_t wanted = workers ? 8 * (size_t)workers->size() : 1;
+        while(tasks.size() < wanted) {
+            std::vector<uint32_t> next;
+            for(uint32_t n : tasks) {
+                if(nodes[n].childCount == 0) next.push_back(n);
+                for(uint32_t c = nodes[n].firstChild; c < nodes[n].firstChild + nodes[n].childCount; c++) next.push_back(c);
+            }
+            if(next.size() == tasks.size()) break;
+            tasks.swap(next);
+        }
+
+        forEachTask(workers, tasks.size(), [&](size_t task) {
+            std::vector<double> coefficients(termCount);
+            interact(law, tasks[task], 0, theta, simd, coefficients);
+            downwardPass(tasks[task], coefficients);
+        });
+
+        for(size_t k = 0; k < count; k++) {
+            ax[indices[k]] = sortedAX[k];
+            ay[indices[k]] = sortedAY[k];
+            az[indices[k]] = sortedAZ[k];
+        }
+    }
+
+    size_t nodeCount() const { return nodes.size(); }
+    size_t expansionTerms() const { return termCount; }
+};
+
+#endif
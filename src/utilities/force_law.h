@@ -0,0 +1,202 @@
+#ifndef FORCE_LAW_H
+#define FORCE_LAW_H
+#include <cmath>
+#include <string>
+
+enum class forceLaw {
+    softened,
+    plummer,
+    spline,
+    cutoff
+};
+
+enum class precisionMode {
+    singlePrecision,
+    doublePrecision
+};
+
+struct forceParameters {
+    float gravity;
+    float eps;
+    float minDistance;
+    float cutoff;
+};
+
+// Force-law policies. Each is a small value type templated on the precision the kernels compute and
+// sum in (in double, the direct and tree kernels add the position residuals to separations), with the
+// pull factor of one source:
+// a += d * law(r2, m). The kernels take the law as a template parameter, so every law/precision
+// combination compiles to its own fully inlined loop and the choice is made once per force call.
+// potential() gives the matching pair potential per unit mass product, in double, for diagnostics.
+
+// The original law: a = G m d / (|d| (|d|^2 + eps^2)), pairs with |d|^2 + eps^2 < minDistance skipped.
+template<typename Real>
+class softenedLaw {
+private:
+    Real gravity, eps2, minDistance;
+public:
+    using real = Real;
+
+    explicit softenedLaw(const forceParameters &p) : gravity(p.gravity), eps2((Real)p.eps * (Real)p.eps), minDistance(p.minDistance) {}
+
+    Real operator()(Real r2, Real mass) const {
+        Real distance = r2 + eps2;
+        if(distance < minDistance) return Real(0);
+
+        return gravity * mass / (distance * std::sqrt(r2));
+    }
+
+    // Plummer potential, as the energy diagnostics always used for this law
+    double potential(double r2) const {
+        return -(double)gravity / std::sqrt(r2 + (double)eps2);
+    }
+
+    Real getGravity() const { return gravity; }
+    Real getEps2() const { return eps2; }
+    Real getMinDistance() const { return minDistance; }
+};
+
+// Plummer sphere: a = G m d / (|d|^2 + eps^2)^(3/2), finite everywhere so no pair is skipped.
+template<typename Real>
+class plummerLaw {
+private:
+    Real gravity, eps2;
+public:
+    using real = Real;
+
+    explicit plummerLaw(const forceParameters &p) : gravity(p.gravity), eps2((Real)p.eps * (Real)p.eps) {}
+
+    Real operator()(Real r2, Real mass) const {
+        Real distance = r2 + eps2;
+        return gravity * mass / (distance * std::sqrt(distance));
+    }
+
+    double potential(double r2) const {
+        return -(double)gravity / std::sqrt(r2 + (double)eps2);
+    }
+
+    Real getGravity() const { return gravity; }
+    Real getEps2() const { return eps2; }
+};
+
+// Cubic spline softening (Monaghan & Lattanzio, as in GADGET): exactly Newtonian beyond the kernel
+// length h = 2.8 eps, which makes eps the Plummer-equivalent softening.
+template<typename Real>
+class splineLaw {
+private:
+    Real gravity, h, inverseH, inverseH3;
+public:
+    using real = Real;
+
+    explicit splineLaw(const forceParameters &p)
+        : gravity(p.gravity), h(Real(2.8) * p.eps), inverseH(Real(1) / h), inverseH3(inverseH * inverseH * inverseH) {}
+
+    Real operator()(Real r2, Real mass) const {
+        Real r = std::sqrt(r2);
+        if(r >= h) return gravity * mass / (r2 * r);
+
+        Real u = r * inverseH;
+        Real factor = u < Real(0.5)
+            ? Real(10.666666666667) + u * u * (Real(32.0) * u - Real(38.4))
+            : Real(21.333333333333) - Real(48.0) * u + Real(38.4) * u * u - Real(10.666666666667) * u * u * u - Real(0.066666666667) / (u * u * u);
+        return gravity * mass * inverseH3 * factor;
+    }
+
+    double potential(double r2) const {
+        double r = std::sqrt(r2);
+        if(r >= h) return -(double)gravity / r;
+
+        double u = r * inverseH;
+        double factor = u < 0.5
+            ? -2.8 + u * u * (5.333333333333 + u * u * (6.4 * u - 9.6))
+            : -3.2 + 0.066666666667 / u + u * u * (10.666666666667 + u * (-16.0 + u * (9.6 - 2.133333333333 * u)));
+        return (double)gravity * inverseH * factor;
+    }
+
+    Real getGravity() const { return gravity; }
+    Real getH() const { return h; }
+    Real getInverseH() const { return inverseH; }
+    Real getInverseH3() const { return inverseH3; }
+};
+
+// Plummer-softened force truncated at a cutoff radius, for short-range or locally bound runs.
+template<typename Real>
+class cutoffLaw {
+private:
+    Real gravity, eps2, cutoff2;
+public:
+    using real = Real;
+
+    explicit cutoffLaw(const forceParameters &p) : gravity(p.gravity), eps2((Real)p.eps * (Real)p.eps), cutoff2((Real)p.cutoff * (Real)p.cutoff) {}
+
+    Real operator()(Real r2, Real mass) const {
+        if(r2 >= cutoff2) return Real(0);
+
+        Real distance = r2 + eps2;
+        return gravity * mass / (distance * std::sqrt(distance));
+    }
+
+    // shifted so it is continuous at the cutoff
+    double potential(double r2) const {
+        if(r2 >= (double)cutoff2) return 0.0;
+        return -(double)gravity / std::sqrt(r2 + (double)eps2) + (double)gravity / std::sqrt((double)cutoff2 + (double)eps2);
+    }
+
+    Real getGravity() const { return gravity; }
+    Real getEps2() const { return eps2; }
+    Real getCutoff2() const { return cutoff2; }
+};
+
+class forceLaws {
+private:
+    template<typename Real, typename Function>
+    static void withLaw(forceLaw law, const forceParameters &parameters, Function function) {
+        switch(law) {
+            case forceLaw::plummer:
+                function(plummerLaw<Real>(parameters));
+                break;
+            case forceLaw::spline:
+                function(splineLaw<Real>(parameters));
+                break;
+            case forceLaw::cutoff:
+                function(cutoffLaw<Real>(parameters));
+                break;
+            default:
+                function(softenedLaw<Real>(parameters));
+                break;
+        }
+    }
+public:
+    // Calls function(law) with the policy object of the selected law and precision.
+    template<typename Function>
+    static void dispatch(forceLaw law, precisionMode precision, const forceParameters &parameters, Function function) {
+        if(precision == precisionMode::doublePrecision) withLaw<double>(law, parameters, function);
+        else withLaw<float>(law, parameters, function);
+    }
+
+    static const char* name(forceLaw law) {
+        switch(law) {
+            case forceLaw::plummer: return "plummer";
+            case forceLaw::spline: return "spline";
+            case forceLaw::cutoff: return "cutoff";
+            default: return "softened";
+        }
+    }
+
+    static forceLaw fromName(const std::string &name) {
+        if(name == "plummer") return forceLaw::plummer;
+        if(name == "spline") return forceLaw::spline;
+        if(name == "cutoff") return forceLaw::cutoff;
+        return forceLaw::softened;
+    }
+
+    static const char* name(precisionMode precision) {
+        return precision == precisionMode::doublePrecision ? "double" : "float";
+    }
+
+    static precisionMode precisionFromName(const std::string &name) {
+        return name == "double" ? precisionMode::doublePrecision : precisionMode::singlePrecision;
+    }
+};
+
+#endif
@@ -0,0 +1,149 @@
+#ifndef FRAME_STREAM_H
+#define FRAME_STREAM_H
+#include <iostream>
+#include <string>
+#include <cstdio>
+#include <cstdint>
+#include <glad/glad.h>
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#endif
+
+enum class frameFormat {
+    raw,    // top-down width * height * 3 byte images back to back, rawvideo rgb24 to an encoder
+    ppm     // a binary PPM image per frame
+};
+
+// Streams rendered frames as 8-bit RGB to a file, or into a command when the path starts with '|'.
+//
+// Readback goes through a ring of pixel buffer objects: capture() only queues the copy of the current
+// frame into the next buffer and fences it, and the frame is mapped and written out when its buffer
+// comes around again RING frames later, by when the GPU has long finished it. Rendering never waits
+// on a readback.
+class frameStream {
+public:
+    static constexpr int RING = 3;
+private:
+    int width, height;
+    frameFormat format;
+
+    FILE *output = nullptr;
+    bool pipe = false;
+    bool failed = false;
+
+    GLuint buffers[RING];
+    GLsync fences[RING] = {};
+    uint64_t queued = 0;
+    uint64_t written = 0;
+
+    bool drain(int slot) {
+        GLsync fence = fences[slot];
+        fences[slot] = nullptr;
+
+        GLenum status;
+        do {
+            status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        } while(status == GL_TIMEOUT_EXPIRED);
+        glDeleteSync(fence);
+
+        size_t row = (size_t)width * 3;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, buffers[slot]);
+        const unsigned char *pixels = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, row * height, GL_MAP_READ_BIT);
+
+        bool ok = pixels != nullptr && status != GL_WAIT_FAILED;
+        if(ok && format == frameFormat::ppm) ok = std::fprintf(output, "P6\n%d %d\n255\n", width, height) > 0;
+
+        // GL rows run bottom-up
+        for(int y = height - 1; ok && y >= 0; y--) {
+            ok = std::fwrite(pixels + y * row, 1, row, output) == row;
+        }
+
+        if(pixels) glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        if(!ok) {
+            std::cout << "Could not write frame " << written << '\n';
+            failed = true;
+            return false;
+        }
+        written++;
+        return true;
+    }
+public:
+    frameStream(int width, int height, const std::string &path, frameFormat format) : width(width), height(height), format(format) {
+        if(!path.empty() && path[0] == '|') {
+            output = popen(path.c_str() + 1, "w");
+            pipe = true;
+        }
+        else {
+            output = std::fopen(path.c_str(), "wb");
+        }
+
+        if(!output) {
+            std::cout << "Could not open frame output " << path << '\n';
+            failed = true;
+        }
+
+        glGenBuffers(RING, buffers);
+        for(int slot = 0; slot < RING; slot++) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, buffers[slot]);
+            glBufferData(GL_PIXEL_PACK_BUFFER, (size_t)width * height * 3, nullptr, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    // Queues the readback of the bound read framebuffer, writing out the frame queued RING captures
+    // ago if its buffer is needed again. False once the output has failed.
+    bool capture() {
+        if(failed) return false;
+
+        int slot = queued % RING;
+        if(fences[slot] && !drain(slot)) return false;
+
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, buffers[slot]);
+        glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        queued++;
+        return true;
+    }
+
+    // Writes out every frame still in flight, oldest first.
+    void finish() {
+        for(uint64_t frame = queued < RING ? 0 : queued - RING; frame < queued; frame++) {
+            int slot = frame % RING;
+            if(fences[slot] && !failed) drain(slot);
+        }
+        if(output) std::fflush(output);
+    }
+
+    // False when the output could not be opened or a write to it failed.
+    bool good() const { return !failed; }
+    uint64_t framesWritten() const { return written; }
+
+    static frameFormat fromName(const std::string &name) {
+        return name == "ppm" ? frameFormat::ppm : frameFormat::raw;
+    }
+
+    frameStream(const frameStream&) = delete;
+    frameStream& operator=(const frameStream&) = delete;
+
+    ~frameStream() {
+        finish();
+        for(int slot = 0; slot < RING; slot++) {
+            if(fences[slot]) glDeleteSync(fences[slot]);
+        }
+        glDeleteBuffers(RING, buffers);
+
+        if(output) {
+            if(pipe) pclose(output);
+            else std::fclose(output);
+        }
+    }
+};
+
+#endif
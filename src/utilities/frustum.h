@@ -0,0 +1,39 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+#include <cmath>
+#include <glm/glm.hpp>
+
+// The six clip planes of a view-projection matrix, pointing inwards and normalized so the plane
+// equation gives the signed distance in the space the matrix maps from.
+class frustum {
+private:
+    glm::vec4 planes[6];
+public:
+    frustum(const glm::mat4 &viewProjection) {
+        // rows of the matrix, glm stores it column-major
+        glm::vec4 rows[4];
+        for(int i = 0; i < 4; i++) {
+            rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+        }
+
+        for(int axis = 0; axis < 3; axis++) {
+            planes[2 * axis] = rows[3] + rows[axis];
+            planes[2 * axis + 1] = rows[3] - rows[axis];
+        }
+
+        for(glm::vec4 &plane : planes) {
+            float length = std::sqrt(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z);
+            plane = plane * (1.0f / length);
+        }
+    }
+
+    // False only when the sphere lies entirely outside one of the planes.
+    bool intersectsSphere(float x, float y, float z, float radius) const {
+        for(const glm::vec4 &plane : planes) {
+            if(plane.x * x + plane.y * y + plane.z * z + plane.w < -radius) return false;
+        }
+        return true;
+    }
+};
+
+#endif
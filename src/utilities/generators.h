@@ -0,0 +1,190 @@
+#ifndef GENERATORS_H
+#define GENERATORS_H
+#define _USE_MATH_DEFINES
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <algorithm>
+#include "bodies.h"
+#include "thread_pool.h"
+
+// Stateless random stream: draw k of body i is a hash of (seed, i, k), so every body gets the same
+// values no matter which thread generates it or in what order.
+class counterRandom {
+private:
+    uint64_t key;
+    uint64_t counter = 0;
+
+    static uint64_t mix(uint64_t z) {
+        z += 0x9e3779b97f4a7c15ull;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+public:
+    counterRandom(uint64_t seed, uint64_t index) : key(mix(seed ^ mix(index))) {}
+
+    // uniform in [0, 1)
+    float uniform() {
+        return (mix(key + ++counter * 0x9e3779b97f4a7c15ull) >> 40) * (1.0f / 16777216.0f);
+    }
+
+    // uniform in (0, 1], safe to take the log of
+    float positive() {
+        return 1.0f - uniform();
+    }
+
+    float gaussian() {
+        return std::sqrt(-2.0f * std::log(positive())) * std::cos(2.0f * (float)M_PI * uniform());
+    }
+};
+
+struct generatorSettings {
+    size_t count = 1000;
+    float mass = 1000.0f;        // total mass of the generated bodies
+    float radius = 100.0f;       // plummer scale radius, disk scale length, ring inner radius
+    float outer = 200.0f;        // ring outer radius
+    float thickness = 1.0f;      // disk and ring vertical scale
+    float centralMass = 0.0f;    // point mass the disk and ring orbit, e.g. a star added separately
+    float centerX = 0.0f, centerY = 0.0f, centerZ = 0.0f;
+    float velocityX = 0.0f, velocityY = 0.0f, velocityZ = 0.0f;
+    float density = 0.1f;
+    float colorR = 1.0f, colorG = 1.0f, colorB = 1.0f;
+    bool star = false;           // generated bodies emit light, for star clusters
+    uint64_t seed = 1;
+};
+
+// Initial conditions appended to a body store in bulk. The store is grown once and bodies are
+// filled in parallel tiles; discs and rings lie in the XZ plane and orbit counter-clockwise seen from +Y.
+class generators {
+private:
+    static constexpr size_t TILE = 4096;
+
+    struct state {
+        float x, y, z;
+        float vx, vy, vz;
+    };
+
+    template<typename Generate>
+    static void fill(bodyStore &bodies, const generatorSettings &settings, threadPool *workers, Generate generate) {
+        const size_t first = bodies.size();
+        const size_t count = settings.count;
+        const float bodyMass = settings.mass / std::max<size_t>(count, 1);
+        const float bodyRadius = bodyStore::radiusFor(bodyMass, settings.density);
+
+        bodies.resize(first + count);
+
+        auto tile = [&](size_t index) {
+            size_t end = std::min((index + 1) * TILE, count);
+
+            for(size_t k = index * TILE; k < end; k++) {
+                counterRandom random(settings.seed, k);
+                state body = generate(random);
+
+                size_t i = first + k;
+                bodies.x[i] = bodies.prevX[i] = settings.centerX + body.x;
+                bodies.y[i] = bodies.prevY[i] = settings.centerY + body.y;
+                bodies.z[i] = bodies.prevZ[i] = settings.centerZ + body.z;
+                bodies.vx[i] = settings.velocityX + body.vx;
+                bodies.vy[i] = settings.velocityY + body.vy;
+                bodies.vz[i] = settings.velocityZ + body.vz;
+                bodies.ax[i] = bodies.ay[i] = bodies.az[i] = 0.0f;
+
+                bodies.mass[i] = bodyMass;
+                bodies.radius[i] = bodyRadius;
+                bodies.flags[i] = settings.star ? (uint32_t)BODY_STAR : 0u;
+                bodies.density[i] = settings.density;
+                bodies.colorR[i] = settings.colorR;
+                bodies.colorG[i] = settings.colorG;
+                bodies.colorB[i] = settings.colorB;
+            }
+        };
+
+        size_t tiles = (count + TILE - 1) / TILE;
+        if(!workers || tiles < 2) {
+            for(size_t index = 0; index < tiles; index++) tile(index);
+            return;
+        }
+        workers->parallelFor(tiles, [&](size_t index, unsigned) { tile(index); });
+    }
+
+    static void isotropic(counterRandom &random, float length, float &x, float &y, float &z) {
+        float cosTheta = 2.0f * random.uniform() - 1.0f;
+        float sinTheta = std::sqrt(std::max(0.0f, 1.0f - cosTheta * cosTheta));
+        float phi = 2.0f * (float)M_PI * random.uniform();
+
+        x = length * sinTheta * std::cos(phi);
+        y = length * cosTheta;
+        z = length * sinTheta * std::sin(phi);
+    }
+
+    // Circular orbit in the XZ plane at cylindrical radius r, angle phi and height y.
+    static state orbit(float r, float phi, float y, float speed) {
+        float c = std::cos(phi), s = std::sin(phi);
+        return {r * c, y, r * s, -s * speed, 0.0f, c * speed};
+    }
+public:
+    // Plummer sphere in virial equilibrium (Aarseth, Henon & Wielen 1974), truncated at ~10 scale radii.
+    static void plummer(bodyStore &bodies, const generatorSettings &settings, float gravity, threadPool *workers) {
+        const float a = settings.radius;
+        const float escapeScale = std::sqrt(2.0f * gravity * settings.mass / a);
+
+        fill(bodies, settings, workers, [&](counterRandom &random) {
+            float enclosed = std::min(random.uniform(), 0.999f);
+            float r = a / std::sqrt(std::pow(std::max(enclosed, 1e-6f), -2.0f / 3.0f) - 1.0f);
+
+            // speed as a fraction q of the local escape speed, by rejection from q^2 (1 - q^2)^3.5
+            float q, height;
+            do {
+                q = random.uniform();
+                height = 0.1f * random.uniform();
+            } while(height > q * q * std::pow(1.0f - q * q, 3.5f));
+            float speed = q * escapeScale * std::pow(1.0f + r * r / (a * a), -0.25f);
+
+            state body;
+            isotropic(random, r, body.x, body.y, body.z);
+            isotropic(random, speed, body.vx, body.vy, body.vz);
+            return body;
+        });
+    }
+
+    // Exponential disk, surface density ~ exp(-R / radius) with a sech^2 vertical profile. Each body
+    // moves on the circular orbit set by the central mass plus the disk mass inside its radius.
+    static void exponentialDisk(bodyStore &bodies, const generatorSettings &settings, float gravity, float softening, threadPool *workers) {
+        const float scale = settings.radius;
+
+        fill(bodies, settings, workers, [&](counterRandom &random) {
+            // the radial distribution R exp(-R / scale) is a sum of two exponential deviates
+            float r = -scale * std::log(random.positive() * random.positive());
+            float phi = 2.0f * (float)M_PI * random.uniform();
+
+            float u = random.positive();
+            float y = 0.5f * settings.thickness * std::log(u / std::max(1.0f - u, 1e-7f));
+
+            float x = r / scale;
+            float enclosed = settings.centralMass + settings.mass * (1.0f - (1.0f + x) * std::exp(-x));
+            float speed = std::sqrt(gravity * enclosed / std::sqrt(r * r + softening * softening));
+
+            return orbit(r, phi, y, speed);
+        });
+    }
+
+    // Thin ring of small bodies between radius and outer, uniform in area, on near-circular Keplerian
+    // orbits around the central mass; thickness sets the vertical spread of positions.
+    static void kuiperRing(bodyStore &bodies, const generatorSettings &settings, float gravity, float softening, threadPool *workers) {
+        const float inner2 = settings.radius * settings.radius;
+        const float outer2 = settings.outer * settings.outer;
+
+        fill(bodies, settings, workers, [&](counterRandom &random) {
+            float r = std::sqrt(inner2 + random.uniform() * (outer2 - inner2));
+            float phi = 2.0f * (float)M_PI * random.uniform();
+            float y = settings.thickness * random.gaussian();
+
+            float speed = std::sqrt(gravity * settings.centralMass / std::sqrt(r * r + softening * softening));
+            return orbit(r, phi, y, speed);
+        });
+    }
+};
+
+#endif
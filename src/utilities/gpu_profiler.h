@@ -0,0 +1,138 @@
+#ifndef GPU_PROFILER_H
+#define GPU_PROFILER_H
+#include <vector>
+#include <cstdint>
+#include <glad/glad.h>
+#include "profiler.h"
+
+// GPU side of the profiler. A scope brackets its commands with two GL_TIMESTAMP queries (core since
+// GL 3.3). Results are read back LATENCY frames later, when the GPU has long finished with them, so
+// the CPU never waits; they land on a "GPU" track, shifted onto the CPU clock.
+#ifdef GRAVITY_PROFILE
+class gpuProfiler {
+private:
+    static constexpr int LATENCY = 4;
+    static constexpr int CALIBRATE_EVERY = 240;
+
+    struct scope {
+        const char *name;
+        GLuint begin;
+        GLuint end;
+    };
+
+    std::vector<scope> frames[LATENCY];
+    std::vector<size_t> open;
+    std::vector<GLuint> spareQueries;
+    int current = 0;
+    int framesSinceCalibration = 0;
+    int64_t offset = 0;
+    profiler::trackHandle track;
+
+    GLuint takeQuery() {
+        if(spareQueries.empty()) {
+            GLuint query;
+            glGenQueries(1, &query);
+            return query;
+        }
+        GLuint query = spareQueries.back();
+        spareQueries.pop_back();
+        return query;
+    }
+
+    // reading GL_TIMESTAMP does not wait for earlier commands to finish, only to reach the server,
+    // close enough to line GPU scopes up under the CPU scopes that issued them
+    void calibrate() {
+        GLint64 gpuTime = 0;
+        glGetInteger64v(GL_TIMESTAMP, &gpuTime);
+        offset = (int64_t)profiler::now() - gpuTime;
+    }
+
+    void collect(std::vector<scope> &scopes) {
+        for(scope &finished : scopes) {
+            GLint available = 0;
+            glGetQueryObjectiv(finished.end, GL_QUERY_RESULT_AVAILABLE, &available);
+
+            if(available) {
+                GLuint64 begin = 0, end = 0;
+                glGetQueryObjectui64v(finished.begin, GL_QUERY_RESULT, &begin);
+                glGetQueryObjectui64v(finished.end, GL_QUERY_RESULT, &end);
+                profiler::record(track, finished.name, begin + offset, end + offset);
+            }
+            spareQueries.push_back(finished.begin);
+            spareQueries.push_back(finished.end);
+        }
+        scopes.clear();
+    }
+public:
+    gpuProfiler() : track(profiler::addTrack("GPU", true)) {
+        calibrate();
+    }
+
+    gpuProfiler(const gpuProfiler&) = delete;
+    gpuProfiler& operator=(const gpuProfiler&) = delete;
+
+    ~gpuProfiler() {
+        for(auto &scopes : frames) {
+            for(scope &pending : scopes) {
+                spareQueries.push_back(pending.begin);
+                if(pending.end) spareQueries.push_back(pending.end);
+            }
+        }
+        if(!spareQueries.empty()) glDeleteQueries(spareQueries.size(), spareQueries.data());
+    }
+
+    void begin(const char *name) {
+        scope started{name, takeQuery(), 0};
+        glQueryCounter(started.begin, GL_TIMESTAMP);
+
+        open.push_back(frames[current].size());
+        frames[current].push_back(started);
+    }
+
+    void end() {
+        scope &started = frames[current][open.back()];
+        open.pop_back();
+
+        started.end = takeQuery();
+        glQueryCounter(started.end, GL_TIMESTAMP);
+    }
+
+    // Call once per frame after the last scope; collects the frame issued LATENCY frames ago.
+    void endFrame() {
+        current = (current + 1) % LATENCY;
+        collect(frames[current]);
+
+        if(++framesSinceCalibration >= CALIBRATE_EVERY) {
+            calibrate();
+            framesSinceCalibration = 0;
+        }
+    }
+};
+
+class gpuProfileScope {
+private:
+    gpuProfiler &timers;
+public:
+    gpuProfileScope(gpuProfiler &timers, const char *name) : timers(timers) {
+        timers.begin(name);
+    }
+
+    ~gpuProfileScope() {
+        timers.end();
+    }
+
+    gpuProfileScope(const gpuProfileScope&) = delete;
+    gpuProfileScope& operator=(const gpuProfileScope&) = delete;
+};
+
+#define PROFILE_GPU_SCOPE(timers, name) gpuProfileScope PROFILE_JOIN(gpuProfileScope_, __LINE__)(timers, name)
+#else
+class gpuProfiler {
+public:
+    void endFrame() {}
+};
+
+#define PROFILE_GPU_SCOPE(timers, name) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,281 @@
+#ifndef INTEGRATOR_H
+#define INTEGRATOR_H
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+#include "bodies.h"
+
+enum class integratorType {
+    euler,
+    leapfrog,
+    verlet,
+    yoshida4,
+    block
+};
+
+// Advances a body store by one step. Force evaluation is passed in as a callable that fills the
+// acceleration arrays, and `accelerationsValid` carries the last evaluation over to the next step
+// so kick-drift-kick schemes only pay one force evaluation per (sub)step.
+//
+// The block scheme treats dt as one synchronized block split into 2^maxLevel ticks. Every body runs
+// kick-drift-kick leapfrog with its own power-of-two step dt / 2^level. Bodies sit in one bucket per
+// level, and a tick only touches the buckets finishing their step: those bodies drift and get new
+// forces, everyone else is predicted along their current velocity, and ticks where no level ends
+// are skipped outright. Levels are picked from
+// eta * max(|v| / |a|, sqrt(lengthScale / |a|)), reassigned at block starts and only allowed to
+// shrink mid-block, so step boundaries always stay aligned.
+class integrator {
+private:
+    std::vector<float> oldX, oldY, oldZ;
+
+    std::vector<float> predictedX, predictedY, predictedZ;
+    std::vector<float> predictedLowX, predictedLowY, predictedLowZ;
+
+    std::vector<uint32_t> levels;
+    std::vector<uint32_t> drifted;
+    std::vector<std::vector<uint32_t>> buckets;
+    std::vector<uint32_t> active;
+
+    // One position or velocity component at the working precision; the residual only counts in double.
+    template<typename Real>
+    static Real read(const std::vector<float> &value, const std::vector<float> &low, size_t i) {
+        if constexpr(std::is_same_v<Real, float>) return value[i];
+        else return (double)value[i] + low[i];
+    }
+
+    // value += delta, in double the sum is split back into the float value and its residual
+    template<typename Real>
+    static void add(std::vector<float> &value, std::vector<float> &low, size_t i, Real delta) {
+        if constexpr(std::is_same_v<Real, float>) {
+            value[i] += delta;
+        }
+        else {
+            double sum = (double)value[i] + low[i] + delta;
+            value[i] = (float)sum;
+            low[i] = (float)(sum - value[i]);
+        }
+    }
+
+    template<typename Real>
+    static void kick(bodyStore &bodies, Real dt) {
+        for(size_t i = 0; i < bodies.size(); i++) {
+            add(bodies.vx, bodies.lowVX, i, bodies.ax[i] * dt);
+            add(bodies.vy, bodies.lowVY, i, bodies.ay[i] * dt);
+            add(bodies.vz, bodies.lowVZ, i, bodies.az[i] * dt);
+        }
+    }
+
+    template<typename Real>
+    static void drift(bodyStore &bodies, Real dt) {
+        for(size_t i = 0; i < bodies.size(); i++) {
+            add(bodies.x, bodies.lowX, i, read<Real>(bodies.vx, bodies.lowVX, i) * dt);
+            add(bodies.y, bodies.lowY, i, read<Real>(bodies.vy, bodies.lowVY, i) * dt);
+            add(bodies.z, bodies.lowZ, i, read<Real>(bodies.vz, bodies.lowVZ, i) * dt);
+        }
+    }
+
+    template<typename Real>
+    void openingKick(bodyStore &bodies, uint32_t i, Real tickDt) const {
+        Real halfStep = Real(0.5) * tickDt * (1u << (maxLevel - levels[i]));
+        add(bodies.vx, bodies.lowVX, i, bodies.ax[i] * halfStep);
+        add(bodies.vy, bodies.lowVY, i, bodies.ay[i] * halfStep);
+        add(bodies.vz, bodies.lowVZ, i, bodies.az[i] * halfStep);
+    }
+
+    template<typename Real>
+    void swapPredicted(bodyStore &bodies) {
+        std::swap(bodies.x, predictedX);
+        std::swap(bodies.y, predictedY);
+        std::swap(bodies.z, predictedZ);
+        if constexpr(!std::is_same_v<Real, float>) {
+            std::swap(bodies.lowX, predictedLowX);
+            std::swap(bodies.lowY, predictedLowY);
+            std::swap(bodies.lowZ, predictedLowZ);
+        }
+    }
+
+    template<typename Real, typename Forces>
+    static void kickDriftKick(bodyStore &bodies, Real dt, Forces &forces) {
+        kick(bodies, Real(0.5) * dt);
+        drift(bodies, dt);
+        forces(bodies);
+        kick(bodies, Real(0.5) * dt);
+    }
+public:
+    uint32_t maxLevel = 8;
+    float eta = 0.02f;
+    float lengthScale = 1.0f;
+
+    static const char* name(integratorType type) {
+        switch(type) {
+            case integratorType::block: return "block";
+            case integratorType::euler: return "euler";
+            case integratorType::verlet: return "verlet";
+            case integratorType::yoshida4: return "yoshida4";
+            default: return "leapfrog";
+        }
+    }
+
+    static integratorType fromName(const std::string &name) {
+        if(name == "euler") return integratorType::euler;
+        if(name == "verlet") return integratorType::verlet;
+        if(name == "yoshida4") return integratorType::yoshida4;
+        if(name == "block") return integratorType::block;
+        return integratorType::leapfrog;
+    }
+
+    uint32_t levelFor(const bodyStore &bodies, size_t i, float dt) const {
+        float accel = std::sqrt(bodies.ax[i] * bodies.ax[i] + bodies.ay[i] * bodies.ay[i] + bodies.az[i] * bodies.az[i]);
+        if(accel <= 0.0f) return 0;
+
+        float speed = std::sqrt(bodies.vx[i] * bodies.vx[i] + bodies.vy[i] * bodies.vy[i] + bodies.vz[i] * bodies.vz[i]);
+        float wanted = eta * std::max(speed / accel, std::sqrt(lengthScale / accel));
+
+        uint32_t level = 0;
+        while(level < maxLevel && dt / (float)(1u << level) > wanted) level++;
+        return level;
+    }
+
+    template<typename Real, typename Forces, typename ForcesFor>
+    void blockStep(bodyStore &bodies, Real dt, bool &accelerationsValid, Forces &forces, ForcesFor &forcesFor) {
+        if(!accelerationsValid) forces(bodies);
+
+        const size_t count = bodies.size();
+        const uint32_t ticks = 1u << maxLevel;
+        const Real tickDt = dt / ticks;
+
+        levels.resize(count);
+        drifted.assign(count, 0);
+        buckets.resize(maxLevel + 1);
+        for(std::vector<uint32_t> &bucket : buckets) bucket.clear();
+
+        for(uint32_t i = 0; i < count; i++) {
+            levels[i] = levelFor(bodies, i, dt);
+            buckets[levels[i]].push_back(i);
+            openingKick(bodies, i, tickDt);
+        }
+
+        uint32_t now = 0;
+        while(now < ticks) {
+            // jump straight to the next tick where the finest occupied level ends a step
+            uint32_t finest = maxLevel;
+            while(finest > 0 && buckets[finest].empty()) finest--;
+            now += 1u << (maxLevel - finest);
+
+            // levels from `due` up finish their step at this tick
+            uint32_t due = maxLevel;
+            while(due > 0 && now % (1u << (maxLevel - due + 1)) == 0) due--;
+
+            active.clear();
+            for(uint32_t level = due; level <= maxLevel; level++) {
+                active.insert(active.end(), buckets[level].begin(), buckets[level].end());
+                buckets[level].clear();
+            }
+
+            for(uint32_t i : active) {
+                Real span = (Real)(now - drifted[i]) * tickDt;
+                add(bodies.x, bodies.lowX, i, read<Real>(bodies.vx, bodies.lowVX, i) * span);
+                add(bodies.y, bodies.lowY, i, read<Real>(bodies.vy, bodies.lowVY, i) * span);
+                add(bodies.z, bodies.lowZ, i, read<Real>(bodies.vz, bodies.lowVZ, i) * span);
+                drifted[i] = now;
+            }
+
+            // everyone else is mid-step and coasting, so their positions at `now` are predicted
+            // for the force evaluation without moving them
+            predictedX = bodies.x;
+            predictedY = bodies.y;
+            predictedZ = bodies.z;
+            if constexpr(!std::is_same_v<Real, float>) {
+                predictedLowX = bodies.lowX;
+                predictedLowY = bodies.lowY;
+                predictedLowZ = bodies.lowZ;
+            }
+            for(uint32_t i = 0; i < count; i++) {
+                if(drifted[i] == now) continue;
+                Real span = (Real)(now - drifted[i]) * tickDt;
+                add(predictedX, predictedLowX, i, read<Real>(bodies.vx, bodies.lowVX, i) * span);
+                add(predictedY, predictedLowY, i, read<Real>(bodies.vy, bodies.lowVY, i) * span);
+                add(predictedZ, predictedLowZ, i, read<Real>(bodies.vz, bodies.lowVZ, i) * span);
+            }
+            swapPredicted<Real>(bodies);
+            forcesFor(bodies, active);
+            swapPredicted<Real>(bodies);
+
+            for(uint32_t i : active) {
+                Real halfStep = Real(0.5) * tickDt * (1u << (maxLevel - levels[i]));
+                add(bodies.vx, bodies.lowVX, i, bodies.ax[i] * halfStep);
+                add(bodies.vy, bodies.lowVY, i, bodies.ay[i] * halfStep);
+                add(bodies.vz, bodies.lowVZ, i, bodies.az[i] * halfStep);
+
+                if(now == ticks) continue;
+                levels[i] = std::max(levels[i], levelFor(bodies, i, dt));
+                buckets[levels[i]].push_back(i);
+                openingKick(bodies, i, tickDt);
+            }
+        }
+        accelerationsValid = true;
+    }
+
+    // Real is the precision of the state update: float works on the float values alone, double
+    // carries the residuals of bodies.h along.
+    template<typename Real = float, typename Forces, typename ForcesFor>
+    void step(integratorType type, bodyStore &bodies, Real dt, bool &accelerationsValid, Forces &&forces, ForcesFor &&forcesFor) {
+        if(type == integratorType::block) {
+            blockStep(bodies, dt, accelerationsValid, forces, forcesFor);
+            return;
+        }
+
+        if(type == integratorType::euler) {
+            forces(bodies);
+            kick(bodies, dt);
+            drift(bodies, dt);
+
+            accelerationsValid = false;
+            return;
+        }
+
+        if(!accelerationsValid) forces(bodies);
+
+        switch(type) {
+            case integratorType::verlet: {
+                oldX = bodies.ax;
+                oldY = bodies.ay;
+                oldZ = bodies.az;
+
+                for(size_t i = 0; i < bodies.size(); i++) {
+                    add(bodies.x, bodies.lowX, i, (read<Real>(bodies.vx, bodies.lowVX, i) + Real(0.5) * bodies.ax[i] * dt) * dt);
+                    add(bodies.y, bodies.lowY, i, (read<Real>(bodies.vy, bodies.lowVY, i) + Real(0.5) * bodies.ay[i] * dt) * dt);
+                    add(bodies.z, bodies.lowZ, i, (read<Real>(bodies.vz, bodies.lowVZ, i) + Real(0.5) * bodies.az[i] * dt) * dt);
+                }
+                forces(bodies);
+
+                for(size_t i = 0; i < bodies.size(); i++) {
+                    add(bodies.vx, bodies.lowVX, i, Real(0.5) * (oldX[i] + bodies.ax[i]) * dt);
+                    add(bodies.vy, bodies.lowVY, i, Real(0.5) * (oldY[i] + bodies.ay[i]) * dt);
+                    add(bodies.vz, bodies.lowVZ, i, Real(0.5) * (oldZ[i] + bodies.az[i]) * dt);
+                }
+                break;
+            }
+            case integratorType::yoshida4: {
+                // Yoshida/Forest-Ruth triple jump: three leapfrog substeps with weights w1, w0, w1
+                const double cubeRoot = std::cbrt(2.0);
+                const Real w1 = 1.0 / (2.0 - cubeRoot);
+                const Real w0 = -cubeRoot / (2.0 - cubeRoot);
+
+                kickDriftKick(bodies, w1 * dt, forces);
+                kickDriftKick(bodies, w0 * dt, forces);
+                kickDriftKick(bodies, w1 * dt, forces);
+                break;
+            }
+            default:
+                kickDriftKick(bodies, dt, forces);
+                break;
+        }
+        accelerationsValid = true;
+    }
+};
+
+#endif
@@ -0,0 +1,510 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+#include <cmath>
+#include <cstddef>
+#include <string>
+#include <type_traits>
+#include "force_law.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+enum class simdLevel {
+    scalar,
+    avx2,
+    avx512
+};
+
+// Target-only direct summation: every target in [begin, end) sums the pull of the sources in
+// [sourceBegin, sourceEnd), so tiles of targets and sources can be computed independently.
+// The force law and the precision of the arithmetic come from the law policy (force_law.h). Every
+// law has hand-vectorized float and double paths built on its pull() overloads below; the scalar loop
+// handles the remainder and machines without AVX2.
+class directKernel {
+private:
+    template<typename Law>
+    static void scalarRange(const Law &law, const float *x, const float *y, const float *z, const float *m,
+                            size_t begin, size_t end, size_t sourceBegin, size_t sourceEnd,
+                            float *ax, float *ay, float *az,
+                            const float *lowX = nullptr, const float *lowY = nullptr, const float *lowZ = nullptr) {
+        using real = typename Law::real;
+        const bool residuals = !std::is_same_v<real, float> && lowX;
+
+        for(size_t i = begin; i < end; i++) {
+            real sumX = 0, sumY = 0, sumZ = 0;
+
+            for(size_t j = sourceBegin; j < sourceEnd; j++) {
+                real dx = (real)x[j] - (real)x[i];
+                real dy = (real)y[j] - (real)y[i];
+                real dz = (real)z[j] - (real)z[i];
+                if(residuals) {
+                    dx += (real)lowX[j] - (real)lowX[i];
+                    dy += (real)lowY[j] - (real)lowY[i];
+                    dz += (real)lowZ[j] - (real)lowZ[i];
+                }
+                real r2 = dx * dx + dy * dy + dz * dz;
+
+                real pull = law(r2, (real)m[j]);
+
+                sumX += dx * pull;
+                sumY += dy * pull;
+                sumZ += dz * pull;
+            }
+
+            ax[i] += (float)sumX;
+            ay[i] += (float)sumY;
+            az[i] += (float)sumZ;
+        }
+    }
+
+#ifdef KERNELS_X86
+    // Vector forms of each law's operator(), one per instruction set and precision. The float ones refine
+    // the rsqrt/rcp estimates with one Newton-Raphson step each, from ~12 to ~23 bits.
+    __attribute__((target("avx2,fma")))
+    static __m256 inverseSqrt(__m256 value) {
+        __m256 estimate = _mm256_rsqrt_ps(value);
+        return _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(0.5f), estimate), _mm256_fnmadd_ps(_mm256_mul_ps(value, estimate), estimate, _mm256_set1_ps(3.0f)));
+    }
+
+    __attribute__((target("avx2,fma")))
+    static __m256 pull(const softenedLaw<float> &law, __m256 r2, __m256 mass) {
+        __m256 distance = _mm256_add_ps(r2, _mm256_set1_ps(law.getEps2()));
+        __m256 keep = _mm256_cmp_ps(distance, _mm256_set1_ps(law.getMinDistance()), _CMP_GE_OQ);
+
+        __m256 invR = inverseSqrt(r2);
+        __m256 invDistance = _mm256_rcp_ps(distance);
+        invDistance = _mm256_mul_ps(invDistance, _mm256_fnmadd_ps(distance, invDistance, _mm256_set1_ps(2.0f)));
+
+        __m256 result = _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(law.getGravity()), mass), _mm256_mul_ps(invR, invDistance));
+        return _mm256_and_ps(result, keep);
+    }
+
+    __attribute__((target("avx2,fma")))
+    static __m256 pull(const plummerLaw<float> &law, __m256 r2, __m256 mass) {
+        __m256 invR = inverseSqrt(_mm256_add_ps(r2, _mm256_set1_ps(law.getEps2())));
+        return _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(law.getGravity()), mass), _mm256_mul_ps(_mm256_mul_ps(invR, invR), invR));
+    }
+
+    __attribute__((target("avx2,fma")))
+    static __m256 pull(const cutoffLaw<float> &law, __m256 r2, __m256 mass) {
+        __m256 keep = _mm256_cmp_ps(r2, _mm256_set1_ps(law.getCutoff2()), _CMP_LT_OQ);
+        __m256 invR = inverseSqrt(_mm256_add_ps(r2, _mm256_set1_ps(law.getEps2())));
+        __m256 result = _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(law.getGravity()), mass), _mm256_mul_ps(_mm256_mul_ps(invR, invR), invR));
+        return _mm256_and_ps(result, keep);
+    }
+
+    // both kernel branches and the Newtonian tail are computed and blended, the unused ones may be inf
+    template<typename Real, typename Vector>
+    __attribute__((target("avx2,fma")))
+    static Vector splineFactor(Vector u) {
+        if constexpr(std::is_same_v<Real, float>) {
+            __m256 u2 = _mm256_mul_ps(u, u), u3 = _mm256_mul_ps(u2, u);
+            __m256 inner = _mm256_fmadd_ps(u2, _mm256_fmsub_ps(_mm256_set1_ps(32.0f), u, _mm256_set1_ps(38.4f)), _mm256_set1_ps(10.666666666667f));
+            __m256 outer = _mm256_fnmadd_ps(_mm256_set1_ps(48.0f), u, _mm256_set1_ps(21.333333333333f));
+            outer = _mm256_fmadd_ps(_mm256_set1_ps(38.4f), u2, outer);
+            outer = _mm256_fnmadd_ps(_mm256_set1_ps(10.666666666667f), u3, outer);
+            outer = _mm256_sub_ps(outer, _mm256_div_ps(_mm256_set1_ps(0.066666666667f), u3));
+            return _mm256_blendv_ps(outer, inner, _mm256_cmp_ps(u, _mm256_set1_ps(0.5f), _CMP_LT_OQ));
+        }
+        else {
+            __m256d u2 = _mm256_mul_pd(u, u), u3 = _mm256_mul_pd(u2, u);
+            __m256d inner = _mm256_fmadd_pd(u2, _mm256_fmsub_pd(_mm256_set1_pd(32.0), u, _mm256_set1_pd(38.4)), _mm256_set1_pd(10.666666666667));
+            __m256d outer = _mm256_fnmadd_pd(_mm256_set1_pd(48.0), u, _mm256_set1_pd(21.333333333333));
+            outer = _mm256_fmadd_pd(_mm256_set1_pd(38.4), u2, outer);
+            outer = _mm256_fnmadd_pd(_mm256_set1_pd(10.666666666667), u3, outer);
+            outer = _mm256_sub_pd(outer, _mm256_div_pd(_mm256_set1_pd(0.066666666667), u3));
+            return _mm256_blendv_pd(outer, inner, _mm256_cmp_pd(u, _mm256_set1_pd(0.5), _CMP_LT_OQ));
+        }
+    }
+
+    __attribute__((target("avx2,fma")))
+    static __m256 pull(const splineLaw<float> &law, __m256 r2, __m256 mass) {
+        __m256 r = _mm256_sqrt_ps(r2);
+        __m256 gm = _mm256_mul_ps(_mm256_set1_ps(law.getGravity()), mass);
+
+        __m256 newtonian = _mm256_div_ps(gm, _mm256_mul_ps(r2, r));
+        __m256 factor = splineFactor<float, __m256>(_mm256_mul_ps(r, _mm256_set1_ps(law.getInverseH())));
+        __m256 softened = _mm256_mul_ps(_mm256_mul_ps(gm, _mm256_set1_ps(law.getInverseH3())), factor);
+        return _mm256_blendv_ps(softened, newtonian, _mm256_cmp_ps(r, _mm256_set1_ps(law.getH()), _CMP_GE_OQ));
+    }
+
+    __attribute__((target("avx2,fma")))
+    static __m256d pull(const softenedLaw<double> &law, __m256d r2, __m256d mass) {
+        __m256d distance = _mm256_add_pd(r2, _mm256_set1_pd(law.getEps2()));
+        __m256d keep = _mm256_cmp_pd(distance, _mm256_set1_pd(law.getMinDistance()), _CMP_GE_OQ);
+        __m256d result = _mm256_div_pd(_mm256_mul_pd(_mm256_set1_pd(law.getGravity()), mass), _mm256_mul_pd(distance, _mm256_sqrt_pd(r2)));
+        return _mm256_and_pd(result, keep);
+    }
+
+    __attribute__((target("avx2,fma")))
+    static __m256d pull(const plummerLaw<double> &law, __m256d r2, __m256d mass) {
+        __m256d distance = _mm256_add_pd(r2, _mm256_set1_pd(law.getEps2()));
+        return _mm256_div_pd(_mm256_mul_pd(_mm256_set1_pd(law.getGravity()), mass), _mm256_mul_pd(distance, _mm256_sqrt_pd(distance)));
+    }
+
+    __attribute__((target("avx2,fma")))
+    static __m256d pull(const cutoffLaw<double> &law, __m256d r2, __m256d mass) {
+        __m256d keep = _mm256_cmp_pd(r2, _mm256_set1_pd(law.getCutoff2()), _CMP_LT_OQ);
+        __m256d distance = _mm256_add_pd(r2, _mm256_set1_pd(law.getEps2()));
+        __m256d result = _mm256_div_pd(_mm256_mul_pd(_mm256_set1_pd(law.getGravity()), mass), _mm256_mul_pd(distance, _mm256_sqrt_pd(distance)));
+        return _mm256_and_pd(result, keep);
+    }
+
+    __attribute__((target("avx2,fma")))
+    static __m256d pull(const splineLaw<double> &law, __m256d r2, __m256d mass) {
+        __m256d r = _mm256_sqrt_pd(r2);
+        __m256d gm = _mm256_mul_pd(_mm256_set1_pd(law.getGravity()), mass);
+
+        __m256d newtonian = _mm256_div_pd(gm, _mm256_mul_pd(r2, r));
+        __m256d factor = splineFactor<double, __m256d>(_mm256_mul_pd(r, _mm256_set1_pd(law.getInverseH())));
+        __m256d softened = _mm256_mul_pd(_mm256_mul_pd(gm, _mm256_set1_pd(law.getInverseH3())), factor);
+        return _mm256_blendv_pd(softened, newtonian, _mm256_cmp_pd(r, _mm256_set1_pd(law.getH()), _CMP_GE_OQ));
+    }
+
+    template<typename Law>
+    __attribute__((target("avx2,fma")))
+    static void avx2Range(const Law &law, const float *x, const float *y, const float *z, const float *m,
+                          size_t begin, size_t end, size_t sourceBegin, size_t sourceEnd,
+                          float *ax, float *ay, float *az) {
+        const size_t vectorEnd = sourceBegin + ((sourceEnd - sourceBegin) & ~size_t(7));
+
+        for(size_t i = begin; i < end; i++) {
+            const __m256 px = _mm256_set1_ps(x[i]);
+            const __m256 py = _mm256_set1_ps(y[i]);
+            const __m256 pz = _mm256_set1_ps(z[i]);
+
+            __m256 sumX = _mm256_setzero_ps();
+            __m256 sumY = _mm256_setzero_ps();
+            __m256 sumZ = _mm256_setzero_ps();
+
+            for(size_t j = sourceBegin; j < vectorEnd; j += 8) {
+                __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(x + j), px);
+                __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(y + j), py);
+                __m256 dz = _mm256_sub_ps(_mm256_loadu_ps(z + j), pz);
+
+                __m256 r2 = _mm256_fmadd_ps(dz, dz, _mm256_fmadd_ps(dy, dy, _mm256_mul_ps(dx, dx)));
+                __m256 factor = pull(law, r2, _mm256_loadu_ps(m + j));
+
+                sumX = _mm256_fmadd_ps(dx, factor, sumX);
+                sumY = _mm256_fmadd_ps(dy, factor, sumY);
+                sumZ = _mm256_fmadd_ps(dz, factor, sumZ);
+            }
+
+            ax[i] += horizontalSum(sumX);
+            ay[i] += horizontalSum(sumY);
+            az[i] += horizontalSum(sumZ);
+        }
+
+        scalarRange(law, x, y, z, m, begin, end, vectorEnd, sourceEnd, ax, ay, az);
+    }
+
+    template<typename Law>
+    __attribute__((target("avx2,fma")))
+    static void avx2DoubleRange(const Law &law, const float *x, const float *y, const float *z, const float *m,
+                                size_t begin, size_t end, size_t sourceBegin, size_t sourceEnd,
+                                float *ax, float *ay, float *az, const float *lowX, const float *lowY, const float *lowZ) {
+        const bool residuals = lowX != nullptr;
+        const size_t vectorEnd = sourceBegin + ((sourceEnd - sourceBegin) & ~size_t(3));
+
+        for(size_t i = begin; i < end; i++) {
+            const __m256d px = _mm256_set1_pd(x[i]);
+            const __m256d py = _mm256_set1_pd(y[i]);
+            const __m256d pz = _mm256_set1_pd(z[i]);
+            const __m256d lowPX = _mm256_set1_pd(residuals ? lowX[i] : 0.0f);
+            const __m256d lowPY = _mm256_set1_pd(residuals ? lowY[i] : 0.0f);
+            const __m256d lowPZ = _mm256_set1_pd(residuals ? lowZ[i] : 0.0f);
+
+            __m256d sumX = _mm256_setzero_pd();
+            __m256d sumY = _mm256_setzero_pd();
+            __m256d sumZ = _mm256_setzero_pd();
+
+            for(size_t j = sourceBegin; j < vectorEnd; j += 4) {
+                __m256d dx = _mm256_sub_pd(_mm256_cvtps_pd(_mm_loadu_ps(x + j)), px);
+                __m256d dy = _mm256_sub_pd(_mm256_cvtps_pd(_mm_loadu_ps(y + j)), py);
+                __m256d dz = _mm256_sub_pd(_mm256_cvtps_pd(_mm_loadu_ps(z + j)), pz);
+                if(residuals) {
+                    dx = _mm256_add_pd(dx, _mm256_sub_pd(_mm256_cvtps_pd(_mm_loadu_ps(lowX + j)), lowPX));
+                    dy = _mm256_add_pd(dy, _mm256_sub_pd(_mm256_cvtps_pd(_mm_loadu_ps(lowY + j)), lowPY));
+                    dz = _mm256_add_pd(dz, _mm256_sub_pd(_mm256_cvtps_pd(_mm_loadu_ps(lowZ + j)), lowPZ));
+                }
+
+                __m256d r2 = _mm256_fmadd_pd(dz, dz, _mm256_fmadd_pd(dy, dy, _mm256_mul_pd(dx, dx)));
+                __m256d factor = pull(law, r2, _mm256_cvtps_pd(_mm_loadu_ps(m + j)));
+
+                sumX = _mm256_fmadd_pd(dx, factor, sumX);
+                sumY = _mm256_fmadd_pd(dy, factor, sumY);
+                sumZ = _mm256_fmadd_pd(dz, factor, sumZ);
+            }
+
+            ax[i] += (float)horizontalSum(sumX);
+            ay[i] += (float)horizontalSum(sumY);
+            az[i] += (float)horizontalSum(sumZ);
+        }
+
+        scalarRange(law, x, y, z, m, begin, end, vectorEnd, sourceEnd, ax, ay, az, lowX, lowY, lowZ);
+    }
+
+    __attribute__((target("avx2,fma")))
+    static float horizontalSum(__m256 value) {
+        __m128 sum = _mm_add_ps(_mm256_castps256_ps128(value), _mm256_extractf128_ps(value, 1));
+        sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+        sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 0x55));
+        return _mm_cvtss_f32(sum);
+    }
+
+    __attribute__((target("avx2,fma")))
+    static double horizontalSum(__m256d value) {
+        __m128d sum = _mm_add_pd(_mm256_castpd256_pd128(value), _mm256_extractf128_pd(value, 1));
+        sum = _mm_add_sd(sum, _mm_unpackhi_pd(sum, sum));
+        return _mm_cvtsd_f64(sum);
+    }
+
+    // GCC 12 flags the undefined passthrough operands inside its own AVX-512 intrinsics
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+    __attribute__((target("avx512f")))
+    static __m512 inverseSqrt(__m512 value) {
+        __m512 estimate = _mm512_rsqrt14_ps(value);
+        return _mm512_mul_ps(_mm512_mul_ps(_mm512_set1_ps(0.5f), estimate), _mm512_fnmadd_ps(_mm512_mul_ps(value, estimate), estimate, _mm512_set1_ps(3.0f)));
+    }
+
+    __attribute__((target("avx512f")))
+    static __m512 pull(const softenedLaw<float> &law, __m512 r2, __m512 mass) {
+        __m512 distance = _mm512_add_ps(r2, _mm512_set1_ps(law.getEps2()));
+        __mmask16 keep = _mm512_cmp_ps_mask(distance, _mm512_set1_ps(law.getMinDistance()), _CMP_GE_OQ);
+
+        __m512 invR = inverseSqrt(r2);
+        __m512 invDistance = _mm512_rcp14_ps(distance);
+        invDistance = _mm512_mul_ps(invDistance, _mm512_fnmadd_ps(distance, invDistance, _mm512_set1_ps(2.0f)));
+
+        return _mm512_maskz_mul_ps(keep, _mm512_mul_ps(_mm512_set1_ps(law.getGravity()), mass), _mm512_mul_ps(invR, invDistance));
+    }
+
+    __attribute__((target("avx512f")))
+    static __m512 pull(const plummerLaw<float> &law, __m512 r2, __m512 mass) {
+        __m512 invR = inverseSqrt(_mm512_add_ps(r2, _mm512_set1_ps(law.getEps2())));
+        return _mm512_mul_ps(_mm512_mul_ps(_mm512_set1_ps(law.getGravity()), mass), _mm512_mul_ps(_mm512_mul_ps(invR, invR), invR));
+    }
+
+    __attribute__((target("avx512f")))
+    static __m512 pull(const cutoffLaw<float> &law, __m512 r2, __m512 mass) {
+        __mmask16 keep = _mm512_cmp_ps_mask(r2, _mm512_set1_ps(law.getCutoff2()), _CMP_LT_OQ);
+        __m512 invR = inverseSqrt(_mm512_add_ps(r2, _mm512_set1_ps(law.getEps2())));
+        return _mm512_maskz_mul_ps(keep, _mm512_mul_ps(_mm512_set1_ps(law.getGravity()), mass), _mm512_mul_ps(_mm512_mul_ps(invR, invR), invR));
+    }
+
+    template<typename Real, typename Vector>
+    __attribute__((target("avx512f")))
+    static Vector splineFactor512(Vector u) {
+        if constexpr(std::is_same_v<Real, float>) {
+            __m512 u2 = _mm512_mul_ps(u, u), u3 = _mm512_mul_ps(u2, u);
+            __m512 inner = _mm512_fmadd_ps(u2, _mm512_fmsub_ps(_mm512_set1_ps(32.0f), u, _mm512_set1_ps(38.4f)), _mm512_set1_ps(10.666666666667f));
+            __m512 outer = _mm512_fnmadd_ps(_mm512_set1_ps(48.0f), u, _mm512_set1_ps(21.333333333333f));
+            outer = _mm512_fmadd_ps(_mm512_set1_ps(38.4f), u2, outer);
+            outer = _mm512_fnmadd_ps(_mm512_set1_ps(10.666666666667f), u3, outer);
+            outer = _mm512_sub_ps(outer, _mm512_div_ps(_mm512_set1_ps(0.066666666667f), u3));
+            return _mm512_mask_blend_ps(_mm512_cmp_ps_mask(u, _mm512_set1_ps(0.5f), _CMP_LT_OQ), outer, inner);
+        }
+        else {
+            __m512d u2 = _mm512_mul_pd(u, u), u3 = _mm512_mul_pd(u2, u);
+            __m512d inner = _mm512_fmadd_pd(u2, _mm512_fmsub_pd(_mm512_set1_pd(32.0), u, _mm512_set1_pd(38.4)), _mm512_set1_pd(10.666666666667));
+            __m512d outer = _mm512_fnmadd_pd(_mm512_set1_pd(48.0), u, _mm512_set1_pd(21.333333333333));
+            outer = _mm512_fmadd_pd(_mm512_set1_pd(38.4), u2, outer);
+            outer = _mm512_fnmadd_pd(_mm512_set1_pd(10.666666666667), u3, outer);
+            outer = _mm512_sub_pd(outer, _mm512_div_pd(_mm512_set1_pd(0.066666666667), u3));
+            return _mm512_mask_blend_pd(_mm512_cmp_pd_mask(u, _mm512_set1_pd(0.5), _CMP_LT_OQ), outer, inner);
+        }
+    }
+
+    __attribute__((target("avx512f")))
+    static __m512 pull(const splineLaw<float> &law, __m512 r2, __m512 mass) {
+        __m512 r = _mm512_sqrt_ps(r2);
+        __m512 gm = _mm512_mul_ps(_mm512_set1_ps(law.getGravity()), mass);
+
+        __m512 newtonian = _mm512_div_ps(gm, _mm512_mul_ps(r2, r));
+        __m512 factor = splineFactor512<float, __m512>(_mm512_mul_ps(r, _mm512_set1_ps(law.getInverseH())));
+        __m512 softened = _mm512_mul_ps(_mm512_mul_ps(gm, _mm512_set1_ps(law.getInverseH3())), factor);
+        return _mm512_mask_blend_ps(_mm512_cmp_ps_mask(r, _mm512_set1_ps(law.getH()), _CMP_GE_OQ), softened, newtonian);
+    }
+
+    __attribute__((target("avx512f")))
+    static __m512d pull(const softenedLaw<double> &law, __m512d r2, __m512d mass) {
+        __m512d distance = _mm512_add_pd(r2, _mm512_set1_pd(law.getEps2()));
+        __mmask8 keep = _mm512_cmp_pd_mask(distance, _mm512_set1_pd(law.getMinDistance()), _CMP_GE_OQ);
+        return _mm512_maskz_div_pd(keep, _mm512_mul_pd(_mm512_set1_pd(law.getGravity()), mass), _mm512_mul_pd(distance, _mm512_sqrt_pd(r2)));
+    }
+
+    __attribute__((target("avx512f")))
+    static __m512d pull(const plummerLaw<double> &law, __m512d r2, __m512d mass) {
+        __m512d distance = _mm512_add_pd(r2, _mm512_set1_pd(law.getEps2()));
+        return _mm512_div_pd(_mm512_mul_pd(_mm512_set1_pd(law.getGravity()), mass), _mm512_mul_pd(distance, _mm512_sqrt_pd(distance)));
+    }
+
+    __attribute__((target("avx512f")))
+    static __m512d pull(const cutoffLaw<double> &law, __m512d r2, __m512d mass) {
+        __mmask8 keep = _mm512_cmp_pd_mask(r2, _mm512_set1_pd(law.getCutoff2()), _CMP_LT_OQ);
+        __m512d distance = _mm512_add_pd(r2, _mm512_set1_pd(law.getEps2()));
+        return _mm512_maskz_div_pd(keep, _mm512_mul_pd(_mm512_set1_pd(law.getGravity()), mass), _mm512_mul_pd(distance, _mm512_sqrt_pd(distance)));
+    }
+
+    __attribute__((target("avx512f")))
+    static __m512d pull(const splineLaw<double> &law, __m512d r2, __m512d mass) {
+        __m512d r = _mm512_sqrt_pd(r2);
+        __m512d gm = _mm512_mul_pd(_mm512_set1_pd(law.getGravity()), mass);
+
+        __m512d newtonian = _mm512_div_pd(gm, _mm512_mul_pd(r2, r));
+        __m512d factor = splineFactor512<double, __m512d>(_mm512_mul_pd(r, _mm512_set1_pd(law.getInverseH())));
+        __m512d softened = _mm512_mul_pd(_mm512_mul_pd(gm, _mm512_set1_pd(law.getInverseH3())), factor);
+        return _mm512_mask_blend_pd(_mm512_cmp_pd_mask(r, _mm512_set1_pd(law.getH()), _CMP_GE_OQ), softened, newtonian);
+    }
+
+    template<typename Law>
+    __attribute__((target("avx512f")))
+    static void avx512Range(const Law &law, const float *x, const float *y, const float *z, const float *m,
+                            size_t begin, size_t end, size_t sourceBegin, size_t sourceEnd,
+                            float *ax, float *ay, float *az) {
+        const size_t vectorEnd = sourceBegin + ((sourceEnd - sourceBegin) & ~size_t(15));
+
+        for(size_t i = begin; i < end; i++) {
+            const __m512 px = _mm512_set1_ps(x[i]);
+            const __m512 py = _mm512_set1_ps(y[i]);
+            const __m512 pz = _mm512_set1_ps(z[i]);
+
+            __m512 sumX = _mm512_setzero_ps();
+            __m512 sumY = _mm512_setzero_ps();
+            __m512 sumZ = _mm512_setzero_ps();
+
+            for(size_t j = sourceBegin; j < vectorEnd; j += 16) {
+                __m512 dx = _mm512_sub_ps(_mm512_loadu_ps(x + j), px);
+                __m512 dy = _mm512_sub_ps(_mm512_loadu_ps(y + j), py);
+                __m512 dz = _mm512_sub_ps(_mm512_loadu_ps(z + j), pz);
+
+                __m512 r2 = _mm512_fmadd_ps(dz, dz, _mm512_fmadd_ps(dy, dy, _mm512_mul_ps(dx, dx)));
+                __m512 factor = pull(law, r2, _mm512_loadu_ps(m + j));
+
+                sumX = _mm512_fmadd_ps(dx, factor, sumX);
+                sumY = _mm512_fmadd_ps(dy, factor, sumY);
+                sumZ = _mm512_fmadd_ps(dz, factor, sumZ);
+            }
+
+            ax[i] += _mm512_reduce_add_ps(sumX);
+            ay[i] += _mm512_reduce_add_ps(sumY);
+            az[i] += _mm512_reduce_add_ps(sumZ);
+        }
+
+        scalarRange(law, x, y, z, m, begin, end, vectorEnd, sourceEnd, ax, ay, az);
+    }
+
+    template<typename Law>
+    __attribute__((target("avx512f")))
+    static void avx512DoubleRange(const Law &law, const float *x, const float *y, const float *z, const float *m,
+                                  size_t begin, size_t end, size_t sourceBegin, size_t sourceEnd,
+                                  float *ax, float *ay, float *az, const float *lowX, const float *lowY, const float *lowZ) {
+        const bool residuals = lowX != nullptr;
+        const size_t vectorEnd = sourceBegin + ((sourceEnd - sourceBegin) & ~size_t(7));
+
+        for(size_t i = begin; i < end; i++) {
+            const __m512d px = _mm512_set1_pd(x[i]);
+            const __m512d py = _mm512_set1_pd(y[i]);
+            const __m512d pz = _mm512_set1_pd(z[i]);
+            const __m512d lowPX = _mm512_set1_pd(residuals ? lowX[i] : 0.0f);
+            const __m512d lowPY = _mm512_set1_pd(residuals ? lowY[i] : 0.0f);
+            const __m512d lowPZ = _mm512_set1_pd(residuals ? lowZ[i] : 0.0f);
+
+            __m512d sumX = _mm512_setzero_pd();
+            __m512d sumY = _mm512_setzero_pd();
+            __m512d sumZ = _mm512_setzero_pd();
+
+            for(size_t j = sourceBegin; j < vectorEnd; j += 8) {
+                __m512d dx = _mm512_sub_pd(_mm512_cvtps_pd(_mm256_loadu_ps(x + j)), px);
+                __m512d dy = _mm512_sub_pd(_mm512_cvtps_pd(_mm256_loadu_ps(y + j)), py);
+                __m512d dz = _mm512_sub_pd(_mm512_cvtps_pd(_mm256_loadu_ps(z + j)), pz);
+                if(residuals) {
+                    dx = _mm512_add_pd(dx, _mm512_sub_pd(_mm512_cvtps_pd(_mm256_loadu_ps(lowX + j)), lowPX));
+                    dy = _mm512_add_pd(dy, _mm512_sub_pd(_mm512_cvtps_pd(_mm256_loadu_ps(lowY + j)), lowPY));
+                    dz = _mm512_add_pd(dz, _mm512_sub_pd(_mm512_cvtps_pd(_mm256_loadu_ps(lowZ + j)), lowPZ));
+                }
+
+                __m512d r2 = _mm512_fmadd_pd(dz, dz, _mm512_fmadd_pd(dy, dy, _mm512_mul_pd(dx, dx)));
+                __m512d factor = pull(law, r2, _mm512_cvtps_pd(_mm256_loadu_ps(m + j)));
+
+                sumX = _mm512_fmadd_pd(dx, factor, sumX);
+                sumY = _mm512_fmadd_pd(dy, factor, sumY);
+                sumZ = _mm512_fmadd_pd(dz, factor, sumZ);
+            }
+
+            ax[i] += (float)_mm512_reduce_add_pd(sumX);
+            ay[i] += (float)_mm512_reduce_add_pd(sumY);
+            az[i] += (float)_mm512_reduce_add_pd(sumZ);
+        }
+
+        scalarRange(law, x, y, z, m, begin, end, vectorEnd, sourceEnd, ax, ay, az, lowX, lowY, lowZ);
+    }
+#pragma GCC diagnostic pop
+#endif
+public:
+    static simdLevel detect() {
+#ifdef KERNELS_X86
+        __builtin_cpu_init();
+
+        if(__builtin_cpu_supports("avx512f")) return simdLevel::avx512;
+        if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return simdLevel::avx2;
+#endif
+        return simdLevel::scalar;
+    }
+
+    static bool supported(simdLevel level) {
+        switch(level) {
+            case simdLevel::avx512:
+                return detect() == simdLevel::avx512;
+            case simdLevel::avx2:
+                return detect() != simdLevel::scalar;
+            default:
+                return true;
+        }
+    }
+
+    static const char* name(simdLevel level) {
+        switch(level) {
+            case simdLevel::avx512: return "avx512";
+            case simdLevel::avx2: return "avx2";
+            default: return "scalar";
+        }
+    }
+
+    static simdLevel fromName(const std::string &name) {
+        if(name == "avx512") return simdLevel::avx512;
+        if(name == "avx2") return simdLevel::avx2;
+        return simdLevel::scalar;
+    }
+
+    // Adds the acceleration of targets [begin, end) to ax/ay/az; callers zero the arrays first. The double
+    // paths add the low-order position residuals (bodyStore::lowX...) to every separation when given, so
+    // close pairs are resolved to the precision the integrator keeps; float laws ignore them.
+    template<typename Law>
+    static void accumulate(simdLevel level, const Law &law, const float *x, const float *y, const float *z, const float *m,
+                           size_t begin, size_t end, size_t sourceBegin, size_t sourceEnd,
+                           float *ax, float *ay, float *az,
+                           const float *lowX = nullptr, const float *lowY = nullptr, const float *lowZ = nullptr) {
+#ifdef KERNELS_X86
+        constexpr bool single = std::is_same_v<typename Law::real, float>;
+        switch(level) {
+            case simdLevel::avx512:
+                if constexpr(single) avx512Range(law, x, y, z, m, begin, end, sourceBegin, sourceEnd, ax, ay, az);
+                else avx512DoubleRange(law, x, y, z, m, begin, end, sourceBegin, sourceEnd, ax, ay, az, lowX, lowY, lowZ);
+                return;
+            case simdLevel::avx2:
+                if constexpr(single) avx2Range(law, x, y, z, m, begin, end, sourceBegin, sourceEnd, ax, ay, az);
+                else avx2DoubleRange(law, x, y, z, m, begin, end, sourceBegin, sourceEnd, ax, ay, az, lowX, lowY, lowZ);
+                return;
+            default:
+                break;
+        }
+#endif
+        scalarRange(law, x, y, z, m, begin, end, sourceBegin, sourceEnd, ax, ay, az, lowX, lowY, lowZ);
+    }
+};
+
+#endif
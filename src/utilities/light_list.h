@@ -0,0 +1,209 @@
+#ifndef LIGHT_LIST_H
+#define LIGHT_LIST_H
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "bodies.h"
+#include "frustum.h"
+#include "shader.h"
+#include "uniform_buffer.h"
+
+// Tiled forward lighting for any number of stars. Every star gets a reach that grows with its mass
+// and its light fades to zero there; each frame the visible stars are binned into screen tiles by the
+// rectangle their reach covers, and the fragment shaders look up their own tile and shade only the
+// stars listed for it.
+//
+// The lists live in three texture buffers: the lights (two RGBA32F texels each, position and reach,
+// then ambient color and diffuse strength), one (first, count) pair per tile, and the flat index list
+// the pairs point into. The `lights` uniform block carries the tile grid.
+class lightList {
+public:
+    static constexpr int TILE_SIZE = 16;
+    static constexpr float REACH = 90.0f;    // reach per sqrt(mass), the 500 mass sun lights up to ~2000
+
+    // texture units of the three buffers; unit 0 stays free for the grid's potential map
+    static constexpr int DATA_UNIT = 1;
+    static constexpr int TILES_UNIT = 2;
+    static constexpr int INDEX_UNIT = 3;
+private:
+    // std140 layout of the `lights` block in the lit shaders
+    struct tilingBlock {
+        GLint tileSize;
+        GLint tilesX;
+        GLint tilesY;
+        GLint padding;
+    };
+
+    struct rectangle {
+        int x0, y0, x1, y1;    // covered pixels, inclusive
+    };
+
+    GLuint buffers[3];
+    GLuint textures[3];
+    GLint maxTexels;
+    uniformBuffer tilingBuffer{sizeof(tilingBlock), LIGHTS_BINDING};
+
+    std::vector<GLfloat> lightData;
+    std::vector<rectangle> rectangles;
+    std::vector<GLuint> tileRanges;
+    std::vector<GLuint> lightIndices;
+    std::vector<GLuint> cursors;
+
+    // Pixel rectangle of the light's reach: the projected corners of the view-space box around it,
+    // or the whole screen when the box reaches behind the camera.
+    static rectangle cover(const glm::vec4 &center, float reach, const glm::mat4 &projection, int width, int height) {
+        rectangle full{0, 0, width - 1, height - 1};
+        float minX = 1.0f, minY = 1.0f, maxX = -1.0f, maxY = -1.0f;
+
+        for(int corner = 0; corner < 8; corner++) {
+            glm::vec4 point(center.x + (corner & 1 ? reach : -reach), center.y + (corner & 2 ? reach : -reach), center.z + (corner & 4 ? reach : -reach), 1.0f);
+            glm::vec4 clip = projection * point;
+            if(clip.w <= 1e-4f) return full;
+
+            float x = clip.x / clip.w, y = clip.y / clip.w;
+            minX = std::min(minX, x);
+            minY = std::min(minY, y);
+            maxX = std::max(maxX, x);
+            maxY = std::max(maxY, y);
+        }
+
+        auto pixel = [](float ndc, int size) {
+            return std::clamp((int)std::floor((ndc * 0.5f + 0.5f) * size), 0, size - 1);
+        };
+        return {pixel(minX, width), pixel(minY, height), pixel(maxX, width), pixel(maxY, height)};
+    }
+
+    template<typename Visit>
+    static void forEachTile(const rectangle &covered, int tileSize, int tilesX, Visit visit) {
+        for(int y = covered.y0 / tileSize; y <= covered.y1 / tileSize; y++) {
+            for(int x = covered.x0 / tileSize; x <= covered.x1 / tileSize; x++) visit(y * tilesX + x);
+        }
+    }
+
+    static size_t tileCount(const rectangle &covered, int tileSize) {
+        return (size_t)(covered.x1 / tileSize - covered.x0 / tileSize + 1) * (covered.y1 / tileSize - covered.y0 / tileSize + 1);
+    }
+
+    template<typename T>
+    void upload(int slot, std::vector<T> &values) {
+        // texture buffers may not be empty
+        if(values.empty()) values.emplace_back();
+
+        glBindBuffer(GL_TEXTURE_BUFFER, buffers[slot]);
+        glBufferData(GL_TEXTURE_BUFFER, values.size() * sizeof(T), values.data(), GL_STREAM_DRAW);
+    }
+public:
+    lightList() {
+        glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+        glGenBuffers(3, buffers);
+        glGenTextures(3, textures);
+
+        const GLenum formats[3] = {GL_RGBA32F, GL_RG32UI, GL_R32UI};
+        for(int slot = 0; slot < 3; slot++) {
+            glBindBuffer(GL_TEXTURE_BUFFER, buffers[slot]);
+            glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW);
+            glBindTexture(GL_TEXTURE_BUFFER, textures[slot]);
+            glTexBuffer(GL_TEXTURE_BUFFER, formats[slot], buffers[slot]);
+        }
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+    }
+
+    // Points a lit shader's samplers at the light list's texture units.
+    static void attach(shader &target) {
+        target.bindUniformBlock("lights", LIGHTS_BINDING);
+        target.use();
+        target.setInt("lightData", DATA_UNIT);
+        target.setInt("lightTiles", TILES_UNIT);
+        target.setInt("lightIndices", INDEX_UNIT);
+    }
+
+    // Bins the stars for this frame's camera and uploads the lists. Positions are taken in model space,
+    // the shaders shade in world space.
+    void update(const bodyStore &bodies, const std::vector<uint32_t> &stars, float alpha, const glm::mat4 &model,
+                const glm::mat4 &view, const glm::mat4 &projection, int width, int height) {
+        width = std::max(width, 1);
+        height = std::max(height, 1);
+        frustum visible(projection * view);
+
+        lightData.clear();
+        rectangles.clear();
+        for(uint32_t star : stars) {
+            // two texels per light
+            if((GLint)lightData.size() / 4 + 2 > maxTexels) break;
+
+            glm::vec4 world = model * glm::vec4(bodies.interpolatedX(star, alpha), bodies.interpolatedY(star, alpha), bodies.interpolatedZ(star, alpha), 1.0f);
+            float reach = REACH * std::sqrt(std::max(bodies.mass[star], 0.0f));
+            if(!visible.intersectsSphere(world.x, world.y, world.z, reach)) continue;
+
+            rectangles.push_back(cover(view * world, reach, projection, width, height));
+
+            float light[8] = {
+                world.x, world.y, world.z, reach,
+                bodies.colorR[star] * 0.1f, bodies.colorG[star] * 0.1f, bodies.colorB[star] * 0.1f, 0.5f
+            };
+            lightData.insert(lightData.end(), light, light + 8);
+        }
+
+        // coarser tiles when the index list would not fit the texture buffer
+        int tileSize = TILE_SIZE;
+        for(;;) {
+            size_t total = 0;
+            for(const rectangle &covered : rectangles) total += tileCount(covered, tileSize);
+
+            int tilesX = (width + tileSize - 1) / tileSize, tilesY = (height + tileSize - 1) / tileSize;
+            if((total <= (size_t)maxTexels && (size_t)tilesX * tilesY <= (size_t)maxTexels) || tileSize >= std::max(width, height)) break;
+            tileSize *= 2;
+        }
+        int tilesX = (width + tileSize - 1) / tileSize, tilesY = (height + tileSize - 1) / tileSize;
+        int tiles = tilesX * tilesY;
+
+        // count, prefix sum, then scatter the light indices into their tiles
+        cursors.assign(tiles, 0);
+        for(const rectangle &covered : rectangles) {
+            forEachTile(covered, tileSize, tilesX, [&](int tile) { cursors[tile]++; });
+        }
+
+        tileRanges.resize(2 * tiles);
+        GLuint first = 0;
+        for(int tile = 0; tile < tiles; tile++) {
+            tileRanges[2 * tile] = first;
+            tileRanges[2 * tile + 1] = cursors[tile];
+            cursors[tile] = first;
+            first += tileRanges[2 * tile + 1];
+        }
+
+        lightIndices.resize(first);
+        for(GLuint light = 0; light < rectangles.size(); light++) {
+            forEachTile(rectangles[light], tileSize, tilesX, [&](int tile) { lightIndices[cursors[tile]++] = light; });
+        }
+
+        upload(0, lightData);
+        upload(1, tileRanges);
+        upload(2, lightIndices);
+
+        tilingBlock tiling{tileSize, tilesX, tilesY, 0};
+        tilingBuffer.update(&tiling, sizeof(tiling));
+    }
+
+    void bind() {
+        const int units[3] = {DATA_UNIT, TILES_UNIT, INDEX_UNIT};
+        for(int slot = 0; slot < 3; slot++) {
+            glActiveTexture(GL_TEXTURE0 + units[slot]);
+            glBindTexture(GL_TEXTURE_BUFFER, textures[slot]);
+        }
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    lightList(const lightList&) = delete;
+    lightList& operator=(const lightList&) = delete;
+
+    ~lightList() {
+        glDeleteTextures(3, textures);
+        glDeleteBuffers(3, buffers);
+    }
+};
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+#include <cstddef>
+#include <string>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read-only memory map of a whole file. Pages are faulted in on first touch, so opening is
+// constant time and reading costs no more than the bytes actually used.
+class mappedFile {
+private:
+    const unsigned char *bytes = nullptr;
+    size_t length = 0;
+
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+public:
+    mappedFile() = default;
+
+    mappedFile(const mappedFile&) = delete;
+    mappedFile& operator=(const mappedFile&) = delete;
+
+    ~mappedFile() {
+        close();
+    }
+
+    bool open(const std::string &path) {
+        close();
+
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if(file == INVALID_HANDLE_VALUE) return false;
+
+        LARGE_INTEGER fileSize;
+        if(!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+            close();
+            return false;
+        }
+        length = (size_t)fileSize.QuadPart;
+
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if(!mapping) {
+            close();
+            return false;
+        }
+
+        bytes = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if(!bytes) {
+            close();
+            return false;
+        }
+#else
+        int descriptor = ::open(path.c_str(), O_RDONLY);
+        if(descriptor < 0) return false;
+
+        struct stat info;
+        if(fstat(descriptor, &info) != 0 || info.st_size == 0) {
+            ::close(descriptor);
+            return false;
+        }
+        length = (size_t)info.st_size;
+
+        void *view = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        ::close(descriptor);
+
+        if(view == MAP_FAILED) {
+            length = 0;
+            return false;
+        }
+        // the whole file is about to be copied front to back
+        madvise(view, length, MADV_SEQUENTIAL);
+        bytes = (const unsigned char*)view;
+#endif
+        return true;
+    }
+
+    void close() {
+#ifdef _WIN32
+        if(bytes) UnmapViewOfFile(bytes);
+        if(mapping) CloseHandle(mapping);
+        if(file != INVALID_HANDLE_VALUE) CloseHandle(file);
+
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if(bytes) munmap((void*)bytes, length);
+#endif
+        bytes = nullptr;
+        length = 0;
+    }
+
+    const unsigned char* data() const { return bytes; }
+    size_t size() const { return length; }
+};
+
+#endif
@@ -0,0 +1,299 @@
+#ifndef OCTREE_H
+#define OCTREE_H
+#include <vector>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <type_traits>
+#include "force_law.h"
+#include "profiler.h"
+
+// Barnes-Hut tree, rebuilt from scratch every step. Bodies are referenced by index,
+// positions and masses are read from plain arrays so the tree knows nothing about objects.
+class octree {
+private:
+    struct node {
+        float centerX, centerY, centerZ;
+        float halfSize;
+
+        float massX, massY, massZ;
+        float mass;
+
+        uint32_t firstChild;
+        uint32_t childCount;
+
+        uint32_t begin;
+        uint32_t count;
+    };
+
+    static constexpr uint32_t LEAF_SIZE = 8;
+    static constexpr int MAX_DEPTH = 32;
+
+    std::vector<node> nodes;
+    std::vector<uint32_t> order;
+    std::vector<uint32_t> scratch;
+
+    const float *posX = nullptr, *posY = nullptr, *posZ = nullptr;
+    const float *masses = nullptr;
+    // low-order position residuals added to leaf separations by double-precision laws, may be null
+    const float *lowX = nullptr, *lowY = nullptr, *lowZ = nullptr;
+
+    void buildNode(uint32_t index, int depth) {
+        node current = nodes[index];
+
+        if(current.count <= LEAF_SIZE || depth >= MAX_DEPTH) {
+            float mass = 0.0f, mx = 0.0f, my = 0.0f, mz = 0.0f;
+
+            for(uint32_t k = current.begin; k < current.begin + current.count; k++) {
+                uint32_t body = order[k];
+
+                mass += masses[body];
+                mx += masses[body] * posX[body];
+                my += masses[body] * posY[body];
+                mz += masses[body] * posZ[body];
+            }
+            setMass(nodes[index], mass, mx, my, mz);
+            return;
+        }
+
+        uint32_t octantCount[8] = {};
+        for(uint32_t k = current.begin; k < current.begin + current.count; k++) {
+            octantCount[octant(current, order[k])]++;
+        }
+
+        uint32_t octantStart[8];
+        uint32_t offset = current.begin;
+        for(int o = 0; o < 8; o++) {
+            octantStart[o] = offset;
+            offset += octantCount[o];
+        }
+
+        uint32_t cursor[8];
+        std::copy(octantStart, octantStart + 8, cursor);
+        for(uint32_t k = current.begin; k < current.begin + current.count; k++) {
+            scratch[cursor[octant(current, order[k])]++] = order[k];
+        }
+        std::copy(scratch.begin() + current.begin, scratch.begin() + current.begin + current.count, order.begin() + current.begin);
+
+        uint32_t firstChild = nodes.size();
+        uint32_t childCount = 0;
+        float childHalf = current.halfSize * 0.5f;
+
+        for(int o = 0; o < 8; o++) {
+            if(octantCount[o] == 0) continue;
+
+            node child{};
+            child.centerX = current.centerX + ((o & 1) ? childHalf : -childHalf);
+            child.centerY = current.centerY + ((o & 2) ? childHalf : -childHalf);
+            child.centerZ = current.centerZ + ((o & 4) ? childHalf : -childHalf);
+            child.halfSize = childHalf;
+            child.begin = octantStart[o];
+            child.count = octantCount[o];
+
+            nodes.push_back(child);
+            childCount++;
+        }
+        nodes[index].firstChild = firstChild;
+        nodes[index].childCount = childCount;
+
+        float mass = 0.0f, mx = 0.0f, my = 0.0f, mz = 0.0f;
+        for(uint32_t c = firstChild; c < firstChild + childCount; c++) {
+            buildNode(c, depth + 1);
+
+            mass += nodes[c].mass;
+            mx += nodes[c].mass * nodes[c].massX;
+            my += nodes[c].mass * nodes[c].massY;
+            mz += nodes[c].mass * nodes[c].massZ;
+        }
+        setMass(nodes[index], mass, mx, my, mz);
+    }
+
+    void setMass(node &target, float mass, float mx, float my, float mz) {
+        target.mass = mass;
+
+        if(mass > 0.0f) {
+            target.massX = mx / mass;
+            target.massY = my / mass;
+            target.massZ = mz / mass;
+        }
+        else {
+            target.massX = target.centerX;
+            target.massY = target.centerY;
+            target.massZ = target.centerZ;
+        }
+    }
+
+    int octant(const node &parent, uint32_t body) const {
+        return (posX[body] >= parent.centerX ? 1 : 0)
+             | (posY[body] >= parent.centerY ? 2 : 0)
+             | (posZ[body] >= parent.centerZ ? 4 : 0);
+    }
+
+    template<typename Law, typename Real>
+    static void accumulate(const Law &law, Real dx, Real dy, Real dz, float mass, Real &ax, Real &ay, Real &az) {
+        Real scale = law(dx * dx + dy * dy + dz * dz, (Real)mass);
+
+        ax += dx * scale;
+        ay += dy * scale;
+        az += dz * scale;
+    }
+public:
+    void build(const float *x, const float *y, const float *z, const float *m, size_t count,
+               const float *residualX = nullptr, const float *residualY = nullptr, const float *residualZ = nullptr) {
+        PROFILE_SCOPE("tree build");
+        posX = x;
+        posY = y;
+        posZ = z;
+        masses = m;
+        lowX = residualX;
+        lowY = residualY;
+        lowZ = residualZ;
+
+        nodes.clear();
+        order.resize(count);
+        scratch.resize(count);
+        if(count == 0) return;
+
+        float minX = x[0], minY = y[0], minZ = z[0];
+        float maxX = x[0], maxY = y[0], maxZ = z[0];
+        for(size_t i = 0; i < count; i++) {
+            order[i] = i;
+
+            minX = std::min(minX, x[i]); maxX = std::max(maxX, x[i]);
+            minY = std::min(minY, y[i]); maxY = std::max(maxY, y[i]);
+            minZ = std::min(minZ, z[i]); maxZ = std::max(maxZ, z[i]);
+        }
+
+        node root{};
+        root.centerX = 0.5f * (minX + maxX);
+        root.centerY = 0.5f * (minY + maxY);
+        root.centerZ = 0.5f * (minZ + maxZ);
+        root.halfSize = 0.5f * std::max({maxX - minX, maxY - minY, maxZ - minZ}) * 1.001f + 1e-3f;
+        root.begin = 0;
+        root.count = count;
+
+        nodes.reserve(2 * count / LEAF_SIZE + 8);
+        nodes.push_back(root);
+        buildNode(0, 0);
+    }
+
+    // Acceleration on a single body, opening every node whose size/distance ratio is at least theta.
+    template<typename Law>
+    void accelerationAt(const Law &law, uint32_t body, float theta, float &outX, float &outY, float &outZ) const {
+        using real = typename Law::real;
+
+        outX = outY = outZ = 0.0f;
+        if(nodes.empty()) return;
+
+        const float px = posX[body], py = posY[body], pz = posZ[body];
+        const float theta2 = theta * theta;
+        const bool residuals = !std::is_same_v<real, float> && lowX;
+        real ax = 0, ay = 0, az = 0;
+
+        uint32_t stack[8 * MAX_DEPTH + 8];
+        int top = 0;
+        stack[top++] = 0;
+
+        while(top > 0) {
+            const node &current = nodes[stack[--top]];
+
+            if(current.childCount == 0) {
+                for(uint32_t k = current.begin; k < current.begin + current.count; k++) {
+                    uint32_t other = order[k];
+                    if(other == body) continue;
+
+                    real dx = (real)posX[other] - px, dy = (real)posY[other] - py, dz = (real)posZ[other] - pz;
+                    if(residuals) {
+                        dx += (real)lowX[other] - (real)lowX[body];
+                        dy += (real)lowY[other] - (real)lowY[body];
+                        dz += (real)lowZ[other] - (real)lowZ[body];
+                    }
+                    accumulate(law, dx, dy, dz, masses[other], ax, ay, az);
+                }
+                continue;
+            }
+
+            float dx = current.massX - px;
+            float dy = current.massY - py;
+            float dz = current.massZ - pz;
+            float r2 = dx * dx + dy * dy + dz * dz;
+            float size = 2.0f * current.halfSize;
+
+            bool inside = std::fabs(px - current.centerX) <= current.halfSize
+                       && std::fabs(py - current.centerY) <= current.halfSize
+                       && std::fabs(pz - current.centerZ) <= current.halfSize;
+
+            if(!inside && size * size < theta2 * r2) {
+                accumulate(law, (real)current.massX - px, (real)current.massY - py, (real)current.massZ - pz, current.mass, ax, ay, az);
+                continue;
+            }
+
+            for(uint32_t c = current.firstChild; c < current.firstChild + current.childCount; c++) {
+                stack[top++] = c;
+            }
+        }
+
+        outX = (float)ax;
+        outY = (float)ay;
+        outZ = (float)az;
+    }
+
+    template<typename Law>
+    void computeAccelerations(const Law &law, float theta, float *ax, float *ay, float *az) const {
+        computeAccelerations(law, theta, 0, order.size(), ax, ay, az);
+    }
+
+    template<typename Law>
+    void computeAccelerations(const Law &law, float theta, size_t begin, size_t end, float *ax, float *ay, float *az) const {
+        for(uint32_t i = begin; i < end; i++) {
+            accelerationAt(law, i, theta, ax[i], ay[i], az[i]);
+        }
+    }
+
+    // Walks the tree on behalf of targets anywhere inside the box [lower, upper], as another rank sees
+    // it: nodes every such target would accept under theta go to summary(x, y, z, mass) as a point mass
+    // at their center of mass, the bodies of leaves that would be opened go to body(index).
+    template<typename Summary, typename Body>
+    void forEachEssential(const float *lower, const float *upper, float theta, Summary summary, Body body) const {
+        if(nodes.empty()) return;
+
+        const float theta2 = theta * theta;
+        uint32_t stack[8 * MAX_DEPTH + 8];
+        int top = 0;
+        stack[top++] = 0;
+
+        while(top > 0) {
+            const node &current = nodes[stack[--top]];
+
+            // distance from the center of mass to the nearest point of the box
+            float dx = std::max({lower[0] - current.massX, 0.0f, current.massX - upper[0]});
+            float dy = std::max({lower[1] - current.massY, 0.0f, current.massY - upper[1]});
+            float dz = std::max({lower[2] - current.massZ, 0.0f, current.massZ - upper[2]});
+            float r2 = dx * dx + dy * dy + dz * dz;
+            float size = 2.0f * current.halfSize;
+
+            bool overlaps = current.centerX + current.halfSize >= lower[0] && current.centerX - current.halfSize <= upper[0]
+                         && current.centerY + current.halfSize >= lower[1] && current.centerY - current.halfSize <= upper[1]
+                         && current.centerZ + current.halfSize >= lower[2] && current.centerZ - current.halfSize <= upper[2];
+
+            if(!overlaps && size * size < theta2 * r2) {
+                summary(current.massX, current.massY, current.massZ, current.mass);
+                continue;
+            }
+
+            if(current.childCount == 0) {
+                for(uint32_t k = current.begin; k < current.begin + current.count; k++) body(order[k]);
+                continue;
+            }
+
+            for(uint32_t c = current.firstChild; c < current.firstChild + current.childCount; c++) {
+                stack[top++] = c;
+            }
+        }
+    }
+
+    size_t nodeCount() const { return nodes.size(); }
+};
+
+#endif
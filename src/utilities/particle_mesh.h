@@ -0,0 +1,532 @@
+#ifndef PARTICLE_MESH_H
+#define PARTICLE_MESH_H
+#include <vector>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <algorithm>
+#include <random>
+#include "fft.h"
+#include "thread_pool.h"
+
+enum class massAssignment {
+    cic,
+    tsc
+};
+
+// Particle-mesh gravity on an isolated cubic grid, rebuilt every step. Masses are spread onto
+// gridSize^3 cells (cloud-in-cell or triangular-shaped-cloud), convolved with the softened Green's
+// function through a zero-padded FFT of twice the size, and forces are taken as central differences
+// of the potential, interpolated back with the same weights so a body does not push itself.
+//
+// The Green's function is -gravity / sqrt(r^2 + (SOFTENING_CELLS * h)^2) in cell units scaled by 1 / h,
+// so its spectrum is computed once per grid size. Mesh forces match the pair loop to within a few
+// percent past SHORT_RANGE_CELLS and are smoothed below that, so on its own the mesh is a far-field
+// solver for systems resolved by the grid. With the short-range correction on, pairs closer than that
+// get the exact law minus the mesh's own orientation-averaged pair force (P3M), found through a
+// chaining mesh; that part costs O(N * neighbours) and grows quickly in dense clumps.
+//
+// The box covers the bulk of the bodies: the CLIP fraction furthest out on each side of each axis is
+// ignored, and the box is kept while the bulk stays inside and fills at least half of it, so a few
+// escapers neither coarsen the cells nor move the grid every step. Up to MAX_OUTSIDE bodies outside it
+// are summed directly, both ways; past that the box grows to hold everyone.
+class particleMesh {
+private:
+    static constexpr int MARGIN = 3;
+    static constexpr float SOFTENING_CELLS = 0.5f;
+
+    static constexpr int SHORT_RANGE_CELLS = 4;
+    static constexpr int TABLE_BINS_PER_CELL = 16;
+    static constexpr int TABLE_SAMPLES = 64;
+
+    static constexpr double CLIP = 1e-3;
+    static constexpr float SLACK = 0.0625f;
+    static constexpr size_t MAX_OUTSIDE = 256;
+
+    int gridSize = 0;
+    int padded = 0;
+    massAssignment assignment = massAssignment::cic;
+    bool shortRange = false;
+
+    float spacing = 1.0f;
+    float originX = 0.0f, originY = 0.0f, originZ = 0.0f;
+
+    bool haveBox = false;
+    float boxX = 0.0f, boxY = 0.0f, boxZ = 0.0f;
+    float boxExtent = 0.0f;
+    std::vector<float> scratch;
+
+    std::vector<uint8_t> outsideFlags;
+    std::vector<uint32_t> outside;
+
+    // orientation-averaged radial mesh force of a unit mass, in cell units, by distance in cells
+    std::vector<float> meshForce;
+
+    // bodies inside the box sorted by chaining cell, SHORT_RANGE_CELLS grid cells wide
+    int chainSize = 0;
+    std::vector<uint32_t> chainStart;
+    std::vector<uint32_t> chainOrder;
+    std::vector<uint32_t> chainCursor;
+
+    // real spectrum of the Green's function, only bins x <= padded / 2
+    std::vector<float> greenSpectrum;
+    std::vector<fft::complex> work;
+    std::vector<float> potential;
+
+    const float *posX = nullptr, *posY = nullptr, *posZ = nullptr;
+    const float *masses = nullptr;
+    size_t bodyCount = 0;
+
+    const float gravity;
+
+    template<typename Function>
+    static void forEachTask(threadPool *workers, size_t tasks, Function function) {
+        if(!workers) {
+            for(size_t task = 0; task < tasks; task++) function(task);
+            return;
+        }
+        workers->parallelFor(tasks, [&](size_t task, unsigned) { function(task); });
+    }
+
+    size_t columns() const { return padded / 2 + 1; }
+
+    fft::complex* cell(int x, int y, int z) {
+        return &work[((size_t)z * padded + y) * padded + x];
+    }
+
+    // First cell of the stencil along one axis and its weights; returns the stencil width.
+    int weights(float u, int &first, float (&w)[3]) const {
+        if(assignment == massAssignment::tsc) {
+            int nearest = (int)std::floor(u + 0.5f);
+            float d = u - nearest;
+
+            first = nearest - 1;
+            w[0] = 0.5f * (0.5f - d) * (0.5f - d);
+            w[1] = 0.75f - d * d;
+            w[2] = 0.5f * (0.5f + d) * (0.5f + d);
+            return 3;
+        }
+
+        first = (int)std::floor(u);
+        float f = u - first;
+
+        w[0] = 1.0f - f;
+        w[1] = f;
+        return 2;
+    }
+
+    // Forward 3D transform of a real grid whose nonzero cells all lie in the first `filled` rows and planes.
+    void forward(threadPool *workers, int filled) {
+        const int n = padded;
+        const size_t cols = columns();
+
+        forEachTask(workers, filled, [&](size_t z) {
+            for(int y = 0; y < filled; y += 2) fft::transformRealPair(cell(0, y, z), cell(0, y + 1, z), n, false);
+            fft::transformStrided(cell(0, 0, z), n, cols, n, false);
+        });
+        forEachTask(workers, n, [&](size_t y) {
+            fft::transformStrided(cell(0, y, 0), n, cols, (size_t)n * n, false);
+        });
+    }
+
+    // Inverse of forward(), producing only the first `needed` rows and planes.
+    void inverse(threadPool *workers, int needed) {
+        const int n = padded;
+        const size_t cols = columns();
+
+        forEachTask(workers, n, [&](size_t y) {
+            fft::transformStrided(cell(0, y, 0), n, cols, (size_t)n * n, true);
+        });
+        forEachTask(workers, needed, [&](size_t z) {
+            fft::transformStrided(cell(0, 0, z), n, cols, n, true);
+            for(int y = 0; y < needed; y += 2) fft::transformRealPair(cell(0, y, z), cell(0, y + 1, z), n, true);
+        });
+    }
+
+    void buildGreenSpectrum(threadPool *workers) {
+        const int n = padded;
+        work.assign((size_t)n * n * n, fft::complex(0.0f, 0.0f));
+
+        forEachTask(workers, n, [&](size_t z) {
+            int dz = (int)z < n / 2 ? (int)z : (int)z - n;
+
+            for(int y = 0; y < n; y++) {
+                int dy = y < n / 2 ? y : y - n;
+
+                for(int x = 0; x < n; x++) {
+                    int dx = x < n / 2 ? x : x - n;
+                    float r2 = (float)(dx * dx + dy * dy + dz * dz);
+
+                    *cell(x, y, z) = -1.0f / std::sqrt(r2 + SOFTENING_CELLS * SOFTENING_CELLS);
+                }
+            }
+        });
+        forward(workers, n);
+
+        const size_t cols = columns();
+        greenSpectrum.resize((size_t)n * n * cols);
+        for(size_t row = 0; row < (size_t)n * n; row++) {
+            for(size_t x = 0; x < cols; x++) greenSpectrum[row * cols + x] = work[row * n + x].real();
+        }
+    }
+
+    float potentialAt(int x, int y, int z) const {
+        return potential[((size_t)z * gridSize + y) * gridSize + x];
+    }
+
+    // Mesh force on a test point at t from a unit mass at s (both in cells, gravity 1), computed from the
+    // assignment stencils and the real-space Green's function the FFT convolves with.
+    void stencilForce(const float (&s)[3], const float (&t)[3], double (&force)[3]) const {
+        int sourceFirst[3], testFirst[3];
+        float sourceW[3][3], testW[3][3];
+        int width = 0;
+        for(int axis = 0; axis < 3; axis++) {
+            width = weights(s[axis], sourceFirst[axis], sourceW[axis]);
+            weights(t[axis], testFirst[axis], testW[axis]);
+        }
+
+        auto potentialAtNode = [&](int x, int y, int z) {
+            double sum = 0.0;
+            for(int c = 0; c < width; c++) {
+                for(int b = 0; b < width; b++) {
+                    for(int a = 0; a < width; a++) {
+                        double dx = x - sourceFirst[0] - a, dy = y - sourceFirst[1] - b, dz = z - sourceFirst[2] - c;
+                        sum -= sourceW[0][a] * sourceW[1][b] * sourceW[2][c] / std::sqrt(dx * dx + dy * dy + dz * dz + SOFTENING_CELLS * SOFTENING_CELLS);
+                    }
+                }
+            }
+            return sum;
+        };
+
+        force[0] = force[1] = force[2] = 0.0;
+        for(int c = 0; c < width; c++) {
+            for(int b = 0; b < width; b++) {
+                for(int a = 0; a < width; a++) {
+                    int x = testFirst[0] + a, y = testFirst[1] + b, z = testFirst[2] + c;
+                    double weight = 0.5 * testW[0][a] * testW[1][b] * testW[2][c];
+
+                    force[0] -= weight * (potentialAtNode(x + 1, y, z) - potentialAtNode(x - 1, y, z));
+                    force[1] -= weight * (potentialAtNode(x, y + 1, z) - potentialAtNode(x, y - 1, z));
+                    force[2] -= weight * (potentialAtNode(x, y, z + 1) - potentialAtNode(x, y, z - 1));
+                }
+            }
+        }
+    }
+
+    // Tabulates the mesh pair force against distance, averaged over random orientations and offsets
+    // within a cell. Depends only on the assignment scheme, with a fixed seed so runs repeat.
+    void buildForceTable(threadPool *workers) {
+        const int bins = SHORT_RANGE_CELLS * TABLE_BINS_PER_CELL + 1;
+        meshForce.assign(bins, 0.0f);
+
+        forEachTask(workers, bins, [&](size_t bin) {
+            std::mt19937 rng(7919u * (uint32_t)bin + 1u);
+            std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+            const float distance = (float)bin / TABLE_BINS_PER_CELL;
+
+            double sum = 0.0;
+            for(int sample = 0; sample < TABLE_SAMPLES; sample++) {
+                // uniform direction, source anywhere in a cell well inside the stencil range
+                float cosine = 2.0f * unit(rng) - 1.0f, angle = 6.2831853f * unit(rng);
+                float sine = std::sqrt(std::max(0.0f, 1.0f - cosine * cosine));
+                float direction[3] = {sine * std::cos(angle), sine * std::sin(angle), cosine};
+
+                float source[3], test[3];
+                for(int axis = 0; axis < 3; axis++) {
+                    source[axis] = 16.0f + unit(rng);
+                    test[axis] = source[axis] + distance * direction[axis];
+                }
+
+                double force[3];
+                stencilForce(source, test, force);
+                sum -= force[0] * direction[0] + force[1] * direction[1] + force[2] * direction[2];
+            }
+            meshForce[bin] = (float)(sum / TABLE_SAMPLES);
+        });
+    }
+
+    // Radial mesh pull of a unit mass at `cells` cell widths, linear between table bins.
+    float tabulatedForce(float cells) const {
+        float u = cells * TABLE_BINS_PER_CELL;
+        int bin = std::min((int)u, (int)meshForce.size() - 2);
+        float f = u - bin;
+        return meshForce[bin] * (1.0f - f) + meshForce[bin + 1] * f;
+    }
+
+    bool insideBox(float x, float y, float z) const {
+        return x >= boxX && x <= boxX + boxExtent && y >= boxY && y <= boxY + boxExtent && z >= boxZ && z <= boxZ + boxExtent;
+    }
+
+    // the value with `rank` smaller ones along one axis
+    float quantile(const float *values, size_t count, size_t rank) {
+        scratch.assign(values, values + count);
+        std::nth_element(scratch.begin(), scratch.begin() + rank, scratch.end());
+        return scratch[rank];
+    }
+
+    // Refits the box to the bulk if it has left the box or shrunk below half of it, then collects the
+    // bodies outside. Too many of those and the box covers every body instead.
+    void fitBox(const float *x, const float *y, const float *z, size_t count) {
+        const size_t low = (size_t)(CLIP * count), high = count - 1 - low;
+        float bulkMin[3], bulkMax[3];
+        const float *axes[3] = {x, y, z};
+        for(int axis = 0; axis < 3; axis++) {
+            bulkMin[axis] = quantile(axes[axis], count, low);
+            bulkMax[axis] = low == 0 ? *std::max_element(axes[axis], axes[axis] + count) : quantile(axes[axis], count, high);
+        }
+
+        auto cover = [&](const float (&minimum)[3], const float (&maximum)[3]) {
+            float extent = std::max({maximum[0] - minimum[0], maximum[1] - minimum[1], maximum[2] - minimum[2], 1e-3f});
+            boxExtent = extent * (1.0f + 2.0f * SLACK);
+            boxX = 0.5f * (minimum[0] + maximum[0]) - 0.5f * boxExtent;
+            boxY = 0.5f * (minimum[1] + maximum[1]) - 0.5f * boxExtent;
+            boxZ = 0.5f * (minimum[2] + maximum[2]) - 0.5f * boxExtent;
+        };
+
+        float bulkExtent = std::max({bulkMax[0] - bulkMin[0], bulkMax[1] - bulkMin[1], bulkMax[2] - bulkMin[2]});
+        bool keep = haveBox && insideBox(bulkMin[0], bulkMin[1], bulkMin[2]) && insideBox(bulkMax[0], bulkMax[1], bulkMax[2])
+                 && bulkExtent >= 0.5f * boxExtent;
+        if(!keep) cover(bulkMin, bulkMax);
+        haveBox = true;
+
+        outsideFlags.assign(count, 0);
+        outside.clear();
+        for(uint32_t i = 0; i < count; i++) {
+            if(insideBox(x[i], y[i], z[i])) continue;
+            outsideFlags[i] = 1;
+            outside.push_back(i);
+        }
+        if(outside.size() <= MAX_OUTSIDE) return;
+
+        float allMin[3], allMax[3];
+        for(int axis = 0; axis < 3; axis++) {
+            allMin[axis] = *std::min_element(axes[axis], axes[axis] + count);
+            allMax[axis] = *std::max_element(axes[axis], axes[axis] + count);
+        }
+        cover(allMin, allMax);
+        outsideFlags.assign(count, 0);
+        outside.clear();
+    }
+
+    int chainCell(float position, float origin) const {
+        int cell = (int)((position - origin) / (spacing * SHORT_RANGE_CELLS));
+        return std::min(std::max(cell, 0), chainSize - 1);
+    }
+
+    size_t chainIndex(float x, float y, float z) const {
+        return ((size_t)chainCell(z, originZ) * chainSize + chainCell(y, originY)) * chainSize + chainCell(x, originX);
+    }
+
+    void buildChains(size_t count) {
+        chainSize = (gridSize + SHORT_RANGE_CELLS - 1) / SHORT_RANGE_CELLS;
+        const size_t cells = (size_t)chainSize * chainSize * chainSize;
+
+        chainStart.assign(cells + 1, 0);
+        for(size_t i = 0; i < count; i++) {
+            if(!outsideFlags[i]) chainStart[chainIndex(posX[i], posY[i], posZ[i]) + 1]++;
+        }
+        for(size_t cell = 0; cell < cells; cell++) chainStart[cell + 1] += chainStart[cell];
+
+        chainOrder.resize(chainStart[cells]);
+        chainCursor.assign(chainStart.begin(), chainStart.end() - 1);
+        for(uint32_t i = 0; i < count; i++) {
+            if(!outsideFlags[i]) chainOrder[chainCursor[chainIndex(posX[i], posY[i], posZ[i])]++] = i;
+        }
+    }
+
+    // Adds the pull of `other` under the full force law, minus the mesh's share when `meshShare` is set.
+    template<typename Law>
+    void addPair(const Law &law, uint32_t body, uint32_t other, bool meshShare, typename Law::real &ax, typename Law::real &ay, typename Law::real &az) const {
+        using real = typename Law::real;
+
+        real dx = (real)posX[other] - (real)posX[body];
+        real dy = (real)posY[other] - (real)posY[body];
+        real dz = (real)posZ[other] - (real)posZ[body];
+        real r2 = dx * dx + dy * dy + dz * dz;
+        if(r2 <= real(0)) return;
+
+        real pull = law(r2, (real)masses[other]);
+        if(meshShare) {
+            real r = std::sqrt(r2);
+            pull -= (real)gravity * (real)masses[other] * (real)tabulatedForce((float)r / spacing) / ((real)spacing * (real)spacing * r);
+        }
+
+        ax += dx * pull;
+        ay += dy * pull;
+        az += dz * pull;
+    }
+
+    // The exact law minus the mesh share for every body within SHORT_RANGE_CELLS of body.
+    template<typename Law>
+    void correctShortRange(const Law &law, uint32_t body, typename Law::real &ax, typename Law::real &ay, typename Law::real &az) const {
+        const float range = spacing * SHORT_RANGE_CELLS;
+        const int cx = chainCell(posX[body], originX), cy = chainCell(posY[body], originY), cz = chainCell(posZ[body], originZ);
+        for(int z = std::max(cz - 1, 0); z <= std::min(cz + 1, chainSize - 1); z++) {
+            for(int y = std::max(cy - 1, 0); y <= std::min(cy + 1, chainSize - 1); y++) {
+                for(int x = std::max(cx - 1, 0); x <= std::min(cx + 1, chainSize - 1); x++) {
+                    size_t cell = ((size_t)z * chainSize + y) * chainSize + x;
+
+                    for(uint32_t k = chainStart[cell]; k < chainStart[cell + 1]; k++) {
+                        uint32_t other = chainOrder[k];
+                        float dx = posX[other] - posX[body], dy = posY[other] - posY[body], dz = posZ[other] - posZ[body];
+                        if(dx * dx + dy * dy + dz * dz < range * range) addPair(law, body, other, true, ax, ay, az);
+                    }
+                }
+            }
+        }
+    }
+public:
+    particleMesh(float gravity) : gravity(gravity) {}
+
+    static const char* name(massAssignment scheme) {
+        return scheme == massAssignment::tsc ? "tsc" : "cic";
+    }
+
+    static massAssignment fromName(const std::string &name) {
+        return name == "tsc" ? massAssignment::tsc : massAssignment::cic;
+    }
+
+    // Grid size is rounded up to a power of two, at least 16 cells per side.
+    void configure(int cells, massAssignment scheme, bool correction = false) {
+        int size = (int)fft::nextPowerOfTwo(std::max(cells, 16));
+        if(scheme != assignment) meshForce.clear();
+        assignment = scheme;
+        shortRange = correction;
+
+        if(size == gridSize) return;
+        gridSize = size;
+        padded = 2 * size;
+        greenSpectrum.clear();
+    }
+
+    void build(const float *x, const float *y, const float *z, const float *m, size_t count, threadPool *workers) {
+        posX = x;
+        posY = y;
+        posZ = z;
+        masses = m;
+        bodyCount = count;
+
+        if(gridSize == 0) configure(64, assignment);
+        if(greenSpectrum.empty()) buildGreenSpectrum(workers);
+        if(shortRange && meshForce.empty()) buildForceTable(workers);
+        if(count == 0) return;
+
+        fitBox(x, y, z, count);
+
+        // bodies stay MARGIN cells away from the faces so stencils and differences never leave the grid
+        spacing = boxExtent * 1.001f / (gridSize - 1 - 2 * MARGIN);
+        originX = boxX - MARGIN * spacing;
+        originY = boxY - MARGIN * spacing;
+        originZ = boxZ - MARGIN * spacing;
+        if(shortRange) buildChains(count);
+
+        const int n = padded;
+        forEachTask(workers, n, [&](size_t plane) {
+            std::fill(cell(0, 0, plane), cell(0, 0, plane) + (size_t)n * n, fft::complex(0.0f, 0.0f));
+        });
+
+        for(size_t i = 0; i < count; i++) {
+            if(outsideFlags[i]) continue;
+
+            int first[3];
+            float w[3][3];
+            int width = weights((x[i] - originX) / spacing, first[0], w[0]);
+            weights((y[i] - originY) / spacing, first[1], w[1]);
+            weights((z[i] - originZ) / spacing, first[2], w[2]);
+
+            for(int c = 0; c < width; c++) {
+                for(int b = 0; b < width; b++) {
+                    fft::complex *row = cell(first[0], first[1] + b, first[2] + c);
+                    float plane = m[i] * w[2][c] * w[1][b];
+
+                    for(int a = 0; a < width; a++) row[a] += plane * w[0][a];
+                }
+            }
+        }
+
+        forward(workers, gridSize);
+
+        const size_t cols = columns();
+        const float scale = gravity / spacing;
+        forEachTask(workers, n, [&](size_t z) {
+            for(int y = 0; y < n; y++) {
+                size_t row = (size_t)z * n + y;
+                for(size_t x = 0; x < cols; x++) work[row * n + x] *= scale * greenSpectrum[row * cols + x];
+            }
+        });
+
+        inverse(workers, gridSize);
+
+        potential.resize((size_t)gridSize * gridSize * gridSize);
+        forEachTask(workers, gridSize, [&](size_t z) {
+            for(int y = 0; y < gridSize; y++) {
+                for(int x = 0; x < gridSize; x++) potential[((size_t)z * gridSize + y) * gridSize + x] = cell(x, y, z)->real();
+            }
+        });
+    }
+
+    // Mesh force plus the short-range correction when it is on and the pull of the bodies outside the
+    // box; those themselves are summed directly over every body.
+    template<typename Law>
+    void accelerationAt(const Law &law, uint32_t body, float &outX, float &outY, float &outZ) const {
+        using real = typename Law::real;
+
+        outX = outY = outZ = 0.0f;
+        if(potential.empty()) return;
+
+        real ax = 0, ay = 0, az = 0;
+        if(outsideFlags[body]) {
+            for(uint32_t other = 0; other < bodyCount; other++) addPair(law, body, other, false, ax, ay, az);
+            outX = (float)ax; outY = (float)ay; outZ = (float)az;
+            return;
+        }
+
+        int first[3];
+        float w[3][3];
+        int width = weights((posX[body] - originX) / spacing, first[0], w[0]);
+        weights((posY[body] - originY) / spacing, first[1], w[1]);
+        weights((posZ[body] - originZ) / spacing, first[2], w[2]);
+
+        const float inverseTwoH = 0.5f / spacing;
+
+        for(int c = 0; c < width; c++) {
+            for(int b = 0; b < width; b++) {
+                for(int a = 0; a < width; a++) {
+                    int x = first[0] + a, y = first[1] + b, z = first[2] + c;
+                    float weight = w[0][a] * w[1][b] * w[2][c];
+
+                    outX -= weight * (potentialAt(x + 1, y, z) - potentialAt(x - 1, y, z)) * inverseTwoH;
+                    outY -= weight * (potentialAt(x, y + 1, z) - potentialAt(x, y - 1, z)) * inverseTwoH;
+                    outZ -= weight * (potentialAt(x, y, z + 1) - potentialAt(x, y, z - 1)) * inverseTwoH;
+                }
+            }
+        }
+
+        if(shortRange) correctShortRange(law, body, ax, ay, az);
+        for(uint32_t other : outside) addPair(law, body, other, false, ax, ay, az);
+
+        outX += (float)ax;
+        outY += (float)ay;
+        outZ += (float)az;
+    }
+
+    template<typename Law>
+    void computeAccelerations(const Law &law, float *ax, float *ay, float *az) const {
+        computeAccelerations(law, 0, bodyCount, ax, ay, az);
+    }
+
+    template<typename Law>
+    void computeAccelerations(const Law &law, size_t begin, size_t end, float *ax, float *ay, float *az) const {
+        for(uint32_t i = begin; i < end; i++) {
+            accelerationAt(law, i, ax[i], ay[i], az[i]);
+        }
+    }
+
+    size_t outsideCount() const { return outside.size(); }
+    int getGridSize() const { return gridSize; }
+    float getSpacing() const { return spacing; }
+    static int getShortRangeCells() { return SHORT_RANGE_CELLS; }
+};
+
+#endif
@@ -0,0 +1,628 @@
+#ifndef PHYSICS_H
+#define PHYSICS_H
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <memory>
+#include <thread>
+#include <string>
+#include <type_traits>
+#include "bodies.h"
+#include "octree.h"
+#include "particle_mesh.h"
+#include "fmm.h"
+#include "kernels.h"
+#include "force_law.h"
+#include "thread_pool.h"
+#include "integrator.h"
+#include "collisions.h"
+#include "profiler.h"
+
+enum class forceSolver {
+    direct,
+    barnesHut,
+    particleMesh,
+    fastMultipole
+};
+
+class physicsEngine {
+public:
+    static constexpr float GRAVITY = 100.0f;
+    static constexpr float EPS = 0.01f;
+    static constexpr float MIN_DISTANCE = 0.01f;
+private:
+    static inline bodyStore bodies;
+    // Indices of the light-emitting bodies, kept in step with addBody/removeObject; bulk edits from
+    // outside and merges only mark it stale and the next getStars() rebuilds it.
+    static inline std::vector<uint32_t> stars;
+    static inline bool starsValid = true;
+
+    static inline octree tree;
+    static inline particleMesh mesh{GRAVITY};
+    static inline fastMultipole multipole{GRAVITY};
+
+    static constexpr size_t TARGET_TILE = 256;
+    static constexpr size_t SOURCE_TILE = 4096;
+    static constexpr size_t PARALLEL_THRESHOLD = 1024;
+
+    static inline integrator stepper;
+    static inline collisionSystem contacts;
+    static inline bool accelerationsValid = false;
+    static inline float accumulator = 0.0f;
+
+    static constexpr float MAX_FRAME_TIME = 0.25f;
+
+    static inline std::unique_ptr<threadPool> pool;
+    static inline std::vector<std::vector<float>> accumulators;
+    static inline std::vector<float> fieldX, fieldY, fieldZ;
+
+    static size_t tileCount(size_t count, size_t tile) {
+        return (count + tile - 1) / tile;
+    }
+
+    // Runs function(kernel) with the policy object of the selected force law and precision, so the
+    // solvers below compile one specialized loop per combination and never branch on it inside.
+    template<typename Function>
+    static void withForceLaw(Function function) {
+        forceLaws::dispatch(law, precision, {GRAVITY, EPS, MIN_DISTANCE, cutoff}, function);
+    }
+public:
+    static inline forceSolver solver = forceSolver::direct;
+    static inline float theta = 0.5f;
+    static inline int meshSize = 64;
+    static inline massAssignment assignment = massAssignment::cic;
+    // P3M: pairs closer than a few mesh cells get the exact law instead of the smoothed mesh force
+    static inline bool meshShortRange = false;
+    // FMM expansion order; a positive tolerance overrides it with the lowest order meeting that bound at theta
+    static inline int expansionOrder = 4;
+    static inline float tolerance = 0.0f;
+    static inline simdLevel simd = directKernel::detect();
+
+    // Pair force of the direct, tree and FMM near-field kernels and the precision they sum in, double
+    // also integrates positions and velocities with their residuals and adds them to the direct and
+    // tree separations (bodies.h); the mesh solver keeps its own grid softening. Cutoff is the range
+    // of the cutoff law.
+    static inline forceLaw law = forceLaw::softened;
+    static inline precisionMode precision = precisionMode::singlePrecision;
+    static inline float cutoff = 100.0f;
+
+    static inline unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    // Deterministic mode gives every target tile the full source range in a fixed order, so results are
+    // bitwise identical for any worker count. Otherwise target x source tiles are stolen individually and
+    // summed through per-worker accumulators, which balances better but depends on the schedule.
+    static inline bool deterministic = true;
+
+    static inline integratorType integration = integratorType::leapfrog;
+    static inline float fixedDeltaTime = 1.0f / 120.0f;
+
+    // Number of single-body force evaluations so far, to compare integrators by cost.
+    static inline uint64_t forceEvaluations = 0;
+
+    // Overlapping bodies pass through each other, merge, or bounce with the given restitution.
+    static inline collisionMode collisions = collisionMode::none;
+    static inline float restitution = 0.5f;
+    static inline uint64_t mergeCount = 0;
+
+    static inline uint64_t stepCount = 0;
+    static inline double simulationTime = 0.0;
+
+    static const char* solverName(forceSolver type) {
+        switch(type) {
+            case forceSolver::barnesHut: return "barnes-hut";
+            case forceSolver::particleMesh: return "pm";
+            case forceSolver::fastMultipole: return "fmm";
+            default: return "direct";
+        }
+    }
+
+    static forceSolver solverFromName(const std::string &name) {
+        if(name == "barnes-hut") return forceSolver::barnesHut;
+        if(name == "pm") return forceSolver::particleMesh;
+        if(name == "fmm") return forceSolver::fastMultipole;
+        return forceSolver::direct;
+    }
+
+    // Why `type` cannot honor the selected force law or precision, or nullptr when it can. The mesh solves
+    // for the potential on its own softened float grid, and the FMM far field expands the Newtonian
+    // potential, which the softened, plummer and spline laws all reduce to at well separated distances
+    // but the cutoff law does not.
+    static const char* unsupportedCombination(forceSolver type) {
+        if(type == forceSolver::particleMesh && law != forceLaw::softened) return "The pm solver only supports --force-law softened";
+        if(type == forceSolver::particleMesh && precision != precisionMode::singlePrecision) return "The pm solver only supports --precision float";
+        if(type == forceSolver::fastMultipole && law == forceLaw::cutoff) return "The fmm solver does not support --force-law cutoff";
+        return nullptr;
+    }
+
+    // Consumes the solver options shared by every executable, returns false for anything else.
+    static bool parseArgument(int argc, char **argv, int &i) {
+        std::string arg = argv[i];
+
+        if(arg == "--solver" && i + 1 < argc) {
+            solver = solverFromName(argv[++i]);
+        }
+        else if(arg == "--theta" && i + 1 < argc) {
+            theta = std::stof(argv[++i]);
+        }
+        else if(arg == "--pm-grid" && i + 1 < argc) {
+            meshSize = std::stoi(argv[++i]);
+        }
+        else if(arg == "--pm-assignment" && i + 1 < argc) {
+            assignment = particleMesh::fromName(argv[++i]);
+        }
+        else if(arg == "--pm-short-range") {
+            meshShortRange = true;
+        }
+        else if(arg == "--fmm-order" && i + 1 < argc) {
+            expansionOrder = std::stoi(argv[++i]);
+        }
+        else if(arg == "--fmm-tolerance" && i + 1 < argc) {
+            tolerance = std::stof(argv[++i]);
+        }
+        else if(arg == "--simd" && i + 1 < argc) {
+            simdLevel level = directKernel::fromName(argv[++i]);
+            if(directKernel::supported(level)) simd = level;
+        }
+        else if(arg == "--force-law" && i + 1 < argc) {
+            law = forceLaws::fromName(argv[++i]);
+        }
+        else if(arg == "--precision" && i + 1 < argc) {
+            precision = forceLaws::precisionFromName(argv[++i]);
+        }
+        else if(arg == "--cutoff" && i + 1 < argc) {
+            cutoff = std::stof(argv[++i]);
+        }
+        else if(arg == "--threads" && i + 1 < argc) {
+            threads = std::max(1, std::stoi(argv[++i]));
+        }
+        else if(arg == "--nondeterministic") {
+            deterministic = false;
+        }
+        else if(arg == "--integrator" && i + 1 < argc) {
+            integration = integrator::fromName(argv[++i]);
+        }
+        else if(arg == "--dt" && i + 1 < argc) {
+            fixedDeltaTime = std::stof(argv[++i]);
+        }
+        else if(arg == "--block-levels" && i + 1 < argc) {
+            stepper.maxLevel = std::min(std::max(0, std::stoi(argv[++i])), 20);
+        }
+        else if(arg == "--eta" && i + 1 < argc) {
+            stepper.eta = std::stof(argv[++i]);
+        }
+        else if(arg == "--length-scale" && i + 1 < argc) {
+            stepper.lengthScale = std::stof(argv[++i]);
+        }
+        else if(arg == "--collisions" && i + 1 < argc) {
+            collisions = collisionSystem::fromName(argv[++i]);
+        }
+        else if(arg == "--restitution" && i + 1 < argc) {
+            restitution = std::min(std::max(std::stof(argv[++i]), 0.0f), 1.0f);
+        }
+        else {
+            return false;
+        }
+        return true;
+    }
+
+    static size_t addBody(float x, float y, float z, float vx, float vy, float vz, float mass, float density, float r, float g, float b, uint32_t flags) {
+        accelerationsValid = false;
+        size_t index = bodies.add(x, y, z, vx, vy, vz, mass, density, r, g, b, flags);
+
+        if(starsValid && (flags & BODY_STAR)) stars.emplace_back(index);
+        return index;
+    }
+
+    template<typename Vec>
+    static size_t addObject(const Vec &position, const Vec &velocity, float mass, float density, const Vec &color, bool star) {
+        return addBody(
+            position.x, position.y, position.z,
+            velocity.x, velocity.y, velocity.z,
+            mass, density,
+            color.x, color.y, color.z,
+            star ? BODY_STAR : 0u
+        );
+    }
+
+    static void removeObject(size_t index) {
+        accelerationsValid = false;
+
+        // the last body moves into the freed slot, so its star entry has to follow it
+        if(starsValid) {
+            uint32_t last = bodies.size() - 1;
+            stars.erase(std::remove(stars.begin(), stars.end(), (uint32_t)index), stars.end());
+            std::replace(stars.begin(), stars.end(), last, (uint32_t)index);
+        }
+        bodies.remove(index);
+    }
+
+    // Worker pool shared by the solvers, also used to fill generated scenes in parallel.
+    static threadPool& getPool() {
+        if(!pool || pool->size() != threads) {
+            pool = std::make_unique<threadPool>(threads);
+        }
+        return *pool;
+    }
+
+    static bodyStore& getBodies() {
+        return bodies;
+    }
+
+    static const std::vector<uint32_t>& getStars() {
+        if(starsValid) return stars;
+
+        stars.clear();
+        for(uint32_t i = 0; i < bodies.size(); i++) {
+            if(bodies.isStar(i)) stars.emplace_back(i);
+        }
+        starsValid = true;
+        return stars;
+    }
+
+    // Symmetric pair loop, kept as the exact reference for the other solvers.
+    static void computePairwise(const float *x, const float *y, const float *z, const float *m, size_t count, float *ax, float *ay, float *az) {
+        withForceLaw([&](const auto &kernel) {
+            using real = typename std::decay_t<decltype(kernel)>::real;
+            std::vector<real> sumX(count, 0), sumY(count, 0), sumZ(count, 0);
+
+            for(size_t i = 0; i < count; i++) {
+
+                for(size_t j = i + 1; j < count; j++) {
+                    real dx = (real)x[j] - (real)x[i];
+                    real dy = (real)y[j] - (real)y[i];
+                    real dz = (real)z[j] - (real)z[i];
+                    real r2 = dx * dx + dy * dy + dz * dz;
+
+                    real pull = kernel(r2, real(1));
+
+                    sumX[i] += dx * pull * m[j];
+                    sumY[i] += dy * pull * m[j];
+                    sumZ[i] += dz * pull * m[j];
+
+                    sumX[j] -= dx * pull * m[i];
+                    sumY[j] -= dy * pull * m[i];
+                    sumZ[j] -= dz * pull * m[i];
+                }
+            }
+
+            std::copy(sumX.begin(), sumX.end(), ax);
+            std::copy(sumY.begin(), sumY.end(), ay);
+            std::copy(sumZ.begin(), sumZ.end(), az);
+        });
+    }
+
+    static void computeDirect(const float *x, const float *y, const float *z, const float *m, size_t count, float *ax, float *ay, float *az) {
+        PROFILE_SCOPE("direct");
+        withForceLaw([&](const auto &kernel) { directSum(kernel, x, y, z, m, count, ax, ay, az); });
+    }
+
+    // lowX/lowY/lowZ are the bodies' position residuals, which double-precision laws add to separations
+    template<typename Law>
+    static void directSum(const Law &kernel, const float *x, const float *y, const float *z, const float *m, size_t count, float *ax, float *ay, float *az,
+                          const float *lowX = nullptr, const float *lowY = nullptr, const float *lowZ = nullptr) {
+        if(threads <= 1 || count < PARALLEL_THRESHOLD) {
+            std::fill(ax, ax + count, 0.0f);
+            std::fill(ay, ay + count, 0.0f);
+            std::fill(az, az + count, 0.0f);
+
+            directKernel::accumulate(simd, kernel, x, y, z, m, 0, count, 0, count, ax, ay, az, lowX, lowY, lowZ);
+            return;
+        }
+
+        threadPool &workers = getPool();
+        size_t targetTiles = tileCount(count, TARGET_TILE);
+
+        if(deterministic) {
+            workers.parallelFor(targetTiles, [&](size_t tile, unsigned) {
+                size_t begin = tile * TARGET_TILE;
+                size_t end = std::min(begin + TARGET_TILE, count);
+
+                std::fill(ax + begin, ax + end, 0.0f);
+                std::fill(ay + begin, ay + end, 0.0f);
+                std::fill(az + begin, az + end, 0.0f);
+
+                directKernel::accumulate(simd, kernel, x, y, z, m, begin, end, 0, count, ax, ay, az, lowX, lowY, lowZ);
+            });
+            return;
+        }
+
+        accumulators.resize(3 * workers.size());
+        for(auto &accumulator : accumulators) {
+            accumulator.assign(count, 0.0f);
+        }
+
+        size_t sourceTiles = tileCount(count, SOURCE_TILE);
+        workers.parallelFor(targetTiles * sourceTiles, [&](size_t tile, unsigned worker) {
+            size_t begin = (tile / sourceTiles) * TARGET_TILE;
+            size_t end = std::min(begin + TARGET_TILE, count);
+            size_t sourceBegin = (tile % sourceTiles) * SOURCE_TILE;
+            size_t sourceEnd = std::min(sourceBegin + SOURCE_TILE, count);
+
+            directKernel::accumulate(simd, kernel, x, y, z, m, begin, end, sourceBegin, sourceEnd,
+                                     accumulators[3 * worker].data(), accumulators[3 * worker + 1].data(), accumulators[3 * worker + 2].data(),
+                                     lowX, lowY, lowZ);
+        });
+
+        workers.parallelFor(targetTiles, [&](size_t tile, unsigned) {
+            size_t begin = tile * TARGET_TILE;
+            size_t end = std::min(begin + TARGET_TILE, count);
+
+            for(size_t i = begin; i < end; i++) {
+                float sumX = 0.0f, sumY = 0.0f, sumZ = 0.0f;
+
+                for(unsigned worker = 0; worker < workers.size(); worker++) {
+                    sumX += accumulators[3 * worker][i];
+                    sumY += accumulators[3 * worker + 1][i];
+                    sumZ += accumulators[3 * worker + 2][i];
+                }
+                ax[i] = sumX;
+                ay[i] = sumY;
+                az[i] = sumZ;
+            }
+        });
+    }
+
+    static void computeBarnesHut(const float *x, const float *y, const float *z, const float *m, size_t count, float *ax, float *ay, float *az) {
+        PROFILE_SCOPE("barnes-hut");
+        tree.build(x, y, z, m, count);
+        withForceLaw([&](const auto &kernel) { treeSum(kernel, count, ax, ay, az); });
+    }
+
+    // Walks the tree built last for every body.
+    template<typename Law>
+    static void treeSum(const Law &kernel, size_t count, float *ax, float *ay, float *az) {
+        if(threads <= 1 || count < PARALLEL_THRESHOLD) {
+            tree.computeAccelerations(kernel, theta, ax, ay, az);
+            return;
+        }
+
+        getPool().parallelFor(tileCount(count, TARGET_TILE), [&](size_t tile, unsigned) {
+            size_t begin = tile * TARGET_TILE;
+            tree.computeAccelerations(kernel, theta, begin, std::min(begin + TARGET_TILE, count), ax, ay, az);
+        });
+    }
+
+    static void buildMesh(const float *x, const float *y, const float *z, const float *m, size_t count) {
+        PROFILE_SCOPE("pm build");
+        mesh.configure(meshSize, assignment, meshShortRange);
+        mesh.build(x, y, z, m, count, threads > 1 ? &getPool() : nullptr);
+    }
+
+    static void computeParticleMesh(const float *x, const float *y, const float *z, const float *m, size_t count, float *ax, float *ay, float *az) {
+        PROFILE_SCOPE("pm");
+        buildMesh(x, y, z, m, count);
+
+        withForceLaw([&](const auto &kernel) {
+            if(threads <= 1 || count < PARALLEL_THRESHOLD) {
+                mesh.computeAccelerations(kernel, ax, ay, az);
+                return;
+            }
+
+            getPool().parallelFor(tileCount(count, TARGET_TILE), [&](size_t tile, unsigned) {
+                size_t begin = tile * TARGET_TILE;
+                mesh.computeAccelerations(kernel, begin, std::min(begin + TARGET_TILE, count), ax, ay, az);
+            });
+        });
+    }
+
+    static void computeFastMultipole(const float *x, const float *y, const float *z, const float *m, size_t count, float *ax, float *ay, float *az) {
+        PROFILE_SCOPE("fmm");
+        multipole.setOrder(tolerance > 0.0f ? fastMultipole::orderFor(tolerance, theta) : expansionOrder);
+        multipole.build(x, y, z, m, count);
+
+        bool parallel = threads > 1 && count >= PARALLEL_THRESHOLD;
+        withForceLaw([&](const auto &kernel) {
+            multipole.computeAccelerations(kernel, theta, simd, parallel ? &getPool() : nullptr, ax, ay, az);
+        });
+    }
+
+    static void computeAccelerations(const float *x, const float *y, const float *z, const float *m, size_t count, float *ax, float *ay, float *az) {
+        switch(solver) {
+            case forceSolver::barnesHut:
+                computeBarnesHut(x, y, z, m, count, ax, ay, az);
+                break;
+            case forceSolver::particleMesh:
+                computeParticleMesh(x, y, z, m, count, ax, ay, az);
+                break;
+            case forceSolver::fastMultipole:
+                computeFastMultipole(x, y, z, m, count, ax, ay, az);
+                break;
+            default:
+                computeDirect(x, y, z, m, count, ax, ay, az);
+                break;
+        }
+    }
+
+    // Accelerations of the first `targets` bodies only, the rest act purely as sources (the bodies and
+    // tree summaries a distributed rank imports from the others). Only ax[0, targets) is written.
+    static void computeTargetAccelerations(const float *x, const float *y, const float *z, const float *m, size_t count, size_t targets,
+                                           float *ax, float *ay, float *az) {
+        if(solver == forceSolver::particleMesh || solver == forceSolver::fastMultipole) {
+            // both solve the whole field in one pass anyway
+            fieldX.resize(count); fieldY.resize(count); fieldZ.resize(count);
+            computeAccelerations(x, y, z, m, count, fieldX.data(), fieldY.data(), fieldZ.data());
+
+            std::copy(fieldX.begin(), fieldX.begin() + targets, ax);
+            std::copy(fieldY.begin(), fieldY.begin() + targets, ay);
+            std::copy(fieldZ.begin(), fieldZ.begin() + targets, az);
+            return;
+        }
+
+        bool barnesHut = solver == forceSolver::barnesHut;
+        if(barnesHut) {
+            PROFILE_SCOPE("barnes-hut");
+            tree.build(x, y, z, m, count);
+        }
+
+        withForceLaw([&](const auto &kernel) {
+            auto evaluate = [&](size_t begin, size_t end) {
+                if(barnesHut) {
+                    tree.computeAccelerations(kernel, theta, begin, end, ax, ay, az);
+                    return;
+                }
+                std::fill(ax + begin, ax + end, 0.0f);
+                std::fill(ay + begin, ay + end, 0.0f);
+                std::fill(az + begin, az + end, 0.0f);
+                directKernel::accumulate(simd, kernel, x, y, z, m, begin, end, 0, count, ax, ay, az);
+            };
+
+            if(threads <= 1 || targets < PARALLEL_THRESHOLD) {
+                evaluate(0, targets);
+                return;
+            }
+
+            getPool().parallelFor(tileCount(targets, TARGET_TILE), [&](size_t tile, unsigned) {
+                size_t begin = tile * TARGET_TILE;
+                evaluate(begin, std::min(begin + TARGET_TILE, targets));
+            });
+        });
+    }
+
+    // Recomputes accelerations of the listed targets only, against every body in the store.
+    static void computeAccelerationsFor(bodyStore &store, const std::vector<uint32_t> &targets) {
+        PROFILE_SCOPE("partial forces");
+        const float *x = store.x.data(), *y = store.y.data(), *z = store.z.data(), *m = store.mass.data();
+        const float *lowX = store.lowX.data(), *lowY = store.lowY.data(), *lowZ = store.lowZ.data();
+        size_t count = store.size();
+        forceEvaluations += targets.size();
+
+        if(solver == forceSolver::barnesHut) {
+            tree.build(x, y, z, m, count, lowX, lowY, lowZ);
+        }
+        else if(solver == forceSolver::particleMesh) {
+            buildMesh(x, y, z, m, count);
+        }
+        else if(solver == forceSolver::fastMultipole) {
+            // the passes are shared by every target, so evaluate the whole field and keep the subset
+            fieldX.resize(count); fieldY.resize(count); fieldZ.resize(count);
+            computeFastMultipole(x, y, z, m, count, fieldX.data(), fieldY.data(), fieldZ.data());
+
+            for(uint32_t i : targets) {
+                store.ax[i] = fieldX[i];
+                store.ay[i] = fieldY[i];
+                store.az[i] = fieldZ[i];
+            }
+            return;
+        }
+
+        withForceLaw([&](const auto &kernel) {
+            auto evaluate = [&](size_t begin, size_t end) {
+                for(size_t k = begin; k < end; k++) {
+                    uint32_t i = targets[k];
+
+                    if(solver == forceSolver::barnesHut) {
+                        tree.accelerationAt(kernel, i, theta, store.ax[i], store.ay[i], store.az[i]);
+                        continue;
+                    }
+                    if(solver == forceSolver::particleMesh) {
+                        mesh.accelerationAt(kernel, i, store.ax[i], store.ay[i], store.az[i]);
+                        continue;
+                    }
+
+                    store.ax[i] = store.ay[i] = store.az[i] = 0.0f;
+                    directKernel::accumulate(simd, kernel, x, y, z, m, i, i + 1, 0, count, store.ax.data(), store.ay.data(), store.az.data(),
+                                             lowX, lowY, lowZ);
+                }
+            };
+
+            if(threads <= 1 || targets.size() * count < PARALLEL_THRESHOLD * PARALLEL_THRESHOLD) {
+                evaluate(0, targets.size());
+                return;
+            }
+
+            size_t tile = std::max<size_t>(1, TARGET_TILE / 4);
+            getPool().parallelFor(tileCount(targets.size(), tile), [&](size_t index, unsigned) {
+                size_t begin = index * tile;
+                evaluate(begin, std::min(begin + tile, targets.size()));
+            });
+        });
+    }
+
+    // The direct sum and the tree's leaves also read the store's position residuals, so in double
+    // precision close pairs are separated at the precision the integrator keeps positions in.
+    static void computeAccelerations(bodyStore &store) {
+        forceEvaluations += store.size();
+        const float *x = store.x.data(), *y = store.y.data(), *z = store.z.data(), *m = store.mass.data();
+        const float *lowX = store.lowX.data(), *lowY = store.lowY.data(), *lowZ = store.lowZ.data();
+        float *ax = store.ax.data(), *ay = store.ay.data(), *az = store.az.data();
+        size_t count = store.size();
+
+        if(solver == forceSolver::barnesHut) {
+            PROFILE_SCOPE("barnes-hut");
+            tree.build(x, y, z, m, count, lowX, lowY, lowZ);
+            withForceLaw([&](const auto &kernel) { treeSum(kernel, count, ax, ay, az); });
+        }
+        else if(solver == forceSolver::direct) {
+            PROFILE_SCOPE("direct");
+            withForceLaw([&](const auto &kernel) { directSum(kernel, x, y, z, m, count, ax, ay, az, lowX, lowY, lowZ); });
+        }
+        else {
+            computeAccelerations(x, y, z, m, count, ax, ay, az);
+        }
+    }
+
+    // Marks the cached accelerations and the star index stale after bodies were edited from outside.
+    static void invalidateAccelerations() {
+        accelerationsValid = false;
+        starsValid = false;
+    }
+
+    static void updatePhysics(const float &deltaTime) {
+        PROFILE_SCOPE("updatePhysics");
+        bodies.prevX = bodies.x;
+        bodies.prevY = bodies.y;
+        bodies.prevZ = bodies.z;
+
+        auto forces = [](bodyStore &store) { computeAccelerations(store); };
+        auto forcesFor = [](bodyStore &store, const std::vector<uint32_t> &targets) { computeAccelerationsFor(store, targets); };
+        if(precision == precisionMode::doublePrecision) stepper.step<double>(integration, bodies, deltaTime, accelerationsValid, forces, forcesFor);
+        else stepper.step(integration, bodies, deltaTime, accelerationsValid, forces, forcesFor);
+
+        // contacts move, merge or remove bodies, so the accelerations carried to the next step are stale
+        size_t merged;
+        if(contacts.resolve(bodies, collisions, restitution, merged) > 0) {
+            accelerationsValid = false;
+            mergeCount += merged;
+            if(merged > 0) starsValid = false;
+        }
+
+        stepCount++;
+        simulationTime += deltaTime;
+    }
+
+    // Feeds wall-clock frame time into a fixed-step accumulator and runs as many fixed steps as fit.
+    // Returns the fraction of a step left over, used to interpolate between the last two states.
+    static float advance(float frameTime) {
+        PROFILE_SCOPE("advance");
+        accumulator += std::min(frameTime, MAX_FRAME_TIME);
+
+        while(accumulator >= fixedDeltaTime) {
+            updatePhysics(fixedDeltaTime);
+            accumulator -= fixedDeltaTime;
+        }
+        return accumulator / fixedDeltaTime;
+    }
+
+    // Kinetic plus the pair potential of the force law, O(N^2), for drift diagnostics.
+    static double totalEnergy(const bodyStore &store) {
+        double kinetic = 0.0, potential = 0.0;
+
+        withForceLaw([&](const auto &kernel) {
+            for(size_t i = 0; i < store.size(); i++) {
+                double v2 = store.preciseVX(i) * store.preciseVX(i) + store.preciseVY(i) * store.preciseVY(i) + store.preciseVZ(i) * store.preciseVZ(i);
+                kinetic += 0.5 * store.mass[i] * v2;
+
+                for(size_t j = i + 1; j < store.size(); j++) {
+                    double dx = store.preciseX(j) - store.preciseX(i);
+                    double dy = store.preciseY(j) - store.preciseY(i);
+                    double dz = store.preciseZ(j) - store.preciseZ(i);
+
+                    potential += (double)store.mass[i] * store.mass[j] * kernel.potential(dx * dx + dy * dy + dz * dz);
+                }
+            }
+        });
+        return kinetic + potential;
+    }
+};
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef PHYSICS_THREAD_H
+#define PHYSICS_THREAD_H
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
+#include "physics.h"
+#include "triple_buffer.h"
+#include "profiler.h"
+
+// Everything the renderer reads from one finished physics state.
+struct renderState {
+    bodyStore bodies;               // positions, previous positions, mass, radius, flags and color only
+    std::vector<uint32_t> stars;
+    uint64_t step = 0;
+    double simulationTime = 0.0;
+
+    // fixed-step remainder when the state was published, and the wall clock at that moment
+    float remainder = 0.0f;
+    std::chrono::steady_clock::time_point published;
+};
+
+// Runs physicsEngine::advance on its own thread against the wall clock and hands every finished
+// state to the render thread through a triple buffer, so a slow step never holds up a frame and
+// vsync never holds up physics. The render thread interpolates the latest state by how much wall
+// time passed since it was published, the same way it used the accumulator remainder before.
+// The body store belongs to the physics thread between start() and stop().
+class physicsThread {
+private:
+    tripleBuffer<renderState> states;
+    std::thread worker;
+    std::atomic<bool> running{false};
+
+    static void copyArray(std::vector<float> &to, const std::vector<float> &from) {
+        to.assign(from.begin(), from.end());
+    }
+
+    void publish(float remainder) {
+        PROFILE_SCOPE("publish state");
+        const bodyStore &bodies = physicsEngine::getBodies();
+        renderState &state = states.writeBuffer();
+
+        copyArray(state.bodies.x, bodies.x); copyArray(state.bodies.y, bodies.y); copyArray(state.bodies.z, bodies.z);
+        copyArray(state.bodies.prevX, bodies.prevX); copyArray(state.bodies.prevY, bodies.prevY); copyArray(state.bodies.prevZ, bodies.prevZ);
+        copyArray(state.bodies.mass, bodies.mass);
+        copyArray(state.bodies.radius, bodies.radius);
+        copyArray(state.bodies.colorR, bodies.colorR); copyArray(state.bodies.colorG, bodies.colorG); copyArray(state.bodies.colorB, bodies.colorB);
+        state.bodies.flags.assign(bodies.flags.begin(), bodies.flags.end());
+
+        state.stars = physicsEngine::getStars();
+        state.step = physicsEngine::stepCount;
+        state.simulationTime = physicsEngine::simulationTime;
+        state.remainder = remainder;
+        state.published = std::chrono::steady_clock::now();
+
+        states.publish();
+    }
+
+    void run() {
+        PROFILE_THREAD("physics");
+        auto last = std::chrono::steady_clock::now();
+
+        while(running.load(std::memory_order_relaxed)) {
+            auto now = std::chrono::steady_clock::now();
+            float frameTime = std::chrono::duration<float>(now - last).count();
+            last = now;
+
+            uint64_t before = physicsEngine::stepCount;
+            float alpha = physicsEngine::advance(frameTime);
+
+            if(physicsEngine::stepCount != before) publish(alpha * physicsEngine::fixedDeltaTime);
+
+            // nothing to do until the next fixed step is due
+            std::this_thread::sleep_for(std::chrono::duration<float>((1.0f - alpha) * physicsEngine::fixedDeltaTime));
+        }
+    }
+public:
+    physicsThread() = default;
+
+    physicsThread(const physicsThread&) = delete;
+    physicsThread& operator=(const physicsThread&) = delete;
+
+    ~physicsThread() {
+        stop();
+    }
+
+    void start() {
+        if(running.load()) return;
+
+        // the render thread has a state to draw from the first frame on
+        publish(0.0f);
+        states.update();
+
+        running.store(true);
+        worker = std::thread([this] { run(); });
+    }
+
+    void stop() {
+        running.store(false);
+        if(worker.joinable()) worker.join();
+    }
+
+    // Render thread: the newest finished state and how far to interpolate it toward its last step.
+    const renderState& latest(float &alpha) {
+        states.update();
+        const renderState &state = states.readBuffer();
+
+        float elapsed = std::chrono::duration<float>(std::chrono::steady_clock::now() - state.published).count();
+        alpha = std::min(1.0f, (state.remainder + elapsed) / physicsEngine::fixedDeltaTime);
+        return state;
+    }
+};
+
+#endif
@@ -0,0 +1,233 @@
+#ifndef POTENTIAL_MAP_H
+#define POTENTIAL_MAP_H
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include "bodies.h"
+#include "fft.h"
+#include "profiler.h"
+
+// Softened potential of every body sampled on a square texel grid in the XZ plane:
+//   value = strength * mass / sqrt(r^2 + softening^2)
+// Bodies are deposited onto the texels with cloud-in-cell weights and convolved with the kernel
+// through a zero-padded FFT, so the cost depends on the resolution and not on the body count.
+//
+// Bodies whose deposit would fall off the map go to an outer level of the same resolution OUTER_SCALE
+// times wider, convolved the same way and interpolated onto the texels. Bodies past that one only enter
+// through the Taylor expansion of their potential about the map center to second order, which is off
+// by about (r / R)^3 < 1% at texel r for a body at R.
+class potentialMap {
+private:
+    static constexpr int OUTER_SCALE = 8;
+
+    struct level {
+        float halfExtent = 0.0f;
+        float spacing = 0.0f;
+        std::vector<float> kernelSpectrum;
+        std::vector<fft::complex> work;
+    };
+
+    int resolution = 0;
+    int padded = 0;
+    float softening = 0.0f;
+    float strength = 0.0f;
+
+    level inner, outer;
+    std::vector<float> values;
+    size_t outerCount = 0;
+
+    // far bodies: potential, gradient and Hessian at the map center, in units of mass
+    double farValue = 0.0;
+    double farX = 0.0, farZ = 0.0;
+    double farXX = 0.0, farXZ = 0.0, farZZ = 0.0;
+
+    double totalMass = 0.0;
+    float massCenterX = 0.0f, massCenterZ = 0.0f;
+
+    float kernel(float dx, float dz) const {
+        return strength / std::sqrt(dx * dx + dz * dz + softening * softening);
+    }
+
+    void configureLevel(level &target, float extent) {
+        target.halfExtent = extent;
+        target.spacing = 2.0f * extent / (resolution - 1);
+
+        // kernel stored with wrapped offsets so the circular convolution reproduces the linear one;
+        // it is real and even, so its spectrum is real too
+        std::vector<fft::complex> kernelGrid((size_t)padded * padded);
+        for(int j = 0; j < padded; j++) {
+            int dz = j < padded / 2 ? j : j - padded;
+
+            for(int i = 0; i < padded; i++) {
+                int dx = i < padded / 2 ? i : i - padded;
+                kernelGrid[(size_t)j * padded + i] = kernel(dx * target.spacing, dz * target.spacing);
+            }
+        }
+        fft::transform2D(kernelGrid, padded, padded, false);
+
+        // Cloud-in-cell deposit and the bilinear lookup afterwards each filter the field by sinc^2 per
+        // axis; dividing it out of the kernel keeps peaks from being smeared twice.
+        std::vector<float> window(padded);
+        for(int i = 0; i < padded; i++) {
+            int frequency = i < padded / 2 ? i : i - padded;
+            double angle = M_PI * frequency / padded;
+            double sinc = frequency == 0 ? 1.0 : std::sin(angle) / angle;
+            window[i] = sinc * sinc * sinc * sinc;
+        }
+
+        target.kernelSpectrum.resize(kernelGrid.size());
+        for(int j = 0; j < padded; j++) {
+            for(int i = 0; i < padded; i++) {
+                size_t k = (size_t)j * padded + i;
+                target.kernelSpectrum[k] = kernelGrid[k].real() / (window[i] * window[j]);
+            }
+        }
+
+        target.work.assign(target.kernelSpectrum.size(), fft::complex(0.0f, 0.0f));
+    }
+
+    // False when the deposit would fall off the level.
+    bool deposit(level &target, float bx, float bz, float m) {
+        float u = (bx + target.halfExtent) / target.spacing;
+        float v = (bz + target.halfExtent) / target.spacing;
+
+        int i = (int)std::floor(u);
+        int j = (int)std::floor(v);
+        if(i < 0 || j < 0 || i >= resolution - 1 || j >= resolution - 1) return false;
+
+        float fx = u - i;
+        float fz = v - j;
+
+        target.work[(size_t)j * padded + i] += m * (1.0f - fx) * (1.0f - fz);
+        target.work[(size_t)j * padded + i + 1] += m * fx * (1.0f - fz);
+        target.work[(size_t)(j + 1) * padded + i] += m * (1.0f - fx) * fz;
+        target.work[(size_t)(j + 1) * padded + i + 1] += m * fx * fz;
+        return true;
+    }
+
+    void convolve(level &target) {
+        std::vector<fft::complex> &work = target.work;
+
+        // Only the first `resolution` rows hold mass and only those rows are read back. The field is
+        // real, so rows go through the transform two at a time and columns past padded / 2 are skipped.
+        const size_t columns = padded / 2 + 1;
+        for(int j = 0; j < resolution; j += 2) {
+            fft::transformRealPair(&work[(size_t)j * padded], &work[(size_t)(j + 1) * padded], padded, false);
+        }
+        fft::transformStrided(work.data(), padded, columns, padded, false);
+
+        for(int j = 0; j < padded; j++) {
+            for(size_t i = 0; i < columns; i++) work[(size_t)j * padded + i] *= target.kernelSpectrum[(size_t)j * padded + i];
+        }
+
+        fft::transformStrided(work.data(), padded, columns, padded, true);
+        for(int j = 0; j < resolution; j += 2) {
+            fft::transformRealPair(&work[(size_t)j * padded], &work[(size_t)(j + 1) * padded], padded, true);
+        }
+    }
+
+    // bilinear lookup of a convolved level at a point well inside it
+    float sample(const level &source, float px, float pz) const {
+        float u = (px + source.halfExtent) / source.spacing;
+        float v = (pz + source.halfExtent) / source.spacing;
+        int i = std::min((int)u, resolution - 2);
+        int j = std::min((int)v, resolution - 2);
+        float fx = u - i, fz = v - j;
+
+        auto at = [&](int a, int b) { return source.work[(size_t)b * padded + a].real(); };
+        return (at(i, j) * (1.0f - fx) + at(i + 1, j) * fx) * (1.0f - fz) + (at(i, j + 1) * (1.0f - fx) + at(i + 1, j + 1) * fx) * fz;
+    }
+
+    void addFar(float bx, float bz, float m) {
+        double d2 = (double)bx * bx + (double)bz * bz + (double)softening * softening;
+        double inverse = 1.0 / std::sqrt(d2);
+        double inverse3 = inverse / d2, inverse5 = inverse3 / d2;
+
+        farValue += m * inverse;
+        farX += m * bx * inverse3;
+        farZ += m * bz * inverse3;
+        farXX += m * (3.0 * bx * bx * inverse5 - inverse3);
+        farXZ += m * (3.0 * bx * bz * inverse5);
+        farZZ += m * (3.0 * bz * bz * inverse5 - inverse3);
+    }
+public:
+    // Texel i sits at -halfExtent + i * spacing, so the outermost texel centers land on the map edges.
+    void configure(int texels, float extent, float soft, float scale) {
+        resolution = texels;
+        padded = (int)fft::nextPowerOfTwo(2 * texels);
+        softening = soft;
+        strength = scale;
+
+        configureLevel(inner, extent);
+        configureLevel(outer, OUTER_SCALE * extent);
+        outerCount = 0;
+        values.assign((size_t)texels * texels, 0.0f);
+    }
+
+    int getResolution() const { return resolution; }
+    float getHalfExtent() const { return inner.halfExtent; }
+    float getSpacing() const { return inner.spacing; }
+    const std::vector<float>& getValues() const { return values; }
+    float getSoftening() const { return softening; }
+    float getStrength() const { return strength; }
+
+    // mass and XZ center of mass of the last compute(), for the monopole far field past the map
+    float getTotalMass() const { return (float)totalMass; }
+    float getMassCenterX() const { return massCenterX; }
+    float getMassCenterZ() const { return massCenterZ; }
+
+    void compute(const bodyStore &bodies, float alpha) {
+        PROFILE_SCOPE("potential map");
+        std::fill(inner.work.begin(), inner.work.end(), fft::complex(0.0f, 0.0f));
+        if(outerCount > 0) std::fill(outer.work.begin(), outer.work.end(), fft::complex(0.0f, 0.0f));
+
+        outerCount = 0;
+        farValue = farX = farZ = farXX = farXZ = farZZ = 0.0;
+        totalMass = 0.0;
+        double sumX = 0.0, sumZ = 0.0;
+        bool far = false;
+
+        for(size_t b = 0; b < bodies.size(); b++) {
+            float bx = bodies.interpolatedX(b, alpha);
+            float bz = bodies.interpolatedZ(b, alpha);
+            float m = bodies.mass[b];
+            totalMass += m;
+            sumX += (double)m * bx;
+            sumZ += (double)m * bz;
+
+            if(deposit(inner, bx, bz, m)) continue;
+            if(deposit(outer, bx, bz, m)) {
+                outerCount++;
+                continue;
+            }
+            addFar(bx, bz, m);
+            far = true;
+        }
+        massCenterX = totalMass > 0.0 ? (float)(sumX / totalMass) : 0.0f;
+        massCenterZ = totalMass > 0.0 ? (float)(sumZ / totalMass) : 0.0f;
+
+        convolve(inner);
+        if(outerCount > 0) convolve(outer);
+
+        for(int j = 0; j < resolution; j++) {
+            float pz = -inner.halfExtent + j * inner.spacing;
+
+            for(int i = 0; i < resolution; i++) {
+                float px = -inner.halfExtent + i * inner.spacing;
+                float value = inner.work[(size_t)j * padded + i].real();
+
+                if(outerCount > 0) value += sample(outer, px, pz);
+                if(far) {
+                    value += strength * (float)(farValue + farX * px + farZ * pz
+                                              + 0.5 * (farXX * px * px + 2.0 * farXZ * px * pz + farZZ * pz * pz));
+                }
+                values[(size_t)j * resolution + i] = value;
+            }
+        }
+    }
+
+    // bodies that went to the outer level in the last compute()
+    size_t getOuterCount() const { return outerCount; }
+};
+
+#endif
@@ -0,0 +1,230 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
+#include <unordered_map>
+
+// Scoped timers for the hot paths. Every thread records into its own ring of events that only it
+// writes, publishing each one with a single release store, so recording never takes a lock; once a
+// ring is full the oldest events are overwritten. summary() aggregates whatever the rings still hold
+// and writeTrace() exports them as Chrome trace JSON for chrome://tracing or ui.perfetto.dev.
+//
+// The PROFILE_* macros only expand to anything when GRAVITY_PROFILE is defined, so a normal build
+// carries no timers at all.
+class profiler {
+public:
+    struct event {
+        const char *name;   // must outlive the profiler, in practice a string literal
+        uint64_t start;     // nanoseconds since the profiler epoch
+        uint64_t end;
+    };
+private:
+    static constexpr uint64_t CAPACITY = 1 << 16;
+
+    struct track {
+        std::unique_ptr<event[]> events{new event[CAPACITY]};
+        std::atomic<uint64_t> head{0};
+        std::string name;
+        bool gpu = false;
+    };
+
+    static inline std::mutex registryMutex;
+    static inline std::vector<std::unique_ptr<track>> tracks;
+    static inline std::atomic<uint64_t> since{0};
+    static inline const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+    static track* createTrack(const std::string &name, bool gpu) {
+        std::lock_guard<std::mutex> lock(registryMutex);
+
+        tracks.push_back(std::make_unique<track>());
+        tracks.back()->name = name;
+        tracks.back()->gpu = gpu;
+        return tracks.back().get();
+    }
+
+    static track& threadTrack() {
+        thread_local track *own = createTrack("thread", false);
+        return *own;
+    }
+
+    static void push(track &target, const char *name, uint64_t start, uint64_t end) {
+        uint64_t head = target.head.load(std::memory_order_relaxed);
+
+        target.events[head % CAPACITY] = {name, start, end};
+        target.head.store(head + 1, std::memory_order_release);
+    }
+
+    // Copies the events still held by a track. Events the owner may have overwritten while they were
+    // being copied are dropped, as is anything older than the last reset().
+    static std::vector<event> snapshot(const track &source) {
+        uint64_t head = source.head.load(std::memory_order_acquire);
+        uint64_t first = head > CAPACITY ? head - CAPACITY : 0;
+
+        std::vector<event> copy;
+        copy.reserve(head - first);
+        for(uint64_t i = first; i < head; i++) copy.push_back(source.events[i % CAPACITY]);
+
+        uint64_t after = source.head.load(std::memory_order_acquire);
+        uint64_t safe = after >= CAPACITY ? after - CAPACITY + 1 : 0;
+        if(safe > first) copy.erase(copy.begin(), copy.begin() + std::min<uint64_t>(safe - first, copy.size()));
+
+        uint64_t cutoff = since.load();
+        copy.erase(std::remove_if(copy.begin(), copy.end(), [&](const event &e) { return e.start < cutoff; }), copy.end());
+        return copy;
+    }
+public:
+#ifdef GRAVITY_PROFILE
+    static constexpr bool enabled = true;
+#else
+    static constexpr bool enabled = false;
+#endif
+
+    static uint64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+    }
+
+    // Opaque handle of an extra track, e.g. for GPU timings. Only one thread may record into it.
+    using trackHandle = void*;
+
+    static trackHandle addTrack(const std::string &name, bool gpu) {
+        return createTrack(name, gpu);
+    }
+
+    // Names the calling thread's track in the trace.
+    static void setThreadName(const std::string &name) {
+        track &own = threadTrack();
+        std::lock_guard<std::mutex> lock(registryMutex);
+        own.name = name;
+    }
+
+    static void record(const char *name, uint64_t start, uint64_t end) {
+        push(threadTrack(), name, start, end);
+    }
+
+    static void record(trackHandle target, const char *name, uint64_t start, uint64_t end) {
+        push(*(track*)target, name, start, end);
+    }
+
+    // Summaries and traces only cover events recorded after the last reset.
+    static void reset() {
+        since.store(now());
+    }
+
+    // Calls, total, mean and extremes per scope name, CPU and GPU scopes listed separately.
+    static void summary(std::ostream &out) {
+        struct stats {
+            std::string name;
+            uint64_t calls = 0;
+            double total = 0.0, low = 1e300, high = 0.0;
+        };
+        std::unordered_map<std::string, stats> byName;
+        uint64_t first = UINT64_MAX, last = 0;
+
+        std::lock_guard<std::mutex> lock(registryMutex);
+        for(const auto &source : tracks) {
+            for(const event &e : snapshot(*source)) {
+                std::string key = (source->gpu ? "gpu " : "") + std::string(e.name);
+                stats &entry = byName[key];
+                double ms = (e.end - e.start) * 1e-6;
+
+                entry.name = key;
+                entry.calls++;
+                entry.total += ms;
+                entry.low = std::min(entry.low, ms);
+                entry.high = std::max(entry.high, ms);
+                first = std::min(first, e.start);
+                last = std::max(last, e.end);
+            }
+        }
+
+        std::vector<stats> sorted;
+        for(auto &entry : byName) sorted.push_back(entry.second);
+        std::sort(sorted.begin(), sorted.end(), [](const stats &a, const stats &b) { return a.total > b.total; });
+
+        double span = last > first ? (last - first) * 1e-6 : 0.0;
+        std::streamsize precision = out.precision();
+        out << "profile over " << span << " ms" << '\n';
+        out << std::left << std::setw(28) << "scope" << std::right << std::setw(10) << "calls" << std::setw(12) << "total ms"
+            << std::setw(12) << "mean ms" << std::setw(12) << "min ms" << std::setw(12) << "max ms" << '\n';
+
+        for(const stats &entry : sorted) {
+            out << std::left << std::setw(28) << entry.name << std::right << std::setw(10) << entry.calls
+                << std::fixed << std::setprecision(3)
+                << std::setw(12) << entry.total << std::setw(12) << entry.total / entry.calls
+                << std::setw(12) << entry.low << std::setw(12) << entry.high << std::defaultfloat << '\n';
+        }
+        out.precision(precision);
+    }
+
+    // Chrome trace event format: one complete ("X") event per scope, one thread per track.
+    static bool writeTrace(const std::string &path) {
+        std::ofstream file(path);
+        if(!file.is_open()) {
+            std::cout << "Could not write trace file: " << path << '\n';
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(registryMutex);
+        file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+        file << std::fixed << std::setprecision(3);
+        bool first = true;
+
+        for(size_t index = 0; index < tracks.size(); index++) {
+            const track &source = *tracks[index];
+
+            file << (first ? "\n" : ",\n") << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << index
+                 << ", \"args\": {\"name\": \"" << source.name << "\"}}";
+            first = false;
+
+            for(const event &e : snapshot(source)) {
+                file << ",\n{\"name\": \"" << e.name << "\", \"cat\": \"" << (source.gpu ? "gpu" : "cpu")
+                     << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << index
+                     << ", \"ts\": " << e.start * 1e-3 << ", \"dur\": " << (e.end - e.start) * 1e-3 << "}";
+            }
+        }
+        file << "\n]}\n";
+
+        if(!file) {
+            std::cout << "Could not write trace file: " << path << '\n';
+            return false;
+        }
+        return true;
+    }
+};
+
+class profileScope {
+private:
+    const char *name;
+    uint64_t start;
+public:
+    explicit profileScope(const char *name) : name(name), start(profiler::now()) {}
+
+    ~profileScope() {
+        profiler::record(name, start, profiler::now());
+    }
+
+    profileScope(const profileScope&) = delete;
+    profileScope& operator=(const profileScope&) = delete;
+};
+
+#define PROFILE_JOIN_INNER(a, b) a##b
+#define PROFILE_JOIN(a, b) PROFILE_JOIN_INNER(a, b)
+
+#ifdef GRAVITY_PROFILE
+#define PROFILE_SCOPE(name) profileScope PROFILE_JOIN(profileScope_, __LINE__)(name)
+#define PROFILE_THREAD(name) profiler::setThreadName(name)
+#else
+#define PROFILE_SCOPE(name) ((void)0)
+#define PROFILE_THREAD(name) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,219 @@
+#ifndef PROGRAM_CACHE_H
+#define PROGRAM_CACHE_H
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+// GL 4.1 / ARB_get_program_binary, which a 3.3 core loader does not know about
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
+// On-disk cache of linked shader programs. Entries are keyed by a hash of both shader sources and the
+// driver's vendor, renderer and version strings, so an edited shader or a driver update simply misses.
+// The driver may still reject a binary it wrote itself; load() reports that and the caller links from
+// source, after which store() replaces the entry.
+class programCache {
+private:
+    typedef void (APIENTRY *getProgramBinaryFunction)(GLuint, GLsizei, GLsizei*, GLenum*, void*);
+    typedef void (APIENTRY *programBinaryFunction)(GLuint, GLenum, const void*, GLsizei);
+    typedef void (APIENTRY *programParameteriFunction)(GLuint, GLenum, GLint);
+
+    struct entryHeader {
+        char magic[8];
+        uint64_t key;
+        uint32_t format;
+        uint32_t length;
+    };
+
+    static constexpr char MAGIC[8] = {'G', 'R', 'A', 'V', 'P', 'R', 'G', '1'};
+    static constexpr uint32_t MAX_LENGTH = 64u << 20;
+
+    static inline int supported = -1;
+    static inline getProgramBinaryFunction getProgramBinary = nullptr;
+    static inline programBinaryFunction programBinary = nullptr;
+    static inline programParameteriFunction programParameteri = nullptr;
+
+    static uint64_t hash(uint64_t value, const std::string &text) {
+        // FNV-1a, with a separator so ("ab", "c") and ("a", "bc") differ
+        for(unsigned char c : text) value = (value ^ c) * 1099511628211ull;
+        return (value ^ 0xff) * 1099511628211ull;
+    }
+
+    static std::string driverString(GLenum name) {
+        const GLubyte *value = glGetString(name);
+        return value ? (const char*)value : "";
+    }
+
+    static bool hasExtension(const char *name) {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for(GLint i = 0; i < count; i++) {
+            const GLubyte *extension = glGetStringi(GL_EXTENSIONS, i);
+            if(extension && std::strcmp((const char*)extension, name) == 0) return true;
+        }
+        return false;
+    }
+
+    // Needs a current context, so it runs on the first shader rather than at startup.
+    static bool available() {
+        if(supported >= 0) return supported;
+        supported = 0;
+        if(directory.empty()) return false;
+
+        GLint major = 0, minor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        if(major * 10 + minor < 41 && !hasExtension("GL_ARB_get_program_binary")) return false;
+
+        getProgramBinary = (getProgramBinaryFunction)glfwGetProcAddress("glGetProgramBinary");
+        programBinary = (programBinaryFunction)glfwGetProcAddress("glProgramBinary");
+        programParameteri = (programParameteriFunction)glfwGetProcAddress("glProgramParameteri");
+        if(!getProgramBinary || !programBinary || !programParameteri) return false;
+
+        // drivers may expose the entry points without a single format they can save
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        supported = formats > 0;
+        return supported;
+    }
+
+    static std::string entryPath(uint64_t key) {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+        return (std::filesystem::path(directory) / name).string();
+    }
+
+    static std::string defaultDirectory() {
+        const char *base = std::getenv("XDG_CACHE_HOME");
+        if(base && *base) return std::string(base) + "/gravity-simulator/shaders";
+
+        base = std::getenv("LOCALAPPDATA");
+        if(base && *base) return std::string(base) + "/gravity-simulator/shaders";
+
+        base = std::getenv("HOME");
+        if(base && *base) return std::string(base) + "/.cache/gravity-simulator/shaders";
+        return "";
+    }
+public:
+    // empty turns the cache off
+    static inline std::string directory = defaultDirectory();
+
+    static inline int hits = 0;
+    static inline int misses = 0;
+
+    static uint64_t key(const std::string &vertexCode, const std::string &fragmentCode) {
+        uint64_t value = 14695981039346656037ull;
+        value = hash(value, vertexCode);
+        value = hash(value, fragmentCode);
+        value = hash(value, driverString(GL_VENDOR));
+        value = hash(value, driverString(GL_RENDERER));
+        return hash(value, driverString(GL_VERSION));
+    }
+
+    // Call before glLinkProgram so the driver keeps the binary around for store().
+    static void prepare(GLuint program) {
+        if(available()) programParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    // Loads the cached binary into program. False when there is no usable entry, the program is
+    // then left unlinked for the caller to build from source.
+    static bool load(GLuint program, uint64_t key) {
+        if(!available()) return false;
+
+        std::string path = entryPath(key);
+        std::ifstream file(path, std::ios::binary);
+        if(!file) {
+            misses++;
+            return false;
+        }
+
+        entryHeader header;
+        std::vector<char> binary;
+        bool intact = (bool)file.read((char*)&header, sizeof(header))
+                   && std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 && header.key == key && header.length <= MAX_LENGTH;
+        if(intact) {
+            binary.resize(header.length);
+            intact = (bool)file.read(binary.data(), binary.size()) && file.peek() == std::ifstream::traits_type::eof();
+        }
+        file.close();
+
+        GLint linked = GL_FALSE;
+        if(intact) {
+            programBinary(program, header.format, binary.data(), binary.size());
+            glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        }
+
+        if(!linked) {
+            std::cout << "Discarding stale shader cache entry " << path << '\n';
+            std::remove(path.c_str());
+            misses++;
+            return false;
+        }
+        hits++;
+        return true;
+    }
+
+    // Saves a linked program. Written to a temporary file and renamed, so a concurrent or interrupted
+    // run never leaves a half-written entry behind.
+    static void store(GLuint program, uint64_t key) {
+        if(!available()) return;
+
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if(length <= 0) return;
+
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        GLsizei written = 0;
+        getProgramBinary(program, length, &written, &format, binary.data());
+        if(written <= 0) return;
+
+        entryHeader header;
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.key = key;
+        header.format = format;
+        header.length = written;
+
+        std::error_code error;
+        std::filesystem::create_directories(directory, error);
+
+        std::string path = entryPath(key);
+        std::string temporary = path + ".tmp" + std::to_string(std::random_device{}());
+        {
+            std::ofstream file(temporary, std::ios::binary);
+            if(!file.write((const char*)&header, sizeof(header)) || !file.write(binary.data(), written)) {
+                file.close();
+                std::remove(temporary.c_str());
+                std::cout << "Could not write shader cache entry " << path << '\n';
+                return;
+            }
+        }
+
+        std::filesystem::rename(temporary, path, error);
+        if(error) {
+            std::remove(temporary.c_str());
+            std::cout << "Could not write shader cache entry " << path << ": " << error.message() << '\n';
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,192 @@
+#ifndef SCENE_H
+#define SCENE_H
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <cstdlib>
+#include <cstdio>
+#include <cctype>
+#include <cmath>
+#include <iterator>
+#include "physics.h"
+#include "generators.h"
+
+// Plain-text scenes, one body per line:
+//   x y z  vx vy vz  mass density  r g b  star
+// or one generator per line, a name followed by key=value settings (vectors as comma lists):
+//   plummer count=100000 mass=5000 radius=150
+//   disk count=500000 mass=2000 radius=120 thickness=2 central=500 color=0.8,0.8,1
+//   ring count=20000 mass=5 radius=400 outer=450 central=500 seed=7
+//   plummer count=300 mass=30000 radius=400 star=1
+// Keys: count mass radius outer thickness central center velocity density color star seed.
+// Blank lines and lines starting with '#' are ignored.
+class scene {
+private:
+    static bool parseVector(const std::string &value, float &x, float &y, float &z) {
+        int consumed = 0;
+        return std::sscanf(value.c_str(), "%f,%f,%f%n", &x, &y, &z, &consumed) == 3 && value[consumed] == '\0'
+            && std::isfinite(x) && std::isfinite(y) && std::isfinite(z);
+    }
+
+    // Fills in one key=value setting, or returns why it is not acceptable.
+    static const char* parseSetting(const std::string &key, const std::string &value, generatorSettings &settings) {
+        char *end = nullptr;
+        float number = std::strtof(value.c_str(), &end);
+        bool isNumber = end != value.c_str() && *end == '\0' && std::isfinite(number);
+
+        if(key == "center") return parseVector(value, settings.centerX, settings.centerY, settings.centerZ) ? nullptr : "expected x,y,z";
+        if(key == "velocity") return parseVector(value, settings.velocityX, settings.velocityY, settings.velocityZ) ? nullptr : "expected x,y,z";
+        if(key == "color") return parseVector(value, settings.colorR, settings.colorG, settings.colorB) ? nullptr : "expected r,g,b";
+
+        if(key == "count") {
+            unsigned long long count = std::strtoull(value.c_str(), &end, 10);
+            if(value.empty() || value[0] == '-' || *end != '\0' || count == 0) return "expected a positive whole number";
+            settings.count = count;
+            return nullptr;
+        }
+        if(key == "seed") {
+            unsigned long long seed = std::strtoull(value.c_str(), &end, 10);
+            if(value.empty() || value[0] == '-' || *end != '\0') return "expected a whole number";
+            settings.seed = seed;
+            return nullptr;
+        }
+        if(!isNumber) return "expected a finite number";
+
+        if(key == "mass" || key == "radius" || key == "density") {
+            if(number <= 0.0f) return "must be positive";
+            if(key == "mass") settings.mass = number;
+            else if(key == "radius") settings.radius = number;
+            else settings.density = number;
+        }
+        else if(key == "outer" || key == "thickness" || key == "central") {
+            if(number < 0.0f) return "must not be negative";
+            if(key == "outer") settings.outer = number;
+            else if(key == "thickness") settings.thickness = number;
+            else settings.centralMass = number;
+        }
+        else if(key == "star") settings.star = number != 0.0f;
+        else return "unknown key";
+        return nullptr;
+    }
+
+    static bool runGenerator(const std::string &line, const std::string &path, int lineNumber) {
+        std::istringstream stream(line);
+        std::string name, token;
+        stream >> name;
+
+        generatorSettings settings;
+        while(stream >> token) {
+            size_t equals = token.find('=');
+            const char *problem = equals == std::string::npos ? "expected key=value" : parseSetting(token.substr(0, equals), token.substr(equals + 1), settings);
+            if(problem) {
+                std::cout << "Could not parse generator setting '" << token << "' on line " << lineNumber << " of " << path << ": " << problem << '\n';
+                return false;
+            }
+        }
+        if(name == "ring" && settings.outer < settings.radius) {
+            std::cout << "Ring outer radius is inside its inner radius on line " << lineNumber << " of " << path << '\n';
+            return false;
+        }
+
+        bodyStore &bodies = physicsEngine::getBodies();
+        threadPool *workers = physicsEngine::threads > 1 ? &physicsEngine::getPool() : nullptr;
+
+        if(name == "plummer") generators::plummer(bodies, settings, physicsEngine::GRAVITY, workers);
+        else if(name == "disk") generators::exponentialDisk(bodies, settings, physicsEngine::GRAVITY, physicsEngine::EPS, workers);
+        else if(name == "ring") generators::kuiperRing(bodies, settings, physicsEngine::GRAVITY, physicsEngine::EPS, workers);
+        else {
+            std::cout << "Unknown generator '" << name << "' on line " << lineNumber << " of " << path << '\n';
+            return false;
+        }
+
+        physicsEngine::invalidateAccelerations();
+        return true;
+    }
+public:
+    static bool load(const std::string &path) {
+        std::ifstream file(path, std::ios::binary);
+        if(!file.is_open()) {
+            std::cout << "Could not open scene file: " << path << '\n';
+            return false;
+        }
+
+        // read everything at once and parse numbers in place, large body lists are bound by parsing
+        std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+        size_t position = 0;
+        int lineNumber = 0;
+
+        while(position < text.size()) {
+            size_t end = text.find('\n', position);
+            if(end == std::string::npos) end = text.size();
+
+            // terminate the line in place so number parsing cannot run into the next one
+            char *line = &text[position];
+            text[end] = '\0';
+            position = end + 1;
+            lineNumber++;
+
+            const char *first = line;
+            while(*first == ' ' || *first == '\t' || *first == '\r') first++;
+            if(*first == '\0' || *first == '#') continue;
+
+            if(std::isalpha((unsigned char)*first)) {
+                if(!runGenerator(line, path, lineNumber)) return false;
+                continue;
+            }
+
+            float values[11];
+            const char *cursor = line;
+            char *next = nullptr;
+            bool parsed = true;
+
+            for(float &value : values) {
+                value = std::strtof(cursor, &next);
+                if(next == cursor || !std::isfinite(value)) { parsed = false; break; }
+                cursor = next;
+            }
+            long star = parsed ? std::strtol(cursor, &next, 10) : 0;
+            parsed = parsed && next != cursor;
+
+            // nothing but whitespace may follow the star flag
+            cursor = next;
+            while(parsed && (*cursor == ' ' || *cursor == '\t' || *cursor == '\r')) cursor++;
+
+            if(!parsed || *cursor != '\0') {
+                std::cout << "Could not parse body on line " << lineNumber << " of " << path << '\n';
+                return false;
+            }
+            if(values[6] <= 0.0f || values[7] <= 0.0f) {
+                std::cout << "Body mass and density must be positive on line " << lineNumber << " of " << path << '\n';
+                return false;
+            }
+
+            physicsEngine::addBody(values[0], values[1], values[2], values[3], values[4], values[5],
+                                   values[6], values[7], values[8], values[9], values[10], star ? BODY_STAR : 0u);
+        }
+        return true;
+    }
+
+    static bool save(const std::string &path, const bodyStore &bodies) {
+        std::ofstream file(path);
+        if(!file.is_open()) {
+            std::cout << "Could not write scene file: " << path << '\n';
+            return false;
+        }
+
+        file.precision(9);
+        file << "# x y z vx vy vz mass density r g b star" << '\n';
+
+        for(size_t i = 0; i < bodies.size(); i++) {
+            file << bodies.x[i] << ' ' << bodies.y[i] << ' ' << bodies.z[i] << ' '
+                 << bodies.vx[i] << ' ' << bodies.vy[i] << ' ' << bodies.vz[i] << ' '
+                 << bodies.mass[i] << ' ' << bodies.density[i] << ' '
+                 << bodies.colorR[i] << ' ' << bodies.colorG[i] << ' ' << bodies.colorB[i] << ' '
+                 << (bodies.isStar(i) ? 1 : 0) << '\n';
+        }
+        return true;
+    }
+};
+
+#endif
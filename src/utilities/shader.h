@@ -4,126 +4,262 @@
 #include <string>
 #include <fstream>
 #include <sstream>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include "program_cache.h"
+#ifdef GRAVITY_EMBED_SHADERS
+#include "embedded_shaders.h"
+#endif
 
 class shader {
-    public:
-    GLuint ID;
+    private:
+    std::unordered_map<std::string, GLint> uniformLocations;
+    bool linked = false;
 
-    shader(const char *vertexShaderPath, const char *fragmentShaderPath) {
-        std::string vertexCode;
-        std::string fragmentCode;
-        std::ifstream vertexShaderFile;
-        std::ifstream fragmentShaderFile;
+    // Resolves every active uniform once after linking, including each element of uniform arrays,
+    // so the setters below never have to ask the driver again.
+    void cacheUniformLocations() {
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
 
-        vertexShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-        fragmentShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+        std::vector<GLchar> buffer(maxLength + 1);
+        for(GLint i = 0; i < count; i++) {
+            GLint size;
+            GLenum type;
+            GLsizei length;
+            glGetActiveUniform(ID, i, buffer.size(), &length, &size, &type, buffer.data());
 
-        try {
-            vertexShaderFile.open(vertexShaderPath);
-            fragmentShaderFile.open(fragmentShaderPath);
-            std::stringstream vertexShaderStream, fragmentShaderStream;
+            std::string name(buffer.data(), length);
+            GLint location = glGetUniformLocation(ID, name.c_str());
+            if(location < 0) continue;
 
-            vertexShaderStream << vertexShaderFile.rdbuf();
-            fragmentShaderStream << fragmentShaderFile.rdbuf();
+            uniformLocations[name] = location;
 
-            vertexShaderFile.close();
-            fragmentShaderFile.close();
+            size_t bracket = name.rfind("[0]");
+            if(bracket == std::string::npos || bracket + 3 != name.size()) continue;
 
-            vertexCode = vertexShaderStream.str();
-            fragmentCode = fragmentShaderStream.str();
+            std::string base = name.substr(0, bracket);
+            uniformLocations[base] = location;
+            for(GLint element = 1; element < size; element++) {
+                std::string elementName = base + '[' + std::to_string(element) + ']';
+                uniformLocations[elementName] = glGetUniformLocation(ID, elementName.c_str());
+            }
+        }
+    }
 
+    // Embedded copies win when the build has them, so the renderer runs from any working directory.
+    static bool readSource(const char *path, std::string &code) {
+#ifdef GRAVITY_EMBED_SHADERS
+        for(const embeddedShader &embedded : EMBEDDED_SHADERS) {
+            if(std::strcmp(embedded.path, path) == 0) {
+                code = embedded.source;
+                return true;
+            }
         }
-        catch (std::ifstream::failure &error) {
-            std::cout << "Could not read shader file: " << error.what() << '\n';
+#endif
+        std::ifstream file(path, std::ios::binary);
+        std::stringstream stream;
+        if(!file || !(stream << file.rdbuf())) {
+            std::cout << "Could not read shader file: " << path << '\n';
+            return false;
         }
-        const char *vertexShaderCode = vertexCode.c_str();
-        const char *fragmentShaderCode = fragmentCode.c_str();
+        code = stream.str();
+        return true;
+    }
 
-        GLuint vertex, fragment;
-        int success;
-        char infoLog[512];
+    static std::string shaderLog(GLuint object) {
+        GLint length = 0;
+        glGetShaderiv(object, GL_INFO_LOG_LENGTH, &length);
 
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vertexShaderCode, NULL);
-        glCompileShader(vertex);
+        std::string log(std::max(length, 1), '\0');
+        glGetShaderInfoLog(object, log.size(), NULL, log.data());
+        return log.c_str();
+    }
 
-        glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
-        if(!success) {
-            glGetShaderInfoLog(vertex, 512, NULL, infoLog);
-            std::cout << "Could not compile VERTEX shader: " << infoLog << '\n';
-        }
+    static std::string programLog(GLuint object) {
+        GLint length = 0;
+        glGetProgramiv(object, GL_INFO_LOG_LENGTH, &length);
+
+        std::string log(std::max(length, 1), '\0');
+        glGetProgramInfoLog(object, log.size(), NULL, log.data());
+        return log.c_str();
+    }
 
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fragmentShaderCode, NULL);
-        glCompileShader(fragment);
+    // Returns 0 when the stage does not compile.
+    static GLuint compile(GLenum stage, const std::string &code, const char *path) {
+        const char *source = code.c_str();
+        GLuint object = glCreateShader(stage);
+        glShaderSource(object, 1, &source, NULL);
+        glCompileShader(object);
 
-        glGetShaderiv(fragment, GL_COMPILE_STATUS, &success);
+        GLint success;
+        glGetShaderiv(object, GL_COMPILE_STATUS, &success);
         if(!success) {
-            glGetShaderInfoLog(fragment, 512, NULL, infoLog);
-            std::cout << "Could not compile FRAGMENT shader: " << infoLog << '\n';
+            std::cout << "Could not compile " << (stage == GL_VERTEX_SHADER ? "VERTEX" : "FRAGMENT") << " shader " << path << ": " << shaderLog(object) << '\n';
+            glDeleteShader(object);
+            return 0;
         }
+        return object;
+    }
+
+    public:
+    GLuint ID;
 
+    shader(const char *vertexShaderPath, const char *fragmentShaderPath) {
+        std::string vertexCode, fragmentCode;
         ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
 
-        glLinkProgram(ID);
-        glGetProgramiv(ID, GL_LINK_STATUS, &success);
-        if(!success) {
-            glGetProgramInfoLog(ID, 512, NULL, infoLog);
-            std::cout << "Could not link shaders: " << infoLog << '\n';
+        if(!readSource(vertexShaderPath, vertexCode) || !readSource(fragmentShaderPath, fragmentCode)) return;
+
+        uint64_t key = programCache::key(vertexCode, fragmentCode);
+        if(programCache::load(ID, key)) {
+            linked = true;
+            cacheUniformLocations();
+            return;
+        }
+
+        GLuint vertex = compile(GL_VERTEX_SHADER, vertexCode, vertexShaderPath);
+        GLuint fragment = compile(GL_FRAGMENT_SHADER, fragmentCode, fragmentShaderPath);
+
+        if(vertex && fragment) {
+            glAttachShader(ID, vertex);
+            glAttachShader(ID, fragment);
+            programCache::prepare(ID);
+            glLinkProgram(ID);
+
+            GLint success;
+            glGetProgramiv(ID, GL_LINK_STATUS, &success);
+            if(success) {
+                linked = true;
+            }
+            else {
+                std::cout << "Could not link shaders " << vertexShaderPath << " and " << fragmentShaderPath << ": " << programLog(ID) << '\n';
+            }
+            glDetachShader(ID, vertex);
+            glDetachShader(ID, fragment);
         }
 
         glDeleteShader(vertex);
         glDeleteShader(fragment);
+        if(!linked) return;
+
+        programCache::store(ID, key);
+        cacheUniformLocations();
+    }
+
+    shader(const shader&) = delete;
+    shader& operator=(const shader&) = delete;
+
+    ~shader() {
+        glDeleteProgram(ID);
+    }
+
+    // False when a source was missing or did not compile or link; drawing with it would draw nothing.
+    bool valid() const {
+        return linked;
     }
 
     void use() {
         glUseProgram(ID);
     }
 
+    GLint getLocation(const GLchar *name) const {
+        auto found = uniformLocations.find(name);
+        return found == uniformLocations.end() ? -1 : found->second;
+    }
+
+    // Attaches a `layout (std140) uniform <name>` block to a uniform buffer binding point.
+    void bindUniformBlock(const GLchar *name, GLuint binding) {
+        GLuint index = glGetUniformBlockIndex(ID, name);
+        if(index != GL_INVALID_INDEX) glUniformBlockBinding(ID, index, binding);
+    }
+
     void setBool(const GLchar *name, bool value) {
-        glUniform1i(glGetUniformLocation(ID, name), value);
+        setBool(getLocation(name), value);
+    }
+
+    void setBool(GLint location, bool value) {
+        glUniform1i(location, value);
     }
 
     void setInt(const GLchar *name, int value) {
-        glUniform1i(glGetUniformLocation(ID, name), value);
+        setInt(getLocation(name), value);
+    }
+
+    void setInt(GLint location, int value) {
+        glUniform1i(location, value);
     }
 
     void setFloat(const GLchar *name, float value) {
-        glUniform1f(glGetUniformLocation(ID, name), value);
+        setFloat(getLocation(name), value);
+    }
+
+    void setFloat(GLint location, float value) {
+        glUniform1f(location, value);
     }
 
     void setVec4(const GLchar *name, glm::vec4 value) {
-        glUniform4fv(glGetUniformLocation(ID, name), 1, glm::value_ptr(value));
+        setVec4(getLocation(name), value);
+    }
+
+    void setVec4(GLint location, glm::vec4 value) {
+        glUniform4fv(location, 1, glm::value_ptr(value));
     }
 
     void setVec3(const GLchar *name, glm::vec3 value) {
-        glUniform3fv(glGetUniformLocation(ID, name), 1, glm::value_ptr(value));
+        setVec3(getLocation(name), value);
+    }
+
+    void setVec3(GLint location, glm::vec3 value) {
+        glUniform3fv(location, 1, glm::value_ptr(value));
     }
 
     void setVec2(const GLchar *name, glm::vec2 value) {
-        glUniform2fv(glGetUniformLocation(ID, name), 1, glm::value_ptr(value));
+        setVec2(getLocation(name), value);
+    }
+
+    void setVec2(GLint location, glm::vec2 value) {
+        glUniform2fv(location, 1, glm::value_ptr(value));
     }
 
     void setVec1(const GLchar *name, glm::vec1 value) {
-        glUniform1fv(glGetUniformLocation(ID, name), 1, glm::value_ptr(value));
+        setVec1(getLocation(name), value);
+    }
+
+    void setVec1(GLint location, glm::vec1 value) {
+        glUniform1fv(location, 1, glm::value_ptr(value));
     }
 
     void setMat4(const GLchar *name, glm::mat4 value) {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name), 1, GL_FALSE, glm::value_ptr(value));
+        setMat4(getLocation(name), value);
+    }
+
+    void setMat4(GLint location, glm::mat4 value) {
+        glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value));
     }
 
     void setMat3(const GLchar *name, glm::mat3 value) {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name), 1, GL_FALSE, glm::value_ptr(value));
+        setMat3(getLocation(name), value);
+    }
+
+    void setMat3(GLint location, glm::mat3 value) {
+        glUniformMatrix3fv(location, 1, GL_FALSE, glm::value_ptr(value));
     }
 
     void setMat2(const GLchar *name, glm::mat2 value) {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name), 1, GL_FALSE, glm::value_ptr(value));
+        setMat2(getLocation(name), value);
+    }
+
+    void setMat2(GLint location, glm::mat2 value) {
+        glUniformMatrix2fv(location, 1, GL_FALSE, glm::value_ptr(value));
     }
 };
 
@@ -0,0 +1,185 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include "physics.h"
+#include "mapped_file.h"
+
+// Versioned binary checkpoint of the whole simulation. A 64 byte header is followed by one
+// contiguous array per field, in the order listed in forEachField(): positions, velocities, mass,
+// density, color, the body flags, then the position and velocity residuals of double-precision runs.
+// Every array holds bodyCount 4 byte values in native byte order; byteOrder lets a reader on a machine
+// with the other endianness reject the file. Bump VERSION whenever the field list changes; version 1
+// files stop before the residuals and still load, with the residuals zeroed.
+class snapshot {
+public:
+    static constexpr uint32_t VERSION = 2;
+    static constexpr uint32_t ENDIAN_MARKER = 0x01020304;
+
+    struct header {
+        char magic[8];
+        uint32_t version;
+        uint32_t byteOrder;
+        uint64_t bodyCount;
+        uint64_t step;
+        double time;
+        uint32_t fieldCount;
+        uint32_t reserved[5];
+    };
+    static_assert(sizeof(header) == 64, "snapshot header must stay 64 bytes");
+private:
+    static constexpr char MAGIC[8] = {'G', 'R', 'A', 'V', 'S', 'N', 'A', 'P'};
+    static constexpr uint32_t FIELD_COUNT = 18;
+    static constexpr uint32_t VERSION_1_FIELD_COUNT = 12;
+
+    // Forces the file's contents to disk, the rename that publishes it must not land first.
+    static bool syncFile(const std::string &path) {
+#ifdef _WIN32
+        HANDLE handle = CreateFileA(path.c_str(), GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if(handle == INVALID_HANDLE_VALUE) return false;
+        bool ok = FlushFileBuffers(handle);
+        CloseHandle(handle);
+        return ok;
+#else
+        int descriptor = ::open(path.c_str(), O_RDONLY);
+        if(descriptor < 0) return false;
+        bool ok = ::fsync(descriptor) == 0;
+        ::close(descriptor);
+        return ok;
+#endif
+    }
+
+    // Renames temporary over path and makes the rename itself durable.
+    static bool replaceDurably(const std::string &temporary, const std::string &path) {
+#ifdef _WIN32
+        return MoveFileExA(temporary.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+#else
+        std::error_code error;
+        std::filesystem::rename(temporary, path, error);
+        if(error) return false;
+
+        std::filesystem::path directory = std::filesystem::path(path).parent_path();
+        int descriptor = ::open(directory.empty() ? "." : directory.c_str(), O_RDONLY);
+        if(descriptor < 0) return false;
+        bool ok = ::fsync(descriptor) == 0;
+        ::close(descriptor);
+        return ok;
+#endif
+    }
+
+    template<typename Store, typename Function>
+    static void forEachField(Store &bodies, Function function) {
+        function(bodies.x); function(bodies.y); function(bodies.z);
+        function(bodies.vx); function(bodies.vy); function(bodies.vz);
+        function(bodies.mass);
+        function(bodies.density);
+        function(bodies.colorR); function(bodies.colorG); function(bodies.colorB);
+        function(bodies.flags);
+        function(bodies.lowX); function(bodies.lowY); function(bodies.lowZ);
+        function(bodies.lowVX); function(bodies.lowVY); function(bodies.lowVZ);
+    }
+public:
+    // Writes to a temporary file, syncs it and renames it over `path`, then syncs the directory, so
+    // neither an interrupted save nor a crash right after one leaves a truncated checkpoint behind.
+    static bool save(const std::string &path, const bodyStore &bodies, uint64_t step, double time) {
+        std::string temporary = path + ".tmp";
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        if(!file.is_open()) {
+            std::cout << "Could not write snapshot file: " << temporary << '\n';
+            return false;
+        }
+
+        header info{};
+        std::memcpy(info.magic, MAGIC, sizeof(MAGIC));
+        info.version = VERSION;
+        info.byteOrder = ENDIAN_MARKER;
+        info.bodyCount = bodies.size();
+        info.step = step;
+        info.time = time;
+        info.fieldCount = FIELD_COUNT;
+
+        file.write((const char*)&info, sizeof(info));
+        forEachField(bodies, [&](const auto &array) {
+            file.write((const char*)array.data(), array.size() * sizeof(array[0]));
+        });
+        file.close();
+
+        if(!file || !syncFile(temporary)) {
+            std::cout << "Could not write snapshot file: " << temporary << '\n';
+            return false;
+        }
+
+        if(!replaceDurably(temporary, path)) {
+            std::cout << "Could not replace snapshot file: " << path << '\n';
+            return false;
+        }
+        return true;
+    }
+
+    // Maps the file and copies each field straight into the engine's body store, replacing every body,
+    // and restores the step count and simulation time.
+    static bool load(const std::string &path) {
+        mappedFile file;
+        if(!file.open(path)) {
+            std::cout << "Could not open snapshot file: " << path << '\n';
+            return false;
+        }
+
+        header info;
+        if(file.size() < sizeof(info)) {
+            std::cout << "Snapshot file is truncated: " << path << '\n';
+            return false;
+        }
+        std::memcpy(&info, file.data(), sizeof(info));
+
+        if(std::memcmp(info.magic, MAGIC, sizeof(MAGIC)) != 0 || info.byteOrder != ENDIAN_MARKER) {
+            std::cout << "Not a snapshot file for this machine: " << path << '\n';
+            return false;
+        }
+        uint32_t fields = info.version == 1 ? VERSION_1_FIELD_COUNT : FIELD_COUNT;
+        if((info.version != 1 && info.version != VERSION) || info.fieldCount != fields) {
+            std::cout << "Unsupported snapshot version " << info.version << " in " << path << '\n';
+            return false;
+        }
+
+        size_t count = info.bodyCount;
+        if(file.size() != sizeof(info) + (size_t)fields * count * 4) {
+            std::cout << "Snapshot file is truncated: " << path << '\n';
+            return false;
+        }
+
+        bodyStore &bodies = physicsEngine::getBodies();
+        bodies.resize(count);
+
+        const unsigned char *cursor = file.data() + sizeof(info);
+        uint32_t field = 0;
+        forEachField(bodies, [&](auto &array) {
+            if(field++ >= fields) {
+                std::fill(array.begin(), array.end(), 0);
+                return;
+            }
+            std::memcpy(array.data(), cursor, count * sizeof(array[0]));
+            cursor += count * sizeof(array[0]);
+        });
+
+        for(size_t i = 0; i < count; i++) {
+            bodies.radius[i] = bodyStore::radiusFor(bodies.mass[i], bodies.density[i]);
+        }
+        bodies.prevX = bodies.x;
+        bodies.prevY = bodies.y;
+        bodies.prevZ = bodies.z;
+
+        physicsEngine::invalidateAccelerations();
+        physicsEngine::stepCount = info.step;
+        physicsEngine::simulationTime = info.time;
+        return true;
+    }
+};
+
+#endif
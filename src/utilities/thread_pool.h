@@ -0,0 +1,159 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <string>
+#include "profiler.h"
+
+// Fork-join pool with work stealing. Every parallelFor hands each worker a contiguous range of task
+// indices; a worker pops tasks from the front of its own range and, once it runs dry, steals single
+// tasks from the back of the other ranges. Each range is one 64-bit word (front | back << 32) updated
+// with compare-and-swap, so taking and stealing never lock. The calling thread works as worker 0.
+class threadPool {
+private:
+    struct alignas(64) taskRange {
+        std::atomic<uint64_t> bounds{0};
+    };
+
+    std::vector<std::thread> threads;
+    std::unique_ptr<taskRange[]> ranges;
+    const unsigned workerCount;
+
+    const std::function<void(size_t, unsigned)> *job = nullptr;
+    std::atomic<size_t> remaining{0};
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    uint64_t generation = 0;
+    bool stopping = false;
+
+    static uint64_t pack(uint32_t front, uint32_t back) {
+        return (uint64_t)back << 32 | front;
+    }
+
+    bool takeOwn(unsigned worker, size_t &task) {
+        std::atomic<uint64_t> &bounds = ranges[worker].bounds;
+        uint64_t current = bounds.load();
+
+        while(true) {
+            uint32_t front = current, back = current >> 32;
+            if(front >= back) return false;
+
+            if(bounds.compare_exchange_weak(current, pack(front + 1, back))) {
+                task = front;
+                return true;
+            }
+        }
+    }
+
+    bool steal(unsigned victim, size_t &task) {
+        std::atomic<uint64_t> &bounds = ranges[victim].bounds;
+        uint64_t current = bounds.load();
+
+        while(true) {
+            uint32_t front = current, back = current >> 32;
+            if(front >= back) return false;
+
+            if(bounds.compare_exchange_weak(current, pack(front, back - 1))) {
+                task = back - 1;
+                return true;
+            }
+        }
+    }
+
+    void work(unsigned worker) {
+        size_t task;
+
+        while(true) {
+            bool found = takeOwn(worker, task);
+
+            for(unsigned offset = 1; !found && offset < workerCount; offset++) {
+                found = steal((worker + offset) % workerCount, task);
+            }
+            if(!found) return;
+
+            (*job)(task, worker);
+            remaining.fetch_sub(1);
+        }
+    }
+
+    void workerLoop(unsigned worker) {
+        PROFILE_THREAD("worker " + std::to_string(worker));
+        uint64_t seen = 0;
+
+        while(true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+
+                if(stopping) return;
+                seen = generation;
+            }
+            PROFILE_SCOPE("parallelFor");
+            work(worker);
+        }
+    }
+public:
+    explicit threadPool(unsigned count) : workerCount(count > 0 ? count : 1) {
+        ranges = std::make_unique<taskRange[]>(workerCount);
+
+        for(unsigned worker = 1; worker < workerCount; worker++) {
+            threads.emplace_back(&threadPool::workerLoop, this, worker);
+        }
+    }
+
+    ~threadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+
+        for(auto &thread : threads) thread.join();
+    }
+
+    threadPool(const threadPool&) = delete;
+    threadPool& operator=(const threadPool&) = delete;
+
+    unsigned size() const { return workerCount; }
+
+    // Runs function(task, worker) for every task in [0, taskCount) and returns once all of them finished.
+    void parallelFor(size_t taskCount, const std::function<void(size_t, unsigned)> &function) {
+        if(taskCount == 0) return;
+
+        if(workerCount == 1) {
+            for(size_t task = 0; task < taskCount; task++) function(task, 0);
+            return;
+        }
+
+        job = &function;
+        remaining.store(taskCount);
+
+        for(unsigned worker = 0; worker < workerCount; worker++) {
+            size_t begin = taskCount * worker / workerCount;
+            size_t end = taskCount * (worker + 1) / workerCount;
+
+            ranges[worker].bounds.store(pack(begin, end));
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            generation++;
+        }
+        wake.notify_all();
+
+        PROFILE_SCOPE("parallelFor");
+        work(0);
+        while(remaining.load() != 0) {
+            std::this_thread::yield();
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,209 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "bodies.h"
+#include "profiler.h"
+
+// Append-only binary trajectory. The file starts with a 16 byte header (magic "GRAVTRAJ", version,
+// byte order marker) followed by one frame per recorded step:
+//   uint64 step, double time, uint64 count, then count floats each of x, y and z.
+// Frames are self-describing so the body count may change between them.
+//
+// record() copies positions into a spare buffer and returns; a background thread does the writes.
+// Once MAX_PENDING frames are waiting on the disk the step loop blocks until one is written,
+// which bounds memory when storage is slower than the simulation.
+class trajectoryWriter {
+private:
+    static constexpr char MAGIC[8] = {'G', 'R', 'A', 'V', 'T', 'R', 'A', 'J'};
+    static constexpr uint32_t VERSION = 1;
+    static constexpr uint32_t ENDIAN_MARKER = 0x01020304;
+    static constexpr size_t MAX_PENDING = 4;
+    static constexpr uint64_t HEADER_SIZE = 16;
+    static constexpr uint64_t FRAME_HEADER_SIZE = 24;
+
+    struct frame {
+        uint64_t step;
+        double time;
+        std::vector<float> positions;
+    };
+
+    std::ofstream file;
+    uint64_t every = 1;
+
+    std::thread writer;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<frame> pending;
+    std::vector<frame> spare;
+    bool stopping = false;
+    bool failed = false;
+
+    // Checks the header of an existing file and finds the length of its whole frames before firstStep.
+    static bool validFrames(const std::string &path, uint64_t firstStep, uint64_t &length) {
+        std::ifstream existing(path, std::ios::binary);
+
+        char magic[8];
+        uint32_t version = 0, byteOrder = 0;
+        existing.read(magic, sizeof(magic));
+        existing.read((char*)&version, sizeof(version));
+        existing.read((char*)&byteOrder, sizeof(byteOrder));
+
+        if(!existing || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 || byteOrder != ENDIAN_MARKER) {
+            std::cout << "Not a trajectory file for this machine, refusing to append: " << path << '\n';
+            return false;
+        }
+        if(version != VERSION) {
+            std::cout << "Unsupported trajectory version " << version << " in " << path << '\n';
+            return false;
+        }
+
+        length = HEADER_SIZE;
+        uint64_t fileSize = std::filesystem::file_size(path);
+        while(true) {
+            uint64_t step, count;
+            double time;
+            existing.read((char*)&step, sizeof(step));
+            existing.read((char*)&time, sizeof(time));
+            existing.read((char*)&count, sizeof(count));
+            if(!existing || step >= firstStep) break;
+
+            uint64_t frameSize = FRAME_HEADER_SIZE + count * 3 * sizeof(float);
+            if(frameSize > fileSize - length) break;
+
+            length += frameSize;
+            existing.seekg(length);
+        }
+        return true;
+    }
+
+    void run() {
+        PROFILE_THREAD("trajectory writer");
+        std::unique_lock<std::mutex> lock(mutex);
+
+        while(true) {
+            wake.wait(lock, [&] { return stopping || !pending.empty(); });
+            if(pending.empty()) return;
+
+            frame current = std::move(pending.front());
+            pending.pop_front();
+            lock.unlock();
+
+            PROFILE_SCOPE("write frame");
+            uint64_t count = current.positions.size() / 3;
+            file.write((const char*)&current.step, sizeof(current.step));
+            file.write((const char*)&current.time, sizeof(current.time));
+            file.write((const char*)&count, sizeof(count));
+            file.write((const char*)current.positions.data(), current.positions.size() * sizeof(float));
+            bool ok = (bool)file;
+
+            lock.lock();
+            if(!ok) failed = true;
+            spare.push_back(std::move(current));
+            wake.notify_all();
+        }
+    }
+public:
+    trajectoryWriter() = default;
+
+    trajectoryWriter(const trajectoryWriter&) = delete;
+    trajectoryWriter& operator=(const trajectoryWriter&) = delete;
+
+    ~trajectoryWriter() {
+        close();
+    }
+
+    // Appends to an existing trajectory, so a restarted run keeps extending the same file. Frames from
+    // firstStep on, and a frame cut short by a crash, are dropped first: they are about to be recorded
+    // again, and keeping them would duplicate the steps between the checkpoint and the crash.
+    bool open(const std::string &path, uint64_t interval, uint64_t firstStep) {
+        close();
+
+        uint64_t keep = 0;
+        if(std::ifstream(path, std::ios::binary).good() && !validFrames(path, firstStep, keep)) return false;
+
+        std::error_code error;
+        if(keep > 0) std::filesystem::resize_file(path, keep, error);
+        if(error) {
+            std::cout << "Could not truncate trajectory file: " << path << '\n';
+            return false;
+        }
+
+        file.open(path, keep > 0 ? std::ios::binary | std::ios::app : std::ios::binary | std::ios::trunc);
+        if(!file.is_open()) {
+            std::cout << "Could not open trajectory file: " << path << '\n';
+            return false;
+        }
+
+        if(keep == 0) {
+            file.write(MAGIC, sizeof(MAGIC));
+            file.write((const char*)&VERSION, sizeof(VERSION));
+            file.write((const char*)&ENDIAN_MARKER, sizeof(ENDIAN_MARKER));
+        }
+
+        every = interval > 0 ? interval : 1;
+        stopping = false;
+        failed = false;
+        writer = std::thread([this] { run(); });
+        return true;
+    }
+
+    bool isOpen() const { return writer.joinable(); }
+
+    // Queues the current positions if `step` is a multiple of the interval.
+    void record(uint64_t step, double time, const bodyStore &bodies) {
+        if(!isOpen() || step % every != 0) return;
+        PROFILE_SCOPE("trajectory record");
+
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [&] { return pending.size() < MAX_PENDING; });
+
+        frame next;
+        if(!spare.empty()) {
+            next = std::move(spare.back());
+            spare.pop_back();
+        }
+        lock.unlock();
+
+        size_t count = bodies.size();
+        next.step = step;
+        next.time = time;
+        next.positions.resize(3 * count);
+        std::memcpy(next.positions.data(), bodies.x.data(), count * sizeof(float));
+        std::memcpy(next.positions.data() + count, bodies.y.data(), count * sizeof(float));
+        std::memcpy(next.positions.data() + 2 * count, bodies.z.data(), count * sizeof(float));
+
+        lock.lock();
+        pending.push_back(std::move(next));
+        wake.notify_all();
+    }
+
+    // Writes every queued frame and closes the file; returns false if any write failed.
+    bool close() {
+        if(!isOpen()) return !failed;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        writer.join();
+
+        file.close();
+        spare.clear();
+
+        if(failed) std::cout << "Could not write every trajectory frame" << '\n';
+        return !failed;
+    }
+};
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+#include <atomic>
+#include <cstdint>
+
+// Single producer, single consumer handoff of whole values. The producer fills its own back slot
+// and swaps it with the shared middle slot; the consumer swaps its front slot with the middle one
+// whenever a newer value was published. Each side owns one slot at any time and only exchanges an
+// index with the other, so neither ever waits, and the consumer always gets the latest value while
+// intermediate ones are dropped.
+template<typename T>
+class tripleBuffer {
+private:
+    static constexpr uint8_t INDEX_MASK = 3;
+    static constexpr uint8_t FRESH = 4;
+
+    T slots[3];
+    std::atomic<uint8_t> middle{1};
+    uint8_t back = 0;
+    uint8_t front = 2;
+public:
+    tripleBuffer() = default;
+
+    tripleBuffer(const tripleBuffer&) = delete;
+    tripleBuffer& operator=(const tripleBuffer&) = delete;
+
+    // Producer side: the slot to fill, then publish() to hand it over.
+    T& writeBuffer() { return slots[back]; }
+
+    void publish() {
+        back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX_MASK;
+    }
+
+    // Consumer side: takes the latest published value if there is one, returns whether it did.
+    bool update() {
+        if(!(middle.load(std::memory_order_relaxed) & FRESH)) return false;
+
+        front = middle.exchange(front, std::memory_order_acq_rel) & INDEX_MASK;
+        return true;
+    }
+
+    const T& readBuffer() const { return slots[front]; }
+};
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef UNIFORM_BUFFER_H
+#define UNIFORM_BUFFER_H
+#include <glad/glad.h>
+
+// Binding points shared between the C++ side and the std140 blocks in src/shaders.
+enum uniformBinding : GLuint {
+    CAMERA_BINDING = 0,
+    LIGHTS_BINDING = 1
+};
+
+class uniformBuffer {
+private:
+    GLuint ID;
+    GLsizeiptr size;
+public:
+    uniformBuffer(GLsizeiptr size, GLuint binding) : size(size) {
+        glGenBuffers(1, &ID);
+        glBindBuffer(GL_UNIFORM_BUFFER, ID);
+        glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+        glBindBufferBase(GL_UNIFORM_BUFFER, binding, ID);
+    }
+
+    // One upload per frame; the old storage is orphaned so the driver never waits on a draw still reading it.
+    void update(const void *data, GLsizeiptr bytes) {
+        glBindBuffer(GL_UNIFORM_BUFFER, ID);
+        glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, bytes < size ? bytes : size, data);
+    }
+
+    uniformBuffer(const uniformBuffer&) = delete;
+    uniformBuffer& operator=(const uniformBuffer&) = delete;
+
+    ~uniformBuffer() {
+        glDeleteBuffers(1, &ID);
+    }
+};
+
+#endif
@@ -15,32 +15,102 @@ class window {
         glViewport(0, 0, width, heigth);
     }
 
+    // Color and depth renderbuffers at the requested size, left bound as the draw and read target
+    // for the rest of the run.
+    bool createFramebuffer() {
+        GLint maxSize = 0;
+        glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &maxSize);
+        if(width <= 0 || heigth <= 0 || width > maxSize || heigth > maxSize) {
+            std::cout << "Could not create a " << width << "x" << heigth << " framebuffer, the driver allows up to " << maxSize << '\n';
+            return false;
+        }
+
+        glGenFramebuffers(1, &framebuffer);
+        glGenRenderbuffers(2, renderbuffers);
+
+        glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, heigth);
+        glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, heigth);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+
+        if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cout << "Could not create offscreen framebuffer" << '\n';
+            return false;
+        }
+        glViewport(0, 0, width, heigth);
+        return true;
+    }
+
     int width, heigth;
+    bool offscreen;
+    bool opened = false;
+
+    GLuint framebuffer = 0;
+    GLuint renderbuffers[2] = {0, 0};
     
-    GLFWwindow *currentWindow;
+    GLFWwindow *currentWindow = nullptr;
+    bool terminated = false;
     public:
     
-    window(int width, int heigth, const char *title) :  width(width), heigth(heigth) {
-        glfwInit();
+    window(int width, int heigth, const char *title, bool offscreen = false, int contextApi = GLFW_NATIVE_CONTEXT_API) :  width(width), heigth(heigth), offscreen(offscreen) {
+#ifdef GLFW_PLATFORM_NULL
+        // GLFW 3.4 can run without any display server when the context comes from OSMesa
+        if(offscreen && contextApi == GLFW_OSMESA_CONTEXT_API) glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#endif
+        if(!glfwInit()) {
+            std::cout << "Could not initialize GLFW" << (offscreen ? ", an offscreen run may need --context egl or osmesa" : "") << '\n';
+            return;
+        }
 
         glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
         glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
         glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, contextApi);
+        if(offscreen) glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
 
-        currentWindow = glfwCreateWindow(width, heigth, title, NULL, NULL);
+        // offscreen the window only carries the context, frames go to the framebuffer object below
+        currentWindow = offscreen ? glfwCreateWindow(64, 64, title, NULL, NULL) : glfwCreateWindow(width, heigth, title, NULL, NULL);
         if(currentWindow == NULL) {
             std::cout << "Could not open window, terminating GLFW..." << '\n';
             glfwTerminate();
+            terminated = true;
+            return;
         }
         glfwMakeContextCurrent(currentWindow);
-        glfwSetFramebufferSizeCallback(currentWindow, framebufferSizeCallback);
-        glfwSwapInterval(1);
+        glfwSwapInterval(offscreen ? 0 : 1);
 
         glfwSetWindowUserPointer(this->currentWindow, this);
 
         if(!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
             std::cout << "Could not load GLAD, terminating GLFW..." << '\n';
             glfwTerminate();
+            terminated = true;
+            return;
+        }
+
+        if(offscreen) {
+            opened = createFramebuffer();
+        }
+        else {
+            glfwSetFramebufferSizeCallback(currentWindow, framebufferSizeCallback);
+            opened = true;
+        }
+    }
+
+    window(const window&) = delete;
+    window& operator=(const window&) = delete;
+
+    ~window() {
+        if(framebuffer) glDeleteFramebuffers(1, &framebuffer);
+        if(renderbuffers[0]) glDeleteRenderbuffers(2, renderbuffers);
+        if(currentWindow && !terminated) {
+            glfwDestroyWindow(currentWindow);
+            glfwTerminate();
         }
     }
 
@@ -48,10 +118,15 @@ class window {
         return glfwWindowShouldClose(currentWindow);
     }
 
+    // Offscreen there is nothing to present, the frame stays in the framebuffer for readback.
     void swapBuffers() {
-        glfwSwapBuffers(currentWindow);
+        if(!offscreen) glfwSwapBuffers(currentWindow);
     }
 
+    // False when the window, its context or the offscreen framebuffer could not be created.
+    bool isOpen() { return opened; }
+    bool isOffscreen() { return offscreen; }
+
     GLFWwindow* getwindow() { return this->currentWindow; }
     
     int getWidth() { return this->width; };